@@ -0,0 +1,153 @@
+#include <QProcess>
+#include <QFileInfo>
+#include <QDir>
+#include <QJsonArray>
+#include <QRegularExpression>
+#include "backendcapabilities.h"
+#include "ssvalidator.h"
+
+//milliseconds a backend gets to print its usage
+static const int PROBE_TIMEOUT = 3000;
+
+BackendCapabilities::BackendCapabilities() :
+    probed(false),
+    timeout(true),
+    udpRelay(false),
+    fastOpen(false),
+    reusePort(false),
+    mptcp(false),
+    noDelay(false)
+{}
+
+bool BackendCapabilities::supportsCipher(const QString &method) const
+{
+    return ciphers.isEmpty() || ciphers.contains(method.toUpper());
+}
+
+QJsonObject BackendCapabilities::toJson() const
+{
+    QJsonObject json;
+    json["probed"] = QJsonValue(probed);
+    json["timeout"] = QJsonValue(timeout);
+    json["udpRelay"] = QJsonValue(udpRelay);
+    json["fastOpen"] = QJsonValue(fastOpen);
+    json["reusePort"] = QJsonValue(reusePort);
+    json["mptcp"] = QJsonValue(mptcp);
+    json["noDelay"] = QJsonValue(noDelay);
+    json["ciphers"] = QJsonArray::fromStringList(ciphers);
+    return json;
+}
+
+BackendCapabilities BackendCapabilities::fromJson(const QJsonObject &json)
+{
+    BackendCapabilities c;
+    c.probed = json["probed"].toBool();
+    c.timeout = json["timeout"].toBool(true);
+    c.udpRelay = json["udpRelay"].toBool();
+    c.fastOpen = json["fastOpen"].toBool();
+    c.reusePort = json["reusePort"].toBool();
+    c.mptcp = json["mptcp"].toBool();
+    c.noDelay = json["noDelay"].toBool();
+    QJsonArray ciphers = json["ciphers"].toArray();
+    for (QJsonArray::iterator it = ciphers.begin(); it != ciphers.end(); ++it) {
+        c.ciphers << (*it).toString();
+    }
+    return c;
+}
+
+/*
+ * The option has to start a word and be followed by white space, a separator,
+ * an argument or the end of line, so that "-u" doesn't match "--udp" or "-up".
+ */
+bool BackendCapabilities::hasOption(const QString &help, const QString &option)
+{
+    QRegularExpression re(QString("(^|[\\s,\\[])%1(?=$|[\\s,=\\]<])").arg(QRegularExpression::escape(option)), QRegularExpression::MultilineOption);
+    return re.match(help).hasMatch();
+}
+
+BackendCapabilities BackendCapabilities::fromHelp(const QString &help)
+{
+    BackendCapabilities c;
+    //every backend takes these, anything without them isn't usage text
+    if (!hasOption(help, "-s") || !hasOption(help, "-l")) {
+        return c;
+    }
+
+    c.probed = true;
+    c.timeout = hasOption(help, "-t");
+    c.udpRelay = hasOption(help, "-u");
+    c.fastOpen = hasOption(help, "--fast-open");
+    c.reusePort = hasOption(help, "--reuse-port");
+    c.mptcp = hasOption(help, "--mptcp");
+    c.noDelay = hasOption(help, "--no-delay");
+
+    QStringList found;
+    for (QStringList::const_iterator it = SSValidator::supportedMethod.begin(); it != SSValidator::supportedMethod.end(); ++it) {
+        QRegularExpression re(QString("(?<![\\w-])%1(?![\\w-])").arg(QRegularExpression::escape(*it)), QRegularExpression::CaseInsensitiveOption);
+        if (re.match(help).hasMatch()) {
+            found << *it;
+        }
+    }
+    //a word or two in the description isn't a cipher list
+    if (found.size() >= 3) {
+        c.ciphers = found;
+    }
+    return c;
+}
+
+/*
+ * What used to be hard-coded per backend type. Used when probing fails,
+ * for example because the backend prints nothing useful for -h.
+ */
+BackendCapabilities BackendCapabilities::defaults(SSProfile::BackendType type)
+{
+    BackendCapabilities c;
+    c.timeout = type != SSProfile::GO;
+#ifdef Q_OS_LINUX
+    c.fastOpen = type == SSProfile::PYTHON || type == SSProfile::LIBEV;
+#endif
+#ifdef Q_OS_WIN
+    c.udpRelay = type == SSProfile::LIBEV;
+#endif
+    return c;
+}
+
+/*
+ * Runs the backend with -h and parses what it prints. This blocks for up
+ * to a few seconds, call it from a worker thread.
+ */
+BackendCapabilities BackendCapabilities::probe(const QString &path, SSProfile::BackendType type)
+{
+    QString program = path;
+    QStringList args;
+#ifdef Q_OS_WIN
+    switch (type) {
+    case SSProfile::NODEJS:
+        program = QString("node");
+        args << QDir::toNativeSeparators(QFileInfo(path).dir().canonicalPath() + QString("/node_modules/shadowsocks/bin/sslocal"));
+        break;
+    case SSProfile::PYTHON:
+        program = QString("python");
+        args << path;
+        break;
+    default:
+        break;
+    }
+#endif
+    args << QString("-h");
+
+    QProcess proc;
+    proc.setProcessChannelMode(QProcess::MergedChannels);
+    proc.start(program, args);
+    if (!proc.waitForStarted(PROBE_TIMEOUT)) {
+        return defaults(type);
+    }
+    if (!proc.waitForFinished(PROBE_TIMEOUT)) {
+        proc.kill();
+        proc.waitForFinished();
+        return defaults(type);
+    }
+
+    BackendCapabilities c = fromHelp(QString::fromLocal8Bit(proc.readAll()));
+    return c.probed ? c : defaults(type);
+}
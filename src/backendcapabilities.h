@@ -0,0 +1,43 @@
+/*
+ * Backend Capabilities Class
+ *
+ * What an installed backend binary supports, read from its own help output.
+ * Probing is slow (it runs the backend), so results are cached per binary
+ * by BackendRegistry and persisted next to gui-config.json.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef BACKENDCAPABILITIES_H
+#define BACKENDCAPABILITIES_H
+#include <QString>
+#include <QStringList>
+#include <QJsonObject>
+#include "ssprofile.h"
+
+class BackendCapabilities
+{
+public:
+    BackendCapabilities();
+
+    bool probed;//false if these are the built-in guesses for the backend type
+    bool timeout;
+    bool udpRelay;
+    bool fastOpen;
+    bool reusePort;
+    bool mptcp;
+    bool noDelay;
+    QStringList ciphers;//upper-case, empty if the backend doesn't list them
+
+    bool supportsCipher(const QString &method) const;
+    QJsonObject toJson() const;
+
+    static BackendCapabilities fromJson(const QJsonObject &);
+    static BackendCapabilities fromHelp(const QString &help);
+    static BackendCapabilities defaults(SSProfile::BackendType);
+    static BackendCapabilities probe(const QString &path, SSProfile::BackendType);
+
+private:
+    static bool hasOption(const QString &help, const QString &option);
+};
+
+#endif // BACKENDCAPABILITIES_H
@@ -0,0 +1,694 @@
+#include <QDebug>
+#include "backendmanager.h"
+
+BackendManager::BackendManager(QObject *parent) :
+    QObject(parent),
+    autoRestart(false),
+    restartDelay(100),
+    restartMaxDelay(30000),
+    restartLimit(5),
+    standbyGroup(NULL),
+    failoverGroup(NULL),
+    balancerGroup(NULL),
+    hedgeBudget(0),
+    healthInterval(5000),
+    healthFailures(2),
+    failbackInterval(30000),
+    healthHost("www.gstatic.com"),
+    healthPort(80),
+    drainMode(false),
+    drainDeadline(30000)
+{
+    drainTimer.setInterval(1000);
+    connect(&drainTimer, &QTimer::timeout, this, &BackendManager::onDrainTimeout);
+    frontThread.setObjectName("local-port-forwarders");
+    statsTimer.setInterval(1000);
+    connect(&statsTimer, &QTimer::timeout, this, &BackendManager::onStatsTimeout);
+    statsTimer.start();
+}
+
+BackendManager::~BackendManager()
+{
+    shutdown();
+    frontThread.quit();
+    frontThread.wait();
+}
+
+SS_Process *BackendManager::processFor(SSProfile * const p)
+{
+    SS_Process *proc = processes.value(p, NULL);
+    if (proc == NULL) {
+        proc = new SS_Process(this);
+        proc->setRestartPolicy(autoRestart, restartDelay, restartMaxDelay, restartLimit);
+        connect(proc, &SS_Process::processRead, this, [=] (const QByteArray &o, const QVector<BackendEvent> &events) {
+            emit processRead(p, o, events);
+        });
+        connect(proc, &SS_Process::processStarted, this, [=] {
+            emit processStarted(p);
+        });
+        connect(proc, &SS_Process::processStopped, this, [=] {
+            emit processStopped(p);
+        });
+        connect(proc, &SS_Process::stateChanged, this, [=] (SS_Process::State s) {
+            onProcessStateChanged(p, s);
+            emit stateChanged(p, s);
+        });
+        processes.insert(p, proc);
+    }
+    return proc;
+}
+
+void BackendManager::setRestartPolicy(bool enabled, int delay, int maxDelay, int limit)
+{
+    autoRestart = enabled;
+    restartDelay = delay;
+    restartMaxDelay = maxDelay;
+    restartLimit = limit;
+    for (QHash<SSProfile *, SS_Process *>::iterator it = processes.begin(); it != processes.end(); ++it) {
+        it.value()->setRestartPolicy(autoRestart, restartDelay, restartMaxDelay, restartLimit);
+    }
+    if (standbyGroup) {
+        standbyGroup->setRestartPolicy(autoRestart, restartDelay, restartMaxDelay, restartLimit);
+    }
+    if (failoverGroup) {
+        failoverGroup->setRestartPolicy(autoRestart, restartDelay, restartMaxDelay, restartLimit);
+    }
+    if (balancerGroup) {
+        balancerGroup->setRestartPolicy(autoRestart, restartDelay, restartMaxDelay, restartLimit);
+    }
+}
+
+void BackendManager::setFailoverPolicy(int interval, int failures, int failback, const QString &target)
+{
+    healthInterval = interval;
+    healthFailures = failures;
+    failbackInterval = failback;
+    int colon = target.lastIndexOf(':');
+    quint16 port = colon > 0 ? target.mid(colon + 1).toUShort() : 0;
+    if (port == 0) {
+        qWarning() << tr("Health check target %1 isn't host:port, keeping %2:%3.").arg(target).arg(healthHost).arg(healthPort);
+    }
+    else {
+        healthHost = target.left(colon);
+        if (healthHost.startsWith('[') && healthHost.endsWith(']')) {
+            healthHost = healthHost.mid(1, healthHost.size() - 2);
+        }
+        healthPort = port;
+    }
+    if (failoverGroup) {
+        failoverGroup->setHealthPolicy(healthInterval, healthFailures, failbackInterval);
+        failoverGroup->setHealthTarget(healthHost, healthPort);
+    }
+    if (balancerGroup) {
+        balancerGroup->setHealthPolicy(healthInterval, healthFailures);
+        balancerGroup->setHealthTarget(healthHost, healthPort);
+    }
+}
+
+void BackendManager::setDrainPolicy(bool enabled, int deadline)
+{
+    drainMode = enabled;
+    drainDeadline = qMax(0, deadline);
+}
+
+void BackendManager::setHedging(int budgetPercent)
+{
+    hedgeBudget = budgetPercent;
+    if (balancerGroup) {
+        balancerGroup->setHedging(hedgeBudget);
+    }
+}
+
+bool BackendManager::inStandbyGroup(SSProfile * const p) const
+{
+    return standbyGroup && standbyGroup->isRunning() && (standbyGroup->activeProfile() == p || standbyGroup->standbyProfile() == p);
+}
+
+bool BackendManager::inFailoverGroup(SSProfile * const p) const
+{
+    return failoverGroup && failoverGroup->contains(p);
+}
+
+bool BackendManager::inBalancerGroup(SSProfile * const p) const
+{
+    return balancerGroup && balancerGroup->contains(p);
+}
+
+bool BackendManager::start(SSProfile * const p, bool debug)
+{
+    if (inBalancerGroup(p)) {
+        return true;
+    }
+    if (inFailoverGroup(p) && failoverGroup->activeProfile() == p) {
+        return true;
+    }
+    if (inFailoverGroup(p) && failoverGroup->primaryProfile() == p) {//the chain holds its local port
+        failoverGroup->stop();
+    }
+
+    if (inStandbyGroup(p)) {
+        if (standbyGroup->standbyProfile() == p) {//switching to the standby is instant
+            standbyGroup->switchOver();
+        }
+        return true;
+    }
+
+    if (draining.contains(p)) {//it can't drain and serve at the same time
+        draining.remove(p);
+        processes.value(p)->stop();
+    }
+
+    SSProfile *other = conflictingProfile(p);
+    if (other != NULL) {
+        qWarning() << tr("Local address %1:%2 is already used by profile %3.").arg(p->local_addr).arg(p->local_port).arg(other->profileName);
+        return false;
+    }
+
+    if (drainMode) {
+        startFronted(p, debug);
+    }
+    else {
+        processFor(p)->start(p, debug);
+    }
+    return true;
+}
+
+QString BackendManager::endpoint(SSProfile * const p)
+{
+    return p->local_addr + QString(":") + p->local_port;
+}
+
+PortForwarder *BackendManager::frontFor(const QString &ep)
+{
+    if (!fronts.contains(ep)) {
+        if (!frontThread.isRunning()) {
+            frontThread.start();
+        }
+        Front fr;
+        fr.forwarder = new PortForwarder;
+        fr.forwarder->moveToThread(&frontThread);
+        fr.owner = NULL;
+        connect(&frontThread, &QThread::finished, fr.forwarder, &QObject::deleteLater);
+        fronts.insert(ep, fr);
+    }
+    return fronts.value(ep).forwarder;
+}
+
+/*
+ * The backend listens on a spare loopback port, the forwarder is retargeted
+ * to it once it's Ready. Whoever owned the port before starts draining then.
+ */
+void BackendManager::startFronted(SSProfile * const p, bool debug)
+{
+    if (isRunning(p)) {//a profile can't take over from itself
+        processes.value(p)->stop();
+    }
+    frontFor(endpoint(p));
+    pendingTakeovers.insert(p, endpoint(p));
+    SS_Process *proc = processFor(p);
+    proc->startOnSparePort(p, debug);
+    backendPorts.insert(p, proc->listenPort());
+}
+
+void BackendManager::onProcessStateChanged(SSProfile * const p, SS_Process::State s)
+{
+    //the backend may have moved off a spare port someone else took
+    if (s == SS_Process::Ready && backendPorts.contains(p) && !draining.contains(p) && processes.value(p)->listenPort() != backendPorts.value(p)) {
+        quint16 port = processes.value(p)->listenPort();
+        backendPorts.insert(p, port);
+        for (QHash<QString, Front>::iterator it = fronts.begin(); it != fronts.end(); ++it) {
+            if (it.value().owner == p) {
+                PortForwarder *f = it.value().forwarder;
+                QTimer::singleShot(0, f, [f, port] { f->setTargets(QList<quint16>() << port); });
+            }
+        }
+    }
+    if (s == SS_Process::Ready && pendingTakeovers.contains(p)) {
+        QString ep = pendingTakeovers.take(p);
+        Front &fr = fronts[ep];
+        SSProfile *old = fr.owner;
+        fr.owner = p;
+
+        PortForwarder *f = fr.forwarder;
+        QList<quint16> targets;
+        targets << backendPorts.value(p);
+        QHostAddress addr(p->local_addr);
+        quint16 port = p->local_port.toUShort();
+        QTimer::singleShot(0, f, [f, targets, addr, port] {
+            f->setTargets(targets);
+            if (!f->isListening()) {
+                f->listen(addr, port);
+            }
+        });
+
+        if (old != NULL && old != p) {
+            emit processRead(p, tr("Taking over %1 from %2.").arg(ep).arg(old->profileName).toLocal8Bit());
+            beginDrain(old);
+        }
+    }
+    else if ((s == SS_Process::Stopped || s == SS_Process::Failed || s == SS_Process::CrashLoop) && !draining.contains(p)) {
+        pendingTakeovers.remove(p);
+    }
+}
+
+/*
+ * Stops accepting new connections for p, existing ones keep going
+ * until they close themselves or the deadline is over.
+ */
+void BackendManager::beginDrain(SSProfile * const p)
+{
+    if (!processes.contains(p) || draining.contains(p)) {
+        return;
+    }
+    QElapsedTimer clock;
+    clock.start();
+    draining.insert(p, clock);
+    if (!drainTimer.isActive()) {
+        drainTimer.start();
+    }
+    emit processRead(p, tr("Draining %1 active connections, deadline %2 ms.").arg(activeConnections(p)).arg(drainDeadline).toLocal8Bit());
+    emit stateChanged(p, processes.value(p)->state());//let the GUI show it's draining
+}
+
+void BackendManager::onDrainTimeout()
+{
+    QList<SSProfile *> d = draining.keys();
+    for (QList<SSProfile *>::iterator it = d.begin(); it != d.end(); ++it) {
+        SSProfile *p = *it;
+        int n = activeConnections(p);
+        bool expired = draining.value(p).elapsed() >= drainDeadline;
+        if (n == 0 || expired) {
+            draining.remove(p);
+            backendPorts.remove(p);
+            if (expired && n > 0) {
+                emit processRead(p, tr("Drain deadline reached, closing %1 connections.").arg(n).toLocal8Bit());
+            }
+            processes.value(p)->stop();
+        }
+        else {
+            emit processRead(p, tr("Draining: %1 connections left.").arg(n).toLocal8Bit());
+            emit stateChanged(p, processes.value(p)->state());
+        }
+    }
+    if (draining.isEmpty()) {
+        drainTimer.stop();
+    }
+}
+
+//stops listening on the profile's port if it owns it, the backend keeps running
+void BackendManager::releaseFront(SSProfile * const p)
+{
+    pendingTakeovers.remove(p);
+    for (QHash<QString, Front>::iterator it = fronts.begin(); it != fronts.end(); ++it) {
+        if (it.value().owner == p) {
+            it.value().owner = NULL;
+            PortForwarder *f = it.value().forwarder;
+            QTimer::singleShot(0, f, [f] { f->close(); });
+        }
+    }
+}
+
+bool BackendManager::isDraining(SSProfile * const p) const
+{
+    return draining.contains(p);
+}
+
+int BackendManager::activeConnections(SSProfile * const p) const
+{
+    if (!backendPorts.contains(p)) {
+        return -1;
+    }
+    quint16 port = backendPorts.value(p);
+    for (QHash<QString, Front>::const_iterator it = fronts.begin(); it != fronts.end(); ++it) {
+        int n = it.value().forwarder->activeConnections(port);
+        if (n > 0) {
+            return n;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Only one hot standby pair is kept. It takes over p's local port,
+ * while both backends listen on spare loopback ports.
+ */
+bool BackendManager::startWithStandby(SSProfile * const p, SSProfile * const standby, bool debug)
+{
+    if (standbyGroup == NULL) {
+        standbyGroup = new HotStandby(&frontThread, this);
+        standbyGroup->setRestartPolicy(autoRestart, restartDelay, restartMaxDelay, restartLimit);
+        connect(standbyGroup, &HotStandby::processRead, this, &BackendManager::processRead);
+        connect(standbyGroup, &HotStandby::processStarted, this, &BackendManager::processStarted);
+        connect(standbyGroup, &HotStandby::processStopped, this, &BackendManager::processStopped);
+        connect(standbyGroup, &HotStandby::stateChanged, this, &BackendManager::stateChanged);
+    }
+    standbyGroup->stop();
+    stop(p);
+    stop(standby);
+
+    SSProfile *other = conflictingProfile(p);
+    if (other != NULL) {
+        qWarning() << tr("Local address %1:%2 is already used by profile %3.").arg(p->local_addr).arg(p->local_port).arg(other->profileName);
+        return false;
+    }
+    standbyGroup->start(p, standby, debug);
+    return true;
+}
+
+/*
+ * Runs chain.first() on its local port, failing over to the next profiles
+ * of the chain in order. Profiles already running are stopped first.
+ */
+bool BackendManager::startWithFailover(const QList<SSProfile *> &chain, bool debug)
+{
+    if (failoverGroup == NULL) {
+        failoverGroup = new FailoverChain(&frontThread, this);
+        failoverGroup->setRestartPolicy(autoRestart, restartDelay, restartMaxDelay, restartLimit);
+        failoverGroup->setHealthPolicy(healthInterval, healthFailures, failbackInterval);
+        failoverGroup->setHealthTarget(healthHost, healthPort);
+        connect(failoverGroup, &FailoverChain::processRead, this, &BackendManager::processRead);
+        connect(failoverGroup, &FailoverChain::processStarted, this, &BackendManager::processStarted);
+        connect(failoverGroup, &FailoverChain::processStopped, this, &BackendManager::processStopped);
+        connect(failoverGroup, &FailoverChain::stateChanged, this, &BackendManager::stateChanged);
+    }
+    failoverGroup->stop();
+    for (QList<SSProfile *>::const_iterator it = chain.begin(); it != chain.end(); ++it) {
+        stop(*it);
+    }
+
+    SSProfile *other = conflictingProfile(chain.first());
+    if (other != NULL) {
+        qWarning() << tr("Local address %1:%2 is already used by profile %3.").arg(chain.first()->local_addr).arg(chain.first()->local_port).arg(other->profileName);
+        return false;
+    }
+    failoverGroup->start(chain, debug);
+    return true;
+}
+
+/*
+ * Runs every profile of the pool and spreads the connections to the local
+ * port of pool.first() over them. Profiles already running are stopped first.
+ */
+bool BackendManager::startBalanced(const QList<SSProfile *> &pool, PortForwarder::Policy policy, bool debug)
+{
+    if (balancerGroup == NULL) {
+        balancerGroup = new LoadBalancer(&frontThread, this);
+        balancerGroup->setRestartPolicy(autoRestart, restartDelay, restartMaxDelay, restartLimit);
+        balancerGroup->setHealthPolicy(healthInterval, healthFailures);
+        balancerGroup->setHealthTarget(healthHost, healthPort);
+        balancerGroup->setHedging(hedgeBudget);
+        connect(balancerGroup, &LoadBalancer::processRead, this, &BackendManager::processRead);
+        connect(balancerGroup, &LoadBalancer::processStarted, this, &BackendManager::processStarted);
+        connect(balancerGroup, &LoadBalancer::processStopped, this, &BackendManager::processStopped);
+        connect(balancerGroup, &LoadBalancer::stateChanged, this, &BackendManager::stateChanged);
+    }
+    balancerGroup->stop();
+    for (QList<SSProfile *>::const_iterator it = pool.begin(); it != pool.end(); ++it) {
+        stop(*it);
+    }
+
+    SSProfile *other = conflictingProfile(pool.first());
+    if (other != NULL) {
+        qWarning() << tr("Local address %1:%2 is already used by profile %3.").arg(pool.first()->local_addr).arg(pool.first()->local_port).arg(other->profileName);
+        return false;
+    }
+    balancerGroup->setPolicy(policy);
+    balancerGroup->start(pool, debug);
+    return true;
+}
+
+bool BackendManager::isEjected(SSProfile * const p) const
+{
+    return inBalancerGroup(p) && balancerGroup->isEjected(p);
+}
+
+const SS_Process *BackendManager::process(SSProfile * const p) const
+{
+    if (inBalancerGroup(p)) {
+        return balancerGroup->process(p);
+    }
+    if (inFailoverGroup(p) && failoverGroup->activeProfile() == p) {
+        return failoverGroup->activeProcess();
+    }
+    if (inStandbyGroup(p) && standbyGroup->activeProfile() == p) {
+        return standbyGroup->activeProcess();
+    }
+    return processes.value(p, NULL);
+}
+
+void BackendManager::setStatsInterval(int msec)
+{
+    statsTimer.setInterval(qMax(100, msec));
+}
+
+/*
+ * One socket snapshot per tick is shared by all backends. Nothing is read
+ * while no backend runs, so an idle client costs only the timer.
+ */
+void BackendManager::onStatsTimeout()
+{
+    QList<SS_Process *> running;
+    for (QHash<SSProfile *, SS_Process *>::iterator it = processes.begin(); it != processes.end(); ++it) {
+        if (it.value()->isRunning()) {
+            running << it.value();
+        }
+    }
+    if (standbyGroup && standbyGroup->isRunning()) {
+        running << standbyGroup->activeProcess();
+    }
+    if (failoverGroup && failoverGroup->isRunning()) {
+        running << failoverGroup->activeProcess();
+    }
+    if (balancerGroup && balancerGroup->isRunning()) {
+        QList<SSProfile *> pool = balancerGroup->profiles();
+        for (QList<SSProfile *>::iterator it = pool.begin(); it != pool.end(); ++it) {
+            running << balancerGroup->process(*it);
+        }
+    }
+    if (running.isEmpty()) {
+        return;
+    }
+
+    QSet<quint16> ports;
+    for (QList<SS_Process *>::iterator it = running.begin(); it != running.end(); ++it) {
+        ports << (*it)->listenPort();
+    }
+    accounting.sample(ports);
+    for (QList<SS_Process *>::iterator it = running.begin(); it != running.end(); ++it) {
+        (*it)->sampleTraffic(accounting);
+    }
+    emit statsUpdated();
+}
+
+void BackendManager::stop(SSProfile * const p)
+{
+    //the chain is started through its primary, so that one stops it, too
+    if (inFailoverGroup(p) && (failoverGroup->activeProfile() == p || failoverGroup->primaryProfile() == p)) {
+        failoverGroup->stop();
+    }
+    if (inStandbyGroup(p) && standbyGroup->activeProfile() == p) {
+        standbyGroup->stop();
+    }
+    if (inBalancerGroup(p) && balancerGroup->frontProfile() == p) {
+        balancerGroup->stop();
+    }
+    SS_Process *proc = processes.value(p, NULL);
+    if (proc == NULL) {
+        return;
+    }
+    if (drainMode && backendPorts.contains(p) && !draining.contains(p) && proc->state() == SS_Process::Ready) {
+        releaseFront(p);
+        beginDrain(p);
+    }
+    else {
+        draining.remove(p);
+        releaseFront(p);
+        proc->stop();
+    }
+}
+
+void BackendManager::stopAll()
+{
+    for (QHash<SSProfile *, SS_Process *>::iterator it = processes.begin(); it != processes.end(); ++it) {
+        stop(it.key());
+    }
+    if (standbyGroup) {
+        standbyGroup->stop();
+    }
+    if (failoverGroup) {
+        failoverGroup->stop();
+    }
+    if (balancerGroup) {
+        balancerGroup->stop();
+    }
+}
+
+/*
+ * For quitting. In drain mode stopAll() leaves ready backends running
+ * until their connections finish, which nobody waits for at exit.
+ */
+void BackendManager::shutdown()
+{
+    drainTimer.stop();
+    draining.clear();
+    pendingTakeovers.clear();
+    if (standbyGroup) {
+        standbyGroup->stop();
+    }
+    if (failoverGroup) {
+        failoverGroup->stop();
+    }
+    if (balancerGroup) {
+        balancerGroup->stop();
+    }
+    for (QHash<SSProfile *, SS_Process *>::iterator it = processes.begin(); it != processes.end(); ++it) {
+        releaseFront(it.key());
+        it.value()->stop();
+    }
+}
+
+/*
+ * Must be called before the profile is deleted (or the profile list reloaded)
+ * so that no signal carrying a dangling SSProfile pointer is emitted afterwards.
+ */
+void BackendManager::remove(SSProfile * const p)
+{
+    if (inStandbyGroup(p)) {
+        standbyGroup->stop();
+    }
+    if (inFailoverGroup(p)) {
+        failoverGroup->stop();
+    }
+    if (inBalancerGroup(p)) {
+        balancerGroup->stop();
+    }
+    draining.remove(p);
+    releaseFront(p);
+    backendPorts.remove(p);
+    SS_Process *proc = processes.take(p);
+    if (proc != NULL) {
+        proc->stop();
+        proc->disconnect(this);
+        proc->deleteLater();
+    }
+}
+
+void BackendManager::clear()
+{
+    if (standbyGroup) {
+        standbyGroup->stop();
+    }
+    if (failoverGroup) {
+        failoverGroup->stop();
+    }
+    if (balancerGroup) {
+        balancerGroup->stop();
+    }
+    QList<SSProfile *> keys = processes.keys();
+    for (QList<SSProfile *>::iterator it = keys.begin(); it != keys.end(); ++it) {
+        remove(*it);
+    }
+}
+
+bool BackendManager::isRunning(SSProfile * const p) const
+{
+    if (inStandbyGroup(p) && standbyGroup->activeProfile() == p) {
+        return true;
+    }
+    if (inFailoverGroup(p) && failoverGroup->activeProfile() == p) {
+        return true;
+    }
+    if (inBalancerGroup(p)) {
+        return true;
+    }
+    SS_Process *proc = processes.value(p, NULL);
+    return proc != NULL && proc->isRunning();
+}
+
+bool BackendManager::isStandby(SSProfile * const p) const
+{
+    return inStandbyGroup(p) && standbyGroup->standbyProfile() == p;
+}
+
+int BackendManager::runningCount() const
+{
+    return runningProfiles().size();
+}
+
+QList<SSProfile *> BackendManager::runningProfiles() const
+{
+    QList<SSProfile *> l;
+    for (QHash<SSProfile *, SS_Process *>::const_iterator it = processes.begin(); it != processes.end(); ++it) {
+        if (it.value()->isRunning()) {
+            l << it.key();
+        }
+    }
+    if (standbyGroup && standbyGroup->isRunning()) {
+        l << standbyGroup->activeProfile();
+    }
+    if (failoverGroup && failoverGroup->isRunning()) {
+        l << failoverGroup->activeProfile();
+    }
+    if (balancerGroup && balancerGroup->isRunning()) {
+        l << balancerGroup->profiles();
+    }
+    return l;
+}
+
+//every profile with a backend, running or not, so stopped ones keep their history
+void BackendManager::profiles(QVector<SSProfile *> *l) const
+{
+    l->resize(0);
+    for (QHash<SSProfile *, SS_Process *>::const_iterator it = processes.begin(); it != processes.end(); ++it) {
+        l->append(it.key());
+    }
+    if (standbyGroup && standbyGroup->isRunning() && !l->contains(standbyGroup->activeProfile())) {
+        l->append(standbyGroup->activeProfile());
+    }
+    if (failoverGroup && failoverGroup->isRunning() && !l->contains(failoverGroup->activeProfile())) {
+        l->append(failoverGroup->activeProfile());
+    }
+    if (balancerGroup) {
+        for (int i = 0; i < balancerGroup->memberCount(); ++i) {
+            if (!l->contains(balancerGroup->memberAt(i))) {
+                l->append(balancerGroup->memberAt(i));
+            }
+        }
+    }
+}
+
+SSProfile *BackendManager::conflictingProfile(SSProfile * const p) const
+{
+    for (QHash<SSProfile *, SS_Process *>::const_iterator it = processes.begin(); it != processes.end(); ++it) {
+        SSProfile *o = it.key();
+        if (drainMode && draining.contains(o)) {//its port is already released
+            continue;
+        }
+        if (drainMode && endpoint(o) == endpoint(p) && backendPorts.contains(o)) {//same front, p takes over
+            continue;
+        }
+        if (o != p && it.value()->isRunning() && o->local_port == p->local_port
+                && (o->local_addr == p->local_addr || o->local_addr == "0.0.0.0" || p->local_addr == "0.0.0.0")) {
+            return o;
+        }
+    }
+    if (standbyGroup && standbyGroup->isRunning() && !inStandbyGroup(p)) {
+        SSProfile *o = standbyGroup->primaryProfile();
+        if (o->local_port == p->local_port && (o->local_addr == p->local_addr || o->local_addr == "0.0.0.0" || p->local_addr == "0.0.0.0")) {
+            return standbyGroup->activeProfile();
+        }
+    }
+    if (failoverGroup && failoverGroup->isRunning() && !inFailoverGroup(p)) {
+        SSProfile *o = failoverGroup->primaryProfile();
+        if (o->local_port == p->local_port && (o->local_addr == p->local_addr || o->local_addr == "0.0.0.0" || p->local_addr == "0.0.0.0")) {
+            return failoverGroup->activeProfile();
+        }
+    }
+    if (balancerGroup && balancerGroup->isRunning() && !inBalancerGroup(p)) {
+        SSProfile *o = balancerGroup->frontProfile();
+        if (o->local_port == p->local_port && (o->local_addr == p->local_addr || o->local_addr == "0.0.0.0" || p->local_addr == "0.0.0.0")) {
+            return o;
+        }
+    }
+    return NULL;
+}
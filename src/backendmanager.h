@@ -0,0 +1,123 @@
+/*
+ * Backend Manager Class
+ *
+ * Keeps one SS_Process per running profile so that several
+ * profiles can be up at the same time, each on its own local port.
+ *
+ * In drain mode every local port is owned by a PortForwarder and the
+ * backends listen on spare loopback ports. Starting a profile on a port
+ * in use then moves new connections to it, while the previous profile
+ * keeps its connections until they finish or the drain deadline passes.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef BACKENDMANAGER_H
+#define BACKENDMANAGER_H
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QVector>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "ss_process.h"
+#include "hotstandby.h"
+#include "failoverchain.h"
+#include "loadbalancer.h"
+#include "ssprofile.h"
+#include "socketaccounting.h"
+
+class BackendManager : public QObject
+{
+    Q_OBJECT
+
+public:
+    BackendManager(QObject *parent = 0);
+    ~BackendManager();
+
+    bool start(SSProfile * const, bool debug);
+    bool startWithStandby(SSProfile * const, SSProfile * const standby, bool debug);
+    bool startWithFailover(const QList<SSProfile *> &chain, bool debug);
+    bool startBalanced(const QList<SSProfile *> &pool, PortForwarder::Policy policy, bool debug);
+    void stop(SSProfile * const);
+    void stopAll();
+    //stops everything at once, nothing is left draining
+    void shutdown();
+    void remove(SSProfile * const);
+    void clear();
+    bool isRunning(SSProfile * const) const;
+    bool isStandby(SSProfile * const) const;
+    bool isDraining(SSProfile * const) const;
+    bool isEjected(SSProfile * const) const;
+    int activeConnections(SSProfile * const) const;
+    int runningCount() const;
+    QList<SSProfile *> runningProfiles() const;
+    //fills l, whose capacity is kept for the next call
+    void profiles(QVector<SSProfile *> *l) const;
+    SSProfile *conflictingProfile(SSProfile * const) const;
+    void setRestartPolicy(bool enabled, int delay, int maxDelay, int limit);
+    void setDrainPolicy(bool enabled, int deadline);
+    //target is host:port, an IPv6 address in brackets
+    void setFailoverPolicy(int interval, int failures, int failback, const QString &target);
+    void setHedging(int budgetPercent);
+    const SS_Process *process(SSProfile * const) const;
+    void setStatsInterval(int msec);
+
+signals:
+    void processRead(SSProfile *p, const QByteArray &o, const QVector<BackendEvent> &events = QVector<BackendEvent>());
+    void processStarted(SSProfile *p);
+    void processStopped(SSProfile *p);
+    void stateChanged(SSProfile *p, SS_Process::State s);
+    void statsUpdated();
+
+private:
+    struct Front
+    {
+        PortForwarder *forwarder;
+        SSProfile *owner;
+    };
+
+    QHash<SSProfile *, SS_Process *> processes;
+    bool autoRestart;
+    int restartDelay;
+    int restartMaxDelay;
+    int restartLimit;
+    HotStandby *standbyGroup;
+    FailoverChain *failoverGroup;
+    LoadBalancer *balancerGroup;
+    int hedgeBudget;//percent of balanced connections raced over two profiles
+    int healthInterval;//milliseconds
+    int healthFailures;
+    int failbackInterval;//milliseconds
+    QString healthHost;
+    quint16 healthPort;
+
+    bool drainMode;
+    int drainDeadline;//milliseconds
+    QThread frontThread;
+    QHash<QString, Front> fronts;//keyed by local address:port
+    QHash<SSProfile *, quint16> backendPorts;//loopback port each fronted backend listens on
+    QHash<SSProfile *, QString> pendingTakeovers;//profiles waiting to be Ready before taking a port
+    QHash<SSProfile *, QElapsedTimer> draining;
+    QTimer drainTimer;
+
+    SocketAccounting accounting;
+    QTimer statsTimer;
+
+    SS_Process *processFor(SSProfile * const);
+    bool inStandbyGroup(SSProfile * const) const;
+    bool inFailoverGroup(SSProfile * const) const;
+    bool inBalancerGroup(SSProfile * const) const;
+    static QString endpoint(SSProfile * const);
+    PortForwarder *frontFor(const QString &ep);
+    void startFronted(SSProfile * const, bool debug);
+    void beginDrain(SSProfile * const);
+    void releaseFront(SSProfile * const);
+    void onProcessStateChanged(SSProfile * const, SS_Process::State);
+
+private slots:
+    void onDrainTimeout();
+    void onStatsTimeout();
+};
+
+#endif // BACKENDMANAGER_H
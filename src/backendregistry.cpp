@@ -0,0 +1,250 @@
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QStandardPaths>
+#include <QDateTime>
+#include <QMutexLocker>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include "backendregistry.h"
+
+#ifdef Q_OS_UNIX
+#include <sys/stat.h>
+#endif
+
+BackendRegistry::BackendRegistry(QObject *parent) :
+    QObject(parent),
+    m_hits(0),
+    m_misses(0)
+{
+    connect(&watcher, &QFileSystemWatcher::fileChanged, this, &BackendRegistry::onFileChanged);
+    connect(&watcher, &QFileSystemWatcher::directoryChanged, this, &BackendRegistry::onDirectoryChanged);
+}
+
+BackendRegistry *BackendRegistry::instance()
+{
+    //owned by the application, so the watcher goes away before the event loop does
+    static BackendRegistry *registry = new BackendRegistry(QCoreApplication::instance());
+    return registry;
+}
+
+bool BackendRegistry::fileKey(const QString &path, FileKey *key)
+{
+#ifdef Q_OS_UNIX
+    struct stat st;
+    if (stat(QFile::encodeName(path).constData(), &st) != 0) {
+        return false;
+    }
+    key->mtime = static_cast<qint64>(st.st_mtime);
+    key->inode = static_cast<quint64>(st.st_ino);
+    key->size = static_cast<qint64>(st.st_size);
+#else
+    QFileInfo info(path);
+    if (!info.exists()) {
+        return false;
+    }
+    key->mtime = info.lastModified().toMSecsSinceEpoch();
+    key->inode = 0;
+    key->size = info.size();
+#endif
+    return true;
+}
+
+/*
+ * Guess the backend type from the first line of the backend.
+ * Scripts carry an interpreter in their shebang, binaries are told apart by name.
+ */
+SSProfile::BackendType BackendRegistry::readType(const QString &path)
+{
+    QFile file(path);
+    file.open(QIODevice::ReadOnly | QIODevice::Text);
+    if (!file.isReadable() || !file.isOpen()) {
+        return SSProfile::UNKNOWN;
+    }
+
+    QString ident(file.readLine());
+    file.close();
+    if (ident.contains("node")) {
+        return SSProfile::NODEJS;
+    }
+    else if (ident.contains("python")) {
+        return SSProfile::PYTHON;
+    }
+    else if (path.contains("ss-local")) {
+        return SSProfile::LIBEV;
+    }
+    else {
+        return SSProfile::GO;
+    }
+}
+
+void BackendRegistry::watch(const QString &path)
+{
+    if (!watcher.files().contains(path) && !watcher.directories().contains(path)) {
+        watcher.addPath(path);
+    }
+}
+
+SSProfile::BackendType BackendRegistry::detectType(const QString &path)
+{
+    FileKey key;
+    if (!fileKey(path, &key)) {
+        return SSProfile::UNKNOWN;
+    }
+
+    QMutexLocker locker(&mutex);
+    QHash<QString, TypeEntry>::const_iterator it = types.find(path);
+    if (it != types.end() && it->key == key) {
+        ++m_hits;
+        return it->type;
+    }
+
+    ++m_misses;
+    TypeEntry e;
+    e.key = key;
+    e.type = readType(path);
+    types.insert(path, e);
+    watch(path);
+    return e.type;
+}
+
+QString BackendRegistry::findExecutable(const QString &execName, const QStringList &paths)
+{
+    QString cacheKey = execName + QChar('\n') + paths.join(QChar('\n'));
+    QMutexLocker locker(&mutex);
+    QHash<QString, QString>::const_iterator it = executables.find(cacheKey);
+    if (it != executables.end()) {
+        ++m_hits;
+        return it.value();
+    }
+
+    ++m_misses;
+    QString found = QStandardPaths::findExecutable(execName, paths);
+    executables.insert(cacheKey, found);
+
+    //any new, removed or replaced executable in the searched directories drops the cache
+    QStringList dirs = paths;
+    if (dirs.isEmpty()) {
+#ifdef Q_OS_WIN
+        const QChar pathSep(';');
+#else
+        const QChar pathSep(':');
+#endif
+        dirs = QString::fromLocal8Bit(qgetenv("PATH")).split(pathSep, QString::SkipEmptyParts);
+    }
+    for (QStringList::iterator d = dirs.begin(); d != dirs.end(); ++d) {
+        if (QFileInfo(*d).isDir()) {
+            watch(*d);
+        }
+    }
+    return found;
+}
+
+/*
+ * Capabilities are only valid for the exact binary they were probed from.
+ * A replaced or upgraded backend has another key and gets probed again.
+ */
+bool BackendRegistry::capabilities(const QString &path, BackendCapabilities *c)
+{
+    FileKey key;
+    if (!fileKey(path, &key)) {
+        return false;
+    }
+
+    QMutexLocker locker(&mutex);
+    QHash<QString, CapabilityEntry>::const_iterator it = capabilityCache.find(path);
+    if (it != capabilityCache.end() && it->key == key) {
+        ++m_hits;
+        *c = it->caps;
+        return true;
+    }
+    ++m_misses;
+    return false;
+}
+
+void BackendRegistry::storeCapabilities(const QString &path, const BackendCapabilities &c)
+{
+    CapabilityEntry e;
+    if (!fileKey(path, &e.key)) {
+        return;
+    }
+    e.caps = c;
+
+    QMutexLocker locker(&mutex);
+    capabilityCache.insert(path, e);
+    saveCache();
+}
+
+void BackendRegistry::setCacheFile(const QString &file)
+{
+    QMutexLocker locker(&mutex);
+    cacheFile = file;
+    loadCache();
+}
+
+void BackendRegistry::loadCache()
+{
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::ReadOnly | QIODevice::Text)) {
+        return;
+    }
+
+    QJsonObject root = QJsonDocument::fromJson(file.readAll()).object();
+    file.close();
+    for (QJsonObject::iterator it = root.begin(); it != root.end(); ++it) {
+        QJsonObject entry = it.value().toObject();
+        CapabilityEntry e;
+        e.key.mtime = static_cast<qint64>(entry["mtime"].toDouble());
+        e.key.inode = entry["inode"].toString().toULongLong();
+        e.key.size = static_cast<qint64>(entry["size"].toDouble());
+        e.caps = BackendCapabilities::fromJson(entry["capabilities"].toObject());
+        capabilityCache.insert(it.key(), e);
+    }
+}
+
+void BackendRegistry::saveCache()
+{
+    if (cacheFile.isEmpty()) {
+        return;
+    }
+
+    QJsonObject root;
+    for (QHash<QString, CapabilityEntry>::const_iterator it = capabilityCache.begin(); it != capabilityCache.end(); ++it) {
+        QJsonObject entry;
+        entry["mtime"] = QJsonValue(static_cast<double>(it->key.mtime));
+        entry["inode"] = QJsonValue(QString::number(it->key.inode));//may not fit into a double
+        entry["size"] = QJsonValue(static_cast<double>(it->key.size));
+        entry["capabilities"] = it->caps.toJson();
+        root[it.key()] = entry;
+    }
+
+    QFile file(cacheFile);
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+        qWarning() << "Warning: cannot write backend cache" << cacheFile;
+        return;
+    }
+    file.write(QJsonDocument(root).toJson());
+    file.close();
+}
+
+void BackendRegistry::invalidate()
+{
+    QMutexLocker locker(&mutex);
+    types.clear();
+    executables.clear();
+}
+
+void BackendRegistry::onFileChanged(const QString &path)
+{
+    QMutexLocker locker(&mutex);
+    types.remove(path);
+    executables.clear();
+}
+
+void BackendRegistry::onDirectoryChanged(const QString &)
+{
+    QMutexLocker locker(&mutex);
+    executables.clear();
+}
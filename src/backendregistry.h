@@ -0,0 +1,80 @@
+/*
+ * Backend Registry Class
+ *
+ * Process-wide cache of backend executable lookups and backend type
+ * detection. Entries are keyed by path, modification time and inode,
+ * and dropped when a file system watcher sees the file or its directory change.
+ * Backend capabilities are kept under the same key and persisted to a cache
+ * file, since probing them means running the backend.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef BACKENDREGISTRY_H
+#define BACKENDREGISTRY_H
+#include <QObject>
+#include <QHash>
+#include <QMutex>
+#include <QStringList>
+#include <QFileSystemWatcher>
+#include "ssprofile.h"
+#include "backendcapabilities.h"
+
+class BackendRegistry : public QObject
+{
+    Q_OBJECT
+
+public:
+    static BackendRegistry *instance();
+
+    SSProfile::BackendType detectType(const QString &path);
+    QString findExecutable(const QString &execName, const QStringList &paths = QStringList());
+    bool capabilities(const QString &path, BackendCapabilities *caps);
+    void storeCapabilities(const QString &path, const BackendCapabilities &caps);
+    void setCacheFile(const QString &file);
+    void invalidate();
+
+    inline quint64 hits() const { return m_hits; }
+    inline quint64 misses() const { return m_misses; }
+
+private:
+    BackendRegistry(QObject *parent = 0);
+
+    struct FileKey
+    {
+        qint64 mtime;
+        quint64 inode;
+        qint64 size;
+        inline bool operator==(const FileKey &o) const { return mtime == o.mtime && inode == o.inode && size == o.size; }
+    };
+    struct TypeEntry
+    {
+        FileKey key;
+        SSProfile::BackendType type;
+    };
+    struct CapabilityEntry
+    {
+        FileKey key;
+        BackendCapabilities caps;
+    };
+
+    QMutex mutex;
+    QHash<QString, TypeEntry> types;
+    QHash<QString, QString> executables;
+    QHash<QString, CapabilityEntry> capabilityCache;
+    QString cacheFile;
+    QFileSystemWatcher watcher;
+    quint64 m_hits;
+    quint64 m_misses;
+
+    static bool fileKey(const QString &path, FileKey *key);
+    static SSProfile::BackendType readType(const QString &path);
+    void watch(const QString &path);
+    void loadCache();
+    void saveCache();
+
+private slots:
+    void onFileChanged(const QString &path);
+    void onDirectoryChanged(const QString &path);
+};
+
+#endif // BACKENDREGISTRY_H
@@ -0,0 +1,117 @@
+#include <QTextStream>
+#include <QElapsedTimer>
+#include <QtShadowsocks>
+#include "cipherbenchmark.h"
+#include "ssvalidator.h"
+
+#if defined(Q_PROCESSOR_X86) && defined(Q_CC_GNU)
+#include <x86intrin.h>
+#define HAVE_RDTSC
+#endif
+
+bool CipherBenchmark::isRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (QByteArray(argv[i]) == "--bench-ciphers") {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * Stream ciphers without known practical breaks and block ciphers with
+ * 128-bit blocks. TABLE and RC4 are broken, the 64-bit block ciphers
+ * (BF, CAST5, DES, IDEA, RC2) are open to birthday attacks on long sessions.
+ */
+bool CipherBenchmark::isSafeMethod(const QString &method)
+{
+    QString m = method.toUpper();
+    return m.startsWith("AES-") || m.startsWith("CAMELLIA-") || m == "CHACHA20" || m == "SALSA20" || m == "SEED-CFB";
+}
+
+static quint64 cycleCounter()
+{
+#ifdef HAVE_RDTSC
+    return __rdtsc();
+#else
+    return 0;
+#endif
+}
+
+/*
+ * Every method encrypts and decrypts the same data through QSS::Encryptor,
+ * which is what the libQtShadowsocks backend relays with, in 64 KiB chunks
+ * as they come off a socket. It runs in one thread, so the figures are per
+ * core. Cycles are time stamp counter ticks and only printed on x86.
+ */
+int CipherBenchmark::run()
+{
+    QTextStream out(stdout);
+    const int chunk = 64 * 1024;
+    const int chunks = 128;//8 MiB each way
+    const double mb = chunk * static_cast<double>(chunks) / (1024 * 1024);
+
+    QByteArray plain(chunk, '\0');
+    for (int i = 0; i < chunk; ++i) {
+        plain[i] = static_cast<char>(i * 131 + 7);
+    }
+
+    QString fastest;
+    double fastestRate = 0;
+    QElapsedTimer t;
+    for (QStringList::const_iterator it = SSValidator::supportedMethod.begin(); it != SSValidator::supportedMethod.end(); ++it) {
+        if (!QSS::Encryptor::initialise(it->toLower(), QString("benchmark"))) {
+            out << qSetFieldWidth(18) << left << *it << qSetFieldWidth(0) << "unsupported" << endl;
+            continue;
+        }
+
+        QSS::Encryptor enc, dec;
+        QList<QByteArray> sealed;
+        t.start();
+        quint64 c0 = cycleCounter();
+        for (int n = 0; n < chunks; ++n) {
+            sealed << enc.encrypt(plain);
+        }
+        quint64 encCycles = cycleCounter() - c0;
+        qint64 encNs = qMax(Q_INT64_C(1), t.nsecsElapsed());
+
+        bool ok = true;
+        t.start();
+        c0 = cycleCounter();
+        for (int n = 0; n < chunks; ++n) {
+            ok = (dec.decrypt(sealed[n]) == plain) && ok;
+        }
+        quint64 decCycles = cycleCounter() - c0;
+        qint64 decNs = qMax(Q_INT64_C(1), t.nsecsElapsed());
+
+        double encRate = mb * 1e9 / encNs;
+        double decRate = mb * 1e9 / decNs;
+        //a relay does both, so rank by the combined rate
+        double rate = 2 / (1 / encRate + 1 / decRate);
+        const double bytes = chunk * static_cast<double>(chunks);
+
+        out << qSetFieldWidth(18) << left << *it << qSetFieldWidth(0) << right << fixed << qSetRealNumberPrecision(1)
+            << "enc " << qSetFieldWidth(8) << encRate << qSetFieldWidth(0) << " MB/s  "
+            << "dec " << qSetFieldWidth(8) << decRate << qSetFieldWidth(0) << " MB/s  "
+            << "avg " << qSetFieldWidth(8) << rate << qSetFieldWidth(0) << " MB/s";
+#ifdef HAVE_RDTSC
+        out << qSetRealNumberPrecision(2) << "  " << encCycles / bytes << "/" << decCycles / bytes << " cycles/byte";
+#else
+        Q_UNUSED(encCycles);
+        Q_UNUSED(decCycles);
+        Q_UNUSED(bytes);
+#endif
+        if (!ok) {
+            out << "  ROUND TRIP FAILED";
+        }
+        out << endl;
+
+        if (ok && isSafeMethod(*it) && rate > fastestRate) {
+            fastestRate = rate;
+            fastest = *it;
+        }
+    }
+    out << "Fastest safe method: " << (fastest.isEmpty() ? QString("none") : fastest) << endl;
+    return 0;
+}
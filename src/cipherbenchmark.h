@@ -0,0 +1,22 @@
+/*
+ * Cipher Benchmark Class
+ *
+ * ss-qt5 --bench-ciphers, run in a child process by the Benchmark button.
+ * Prints the throughput of every encryption method on this machine and
+ * the fastest safe one to stdout.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef CIPHERBENCHMARK_H
+#define CIPHERBENCHMARK_H
+#include <QString>
+
+class CipherBenchmark
+{
+public:
+    static bool isRequested(int argc, char *argv[]);
+    static int run();
+    static bool isSafeMethod(const QString &method);
+};
+
+#endif // CIPHERBENCHMARK_H
@@ -5,45 +5,95 @@
 #include <QJsonArray>
 #include <QJsonObject>
 #include <QJsonValue>
+#include <QCoreApplication>
 #include "configuration.h"
 
-#ifdef Q_OS_LINUX
-#include <sys/utsname.h>
-#endif
-
 bool Configuration::tfo_available = false;
 
 Configuration::Configuration(const QString &file)
+{
+    //bit 0 enables the client side, which is the side a local proxy needs
+    tfo_available = (tcpFastOpenMode() & 1) != 0;
+    setJSONFile(file);
+}
+
+//gui-config.json next to the executable on Windows, in ~/.config/shadowsocks elsewhere
+QString Configuration::defaultFile()
+{
+#ifdef Q_OS_WIN
+    return QCoreApplication::applicationDirPath() + "/gui-config.json";
+#else
+    QDir ssConfigDir = QDir::homePath() + "/.config/shadowsocks";
+    if (!ssConfigDir.exists()) {
+        ssConfigDir.mkpath(ssConfigDir.absolutePath());
+    }
+    return ssConfigDir.absolutePath() + "/gui-config.json";
+#endif
+}
+
+/*
+ * The tcp_fastopen sysctl instead of the kernel version, since the feature
+ * can be switched off on any kernel and distributions backport it.
+ * Returns 0 where it doesn't exist.
+ */
+int Configuration::tcpFastOpenMode()
 {
 #ifdef Q_OS_LINUX
-    /*
-     * Determine linux kernel version on the run-time
-     * if it's greater than 3.7, then define tcp fast open available.
-     */
-    utsname u;
-    uname(&u);
-    QString linux_release(u.release);
-    tfo_available = (linux_release.mid(2, 2).toFloat() >= 7 && linux_release.at(0) == '3') ? true : false;
+    QFile knob("/proc/sys/net/ipv4/tcp_fastopen");
+    if (knob.open(QIODevice::ReadOnly)) {
+        return knob.readAll().trimmed().toInt();
+    }
 #endif
-    setJSONFile(file);
+    return 0;
 }
 
 void Configuration::setJSONFile(const QString &file)
 {
     profileList.clear();//clear list in the very beginning
+    stored.clear();
     m_file = QDir::toNativeSeparators(file);
     QFile JSONFile(m_file);
 
     if (!JSONFile.exists()) {
         qWarning() << "Warning: gui-config.json does not exist!";
         autoHide = false;
+        autoRestart = false;
         autoStart = false;
+        metricsPort = 0;
+        dnsCacheTtl = 0;
+        logBufferSize = 16;
+        logOverflow = QString("drop");
+        logFile = false;
+        logFileSize = 10;
+        logFileAge = 24;
+        logFileCount = 5;
+        logFileCompress = true;
+        pickFastest = false;
+        fastestGroup = QString();
+        fastestHandshake = false;
+        fastestInterval = 600;
+        fastestThreshold = 20;
         debugLog = false;
+        failover = false;
+        failoverChain = QStringList();
+        healthCheckInterval = 5000;
+        healthCheckFailures = 2;
+        failbackInterval = 30000;
+        healthCheckTarget = QString("www.gstatic.com:80");
+        hotStandby = false;
+        loadBalance = false;
+        balancePolicy = QString("roundRobin");
+        hedgeBudget = 0;
+        gracefulDrain = false;
+        drainDeadline = 30000;
         m_index = -1;
         relativePath = false;
         translucent = true;
         useSystray = true;
         singleInstance = false;
+        restartDelay = 100;
+        restartMaxDelay = 30000;
+        restartLimit = 5;
         return;
     }
 
@@ -89,6 +139,8 @@ void Configuration::setJSONFile(const QString &file)
             p.server_port = json["server_port"].toString();
             p.timeout = json["timeout"].toString();
             p.type = json["type"].toString();
+            p.workers = json["workers"].toInt(1);
+            p.group = json["group"].toString();
 #ifdef Q_OS_LINUX
             if (tfo_available) {
                 p.fast_open = json["fast_open"].toBool();
@@ -97,17 +149,103 @@ void Configuration::setJSONFile(const QString &file)
             profileList << p;
         }
         m_index = JSONObj["index"].toInt();
+        markStored();
     }
     autoHide = JSONObj["autoHide"].toBool();
+    autoRestart = JSONObj["autoRestart"].toBool(false);
     autoStart = JSONObj["autoStart"].toBool();
+    metricsPort = JSONObj["metricsPort"].toInt(0);
+    dnsCacheTtl = JSONObj["dnsCacheTtl"].toInt(0);
+    logBufferSize = JSONObj["logBufferSize"].toInt(16);
+    logOverflow = JSONObj["logOverflow"].toString("drop");
+    logFile = JSONObj["logFile"].toBool();
+    logFileSize = JSONObj["logFileSize"].toInt(10);
+    logFileAge = JSONObj["logFileAge"].toInt(24);
+    logFileCount = JSONObj["logFileCount"].toInt(5);
+    logFileCompress = JSONObj["logFileCompress"].toBool(true);
+    pickFastest = JSONObj["pickFastest"].toBool();
+    fastestGroup = JSONObj["fastestGroup"].toString();
+    fastestHandshake = JSONObj["fastestHandshake"].toBool();
+    fastestInterval = JSONObj["fastestInterval"].toInt(600);
+    fastestThreshold = JSONObj["fastestThreshold"].toInt(20);
     debugLog = JSONObj["debug"].toBool();
+    failover = JSONObj["failover"].toBool();
+    failoverChain.clear();
+    QJsonArray chainArray = JSONObj["failoverChain"].toArray();
+    for (QJsonArray::iterator it = chainArray.begin(); it != chainArray.end(); ++it) {
+        failoverChain << (*it).toString();
+    }
+    healthCheckInterval = JSONObj["healthCheckInterval"].toInt(5000);
+    healthCheckFailures = JSONObj["healthCheckFailures"].toInt(2);
+    failbackInterval = JSONObj["failbackInterval"].toInt(30000);
+    healthCheckTarget = JSONObj["healthCheckTarget"].toString("www.gstatic.com:80");
+    hotStandby = JSONObj["hotStandby"].toBool();
+    loadBalance = JSONObj["loadBalance"].toBool();
+    balancePolicy = JSONObj["balancePolicy"].toString("roundRobin");
+    hedgeBudget = JSONObj["hedgeBudget"].toInt(0);
+    gracefulDrain = JSONObj["gracefulDrain"].toBool();
+    drainDeadline = JSONObj["drainDeadline"].toInt(30000);
     relativePath = JSONObj["relative_path"].toBool();
     translucent = JSONObj["translucent"].toBool();
     useSystray = JSONObj["useSystray"].toBool();
     singleInstance = JSONObj["singleInstance"].toBool();
+    restartDelay = JSONObj["restartDelay"].toInt(100);
+    restartMaxDelay = JSONObj["restartMaxDelay"].toInt(30000);
+    restartLimit = JSONObj["restartLimit"].toInt(5);
     JSONFile.close();
 }
 
+/*
+ * primary first, then the profiles named in failoverChain in that order,
+ * or every other profile in list order if failoverChain is empty.
+ */
+QList<SSProfile *> Configuration::failoverChainFor(SSProfile *primary)
+{
+    QList<SSProfile *> chain;
+    chain << primary;
+    if (failoverChain.isEmpty()) {
+        for (QList<SSProfile>::iterator it = profileList.begin(); it != profileList.end(); ++it) {
+            if (&(*it) != primary && it->isValid()) {
+                chain << &(*it);
+            }
+        }
+        return chain;
+    }
+    for (QStringList::iterator n = failoverChain.begin(); n != failoverChain.end(); ++n) {
+        for (QList<SSProfile>::iterator it = profileList.begin(); it != profileList.end(); ++it) {
+            if (it->profileName == *n && &(*it) != primary && it->isValid() && !chain.contains(&(*it))) {
+                chain << &(*it);
+                break;
+            }
+        }
+    }
+    return chain;
+}
+
+//front first, then the other valid profiles of its group, or all of them if it has none
+QList<SSProfile *> Configuration::balancePoolFor(SSProfile *front)
+{
+    QList<SSProfile *> pool;
+    pool << front;
+    for (QList<SSProfile>::iterator it = profileList.begin(); it != profileList.end(); ++it) {
+        if (&(*it) != front && it->isValid() && (front->group.isEmpty() || it->group == front->group)) {
+            pool << &(*it);
+        }
+    }
+    return pool;
+}
+
+QStringList Configuration::serverHosts() const
+{
+    QStringList s;
+    for (QList<SSProfile>::const_iterator it = profileList.begin(); it != profileList.end(); ++it) {
+        if (!it->server.isEmpty() && !s.contains(it->server)) {
+            s << it->server;
+        }
+    }
+    return s;
+}
+
 QStringList Configuration::getProfileList()
 {
     QStringList s;
@@ -156,6 +294,10 @@ void Configuration::save()
         json["server"] = QJsonValue(it->server);
         json["timeout"] = QJsonValue(it->timeout);
         json["type"] = QJsonValue(it->type);
+        json["workers"] = QJsonValue(it->workers);
+        if (!it->group.isEmpty()) {
+            json["group"] = QJsonValue(it->group);
+        }
 #ifdef Q_OS_LINUX
         if (tfo_available) {
             json["fast_open"] = QJsonValue(it->fast_open);
@@ -166,14 +308,44 @@ void Configuration::save()
 
     QJsonObject JSONObj;
     JSONObj["autoHide"] = QJsonValue(autoHide);
+    JSONObj["autoRestart"] = QJsonValue(autoRestart);
     JSONObj["autoStart"] = QJsonValue(autoStart);
+    JSONObj["metricsPort"] = QJsonValue(metricsPort);
+    JSONObj["dnsCacheTtl"] = QJsonValue(dnsCacheTtl);
+    JSONObj["logBufferSize"] = QJsonValue(logBufferSize);
+    JSONObj["logOverflow"] = QJsonValue(logOverflow);
+    JSONObj["logFile"] = QJsonValue(logFile);
+    JSONObj["logFileSize"] = QJsonValue(logFileSize);
+    JSONObj["logFileAge"] = QJsonValue(logFileAge);
+    JSONObj["logFileCount"] = QJsonValue(logFileCount);
+    JSONObj["logFileCompress"] = QJsonValue(logFileCompress);
+    JSONObj["pickFastest"] = QJsonValue(pickFastest);
+    JSONObj["fastestGroup"] = QJsonValue(fastestGroup);
+    JSONObj["fastestHandshake"] = QJsonValue(fastestHandshake);
+    JSONObj["fastestInterval"] = QJsonValue(fastestInterval);
+    JSONObj["fastestThreshold"] = QJsonValue(fastestThreshold);
     JSONObj["configs"] = QJsonValue(newConfArray);
     JSONObj["debug"] = QJsonValue(debugLog);
+    JSONObj["failover"] = QJsonValue(failover);
+    JSONObj["failoverChain"] = QJsonValue(QJsonArray::fromStringList(failoverChain));
+    JSONObj["healthCheckInterval"] = QJsonValue(healthCheckInterval);
+    JSONObj["healthCheckFailures"] = QJsonValue(healthCheckFailures);
+    JSONObj["failbackInterval"] = QJsonValue(failbackInterval);
+    JSONObj["healthCheckTarget"] = QJsonValue(healthCheckTarget);
+    JSONObj["hotStandby"] = QJsonValue(hotStandby);
+    JSONObj["loadBalance"] = QJsonValue(loadBalance);
+    JSONObj["balancePolicy"] = QJsonValue(balancePolicy);
+    JSONObj["hedgeBudget"] = QJsonValue(hedgeBudget);
+    JSONObj["gracefulDrain"] = QJsonValue(gracefulDrain);
+    JSONObj["drainDeadline"] = QJsonValue(drainDeadline);
     JSONObj["index"] = QJsonValue(m_index);
     JSONObj["relative_path"] = QJsonValue(relativePath);
     JSONObj["translucent"] = QJsonValue(translucent);
     JSONObj["useSystray"] = QJsonValue(useSystray);
     JSONObj["singleInstance"] = QJsonValue(singleInstance);
+    JSONObj["restartDelay"] = QJsonValue(restartDelay);
+    JSONObj["restartMaxDelay"] = QJsonValue(restartMaxDelay);
+    JSONObj["restartLimit"] = QJsonValue(restartLimit);
 
     QJsonDocument JSONDoc(JSONObj);
 
@@ -181,9 +353,68 @@ void Configuration::save()
     JSONFile.open(QIODevice::WriteOnly | QIODevice::Text);
     if (JSONFile.isWritable()) {
         JSONFile.write(JSONDoc.toJson());
+        markStored();
     }
     else {
         qWarning() << "Warning: file is not writable!";
     }
     JSONFile.close();
 }
+
+void Configuration::markStored()
+{
+    stored.clear();
+    for (int i = 0; i < profileList.size(); ++i) {
+        stored.insert(&profileList[i], i);
+    }
+}
+
+QList<SSProfile *> Configuration::unsavedProfiles()
+{
+    QList<SSProfile *> l;
+    for (int i = 0; i < profileList.size(); ++i) {
+        if (!stored.contains(&profileList[i])) {
+            l << &profileList[i];
+        }
+    }
+    return l;
+}
+
+/*
+ * Reloads the file into the profiles that were read from it, rather than
+ * into new ones, so that pointers to them stay valid and their running
+ * backends are left alone. The list is never shared while this runs, as
+ * detaching it would copy every profile.
+ */
+void Configuration::revert()
+{
+    QList<SSProfile> kept;
+    kept.swap(profileList);
+    QHash<const SSProfile *, int> keptIndex = stored;
+    setJSONFile(m_file);
+    QList<SSProfile> loaded;
+    loaded.swap(profileList);
+    profileList.swap(kept);
+
+    for (int i = profileList.size() - 1; i >= 0; --i) {
+        if (keptIndex.value(&profileList[i], loaded.size()) >= loaded.size()) {
+            profileList.removeAt(i);
+        }
+    }
+    for (int k = 0; k < loaded.size(); ++k) {
+        int at = -1;
+        for (int i = k; i < profileList.size() && at < 0; ++i) {
+            if (keptIndex.value(&profileList[i]) == k) {
+                at = i;
+            }
+        }
+        if (at < 0) {
+            profileList.insert(k, loaded.at(k));
+        }
+        else {
+            profileList.move(at, k);
+            profileList[k] = loaded.at(k);
+        }
+    }
+    markStored();
+}
@@ -6,6 +6,7 @@
 #include <QString>
 #include <QStringList>
 #include <QList>
+#include <QHash>
 #include "ssprofile.h"
 
 class Configuration
@@ -13,9 +14,19 @@ class Configuration
 public:
     Configuration(const QString &file);
 
+    static QString defaultFile();
+    static int tcpFastOpenMode();
+
     inline bool isAutoHide() const { return autoHide; }
+    inline bool isAutoRestart() const { return autoRestart; }
     inline bool isAutoStart() const { return autoStart; }
     inline bool isDebug() const { return debugLog; }
+    inline bool isFailover() const { return failover; }
+    inline bool isGracefulDrain() const { return gracefulDrain; }
+    inline bool isHotStandby() const { return hotStandby; }
+    inline bool isLoadBalance() const { return loadBalance; }
+    inline bool isPickFastest() const { return pickFastest; }
+    inline bool isFastestHandshake() const { return fastestHandshake; }
     inline bool isRelativePath() const { return relativePath; }
     inline bool isTFOAvailable() const { return tfo_available; }
     inline bool isTranslucent() const { return translucent; }
@@ -23,20 +34,55 @@ public:
     inline bool isSingleInstance() const { return singleInstance; }
     inline int count() const { return profileList.count(); }
     inline int getIndex() const { return m_index; }
+    inline int getDrainDeadline() const { return drainDeadline; }
+    inline int getHealthCheckInterval() const { return healthCheckInterval; }
+    inline int getHealthCheckFailures() const { return healthCheckFailures; }
+    inline int getFailbackInterval() const { return failbackInterval; }
+    inline const QString &getHealthCheckTarget() const { return healthCheckTarget; }
+    inline const QString &getBalancePolicy() const { return balancePolicy; }
+    inline int getHedgeBudget() const { return hedgeBudget; }
+    inline int getMetricsPort() const { return metricsPort; }
+    inline int getDnsCacheTtl() const { return dnsCacheTtl; }
+    inline int getLogBufferSize() const { return logBufferSize; }
+    inline const QString &getLogOverflow() const { return logOverflow; }
+    inline bool isLogFile() const { return logFile; }
+    inline int getLogFileSize() const { return logFileSize; }
+    inline int getLogFileAge() const { return logFileAge; }
+    inline int getLogFileCount() const { return logFileCount; }
+    inline bool isLogFileCompress() const { return logFileCompress; }
+    inline int getFastestInterval() const { return fastestInterval; }
+    inline int getFastestThreshold() const { return fastestThreshold; }
+    inline const QString &getFastestGroup() const { return fastestGroup; }
+    inline int getRestartDelay() const { return restartDelay; }
+    inline int getRestartMaxDelay() const { return restartMaxDelay; }
+    inline int getRestartLimit() const { return restartLimit; }
     inline SSProfile *currentProfile() { return &profileList[m_index]; }
     inline SSProfile *lastProfile() { return &profileList.last(); }
     inline SSProfile *profileAt(int i) { return &profileList[i]; }
-    inline void deleteProfile(int index) { profileList.removeAt(index); }
-    inline void revert() { setJSONFile(m_file); }
+    inline void deleteProfile(int index) { stored.remove(&profileList[index]); profileList.removeAt(index); }
+    inline void moveProfile(int from, int to) { profileList.move(from, to); }
+    void revert();
+    QList<SSProfile *> unsavedProfiles();//the ones revert() drops
     inline void setAutoHide(bool b) { autoHide = b; }
+    inline void setAutoRestart(bool b) { autoRestart = b; }
     inline void setAutoStart(bool b) { autoStart = b; }
     inline void setDebug(bool b) { debugLog = b; }
+    inline void setFailover(bool b) { failover = b; }
+    inline void setGracefulDrain(bool b) { gracefulDrain = b; }
+    inline void setHotStandby(bool b) { hotStandby = b; }
     inline void setIndex(int i) { m_index = i; }
+    inline void setLoadBalance(bool b) { loadBalance = b; }
+    inline void setBalancePolicy(const QString &p) { balancePolicy = p; }
+    inline void setMetricsPort(int p) { metricsPort = p; }
+    inline void setPickFastest(bool b) { pickFastest = b; }
     inline void setRelativePath(bool b) { relativePath = b; }
     inline void setTranslucent(bool b) { translucent = b; }
     inline void setUseSystray(bool b) { useSystray = b; }
     inline void setSingleInstance(bool b) { singleInstance = b; }
     QStringList getProfileList();
+    QList<SSProfile *> failoverChainFor(SSProfile *primary);
+    QList<SSProfile *> balancePoolFor(SSProfile *front);
+    QStringList serverHosts() const;
     void addProfile(const QString &);
     void addProfileFromSSURI(const QString &, QString);
     void save();
@@ -44,16 +90,49 @@ public:
 
 private:
     bool autoHide;
+    bool autoRestart;
     bool autoStart;
     bool debugLog;
+    bool failover;
+    bool gracefulDrain;
+    bool hotStandby;
+    bool loadBalance;
+    bool pickFastest;
+    bool fastestHandshake;//compare full handshakes instead of connect times
     bool relativePath;
     bool translucent;
     bool useSystray;
     bool singleInstance;
     int m_index;
+    int drainDeadline;//milliseconds
+    int healthCheckInterval;//milliseconds
+    int healthCheckFailures;//failed checks in a row before failing over
+    int failbackInterval;//milliseconds between tests of the profiles ahead in the chain
+    QString healthCheckTarget;//host:port health checks ask the profiles to connect to
+    QStringList failoverChain;//profile names to fail over to, in order
+    QString balancePolicy;//roundRobin, leastActive or throughput
+    int hedgeBudget;//percent of balanced connections raced over two profiles, 0 is off
+    int metricsPort;//loopback port of the metrics endpoint, 0 if disabled
+    int logBufferSize;//megabytes of log lines kept for the log view
+    QString logOverflow;//drop or sample backend output the GUI can't keep up with
+    bool logFile;//also write the logs to ss-qt5.log next to gui-config.json
+    int logFileSize;//megabytes before the log file is rotated, 0 for no limit
+    int logFileAge;//hours before the log file is rotated, 0 for no limit
+    int logFileCount;//rotated log files kept
+    bool logFileCompress;//gzip rotated log files
+    int dnsCacheTtl;//seconds server addresses are cached, 0 passes names to the backends
+    int fastestInterval;//seconds between re-evaluations
+    int fastestThreshold;//percent a profile has to be faster to switch to it
+    QString fastestGroup;//only profiles of this group are candidates, all if empty
+    int restartDelay;//milliseconds
+    int restartMaxDelay;//milliseconds
+    int restartLimit;//restarts per minute
     QList<SSProfile> profileList;
+    QHash<const SSProfile *, int> stored;//index in the file of the profiles read from or saved to it
     QString m_file;
     static bool tfo_available;
+
+    void markStored();
 };
 
 #endif // CONFIGURATION_H
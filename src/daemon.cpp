@@ -0,0 +1,222 @@
+#include <QDebug>
+#include <QFile>
+#include <QFileInfo>
+#include <QTextStream>
+#include <QCoreApplication>
+#include "daemon.h"
+#include "hostresolver.h"
+#include "backendregistry.h"
+
+#include <signal.h>
+#ifdef Q_OS_UNIX
+#include <sys/socket.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+int Daemon::signalFd[2] = {-1, -1};
+
+Daemon::Daemon(const QElapsedTimer &launchClock, QObject *parent) :
+    QObject(parent),
+    launch(launchClock),
+    conf(NULL),
+    backends(NULL),
+    monitor(NULL),
+    metrics(NULL),
+    fileLog(NULL),
+    signalNotifier(NULL),
+    verbose(false)
+{}
+
+Daemon::~Daemon()
+{
+    //backends still refer to the profiles owned by conf
+    delete metrics;
+    delete backends;
+    delete fileLog;
+    delete conf;
+}
+
+bool Daemon::isRequested(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (QByteArray(argv[i]) == "--daemon") {
+            return true;
+        }
+    }
+    return false;
+}
+
+qint64 Daemon::residentSetSize()
+{
+#ifdef Q_OS_LINUX
+    QFile status("/proc/self/status");
+    if (status.open(QIODevice::ReadOnly)) {
+        while (!status.atEnd()) {
+            QByteArray line = status.readLine();
+            if (line.startsWith("VmRSS:")) {
+                return line.mid(6).simplified().split(' ').first().toLongLong();
+            }
+        }
+    }
+#endif
+    return -1;
+}
+
+/*
+ * Signal handlers may only do async-signal-safe work, so they write a byte
+ * into a socket pair and the event loop does the stopping.
+ */
+void Daemon::onSignal(int sig)
+{
+#ifdef Q_OS_UNIX
+    char c = static_cast<char>(sig);
+    ssize_t r = ::write(signalFd[0], &c, 1);
+    Q_UNUSED(r);
+#else
+    Q_UNUSED(sig);
+    qApp->quit();
+#endif
+}
+
+void Daemon::installSignalHandlers()
+{
+#ifdef Q_OS_UNIX
+    if (::socketpair(AF_UNIX, SOCK_STREAM, 0, signalFd) != 0) {
+        //a handler with nowhere to write would swallow the signal, so the default action stays
+        qWarning() << "Can't watch for signals, SIGINT and SIGTERM won't stop the backends first:" << strerror(errno);
+        return;
+    }
+    signalNotifier = new QSocketNotifier(signalFd[1], QSocketNotifier::Read, this);
+    connect(signalNotifier, &QSocketNotifier::activated, this, &Daemon::onSignalReceived);
+#endif
+    signal(SIGINT, onSignal);
+    signal(SIGTERM, onSignal);
+}
+
+void Daemon::onSignalReceived()
+{
+#ifdef Q_OS_UNIX
+    char c;
+    ssize_t r = ::read(signalFd[1], &c, 1);
+    Q_UNUSED(r);
+#endif
+    qDebug() << "Stopping on signal.";
+    backends->shutdown();
+    qApp->quit();
+}
+
+/*
+ * Starts the current profile, every profile named by --profile, or all
+ * valid profiles with --all.
+ */
+bool Daemon::start(const QStringList &args)
+{
+    installSignalHandlers();
+    verbose = args.contains("-v");
+    BackendRegistry::instance()->setCacheFile(QFileInfo(Configuration::defaultFile()).absolutePath() + "/backend-cache.json");
+    conf = new Configuration(Configuration::defaultFile());
+    backends = new BackendManager(this);
+    backends->setRestartPolicy(conf->isAutoRestart(), conf->getRestartDelay(), conf->getRestartMaxDelay(), conf->getRestartLimit());
+    backends->setDrainPolicy(conf->isGracefulDrain(), conf->getDrainDeadline());
+    backends->setFailoverPolicy(conf->getHealthCheckInterval(), conf->getHealthCheckFailures(), conf->getFailbackInterval(), conf->getHealthCheckTarget());
+    backends->setHedging(conf->getHedgeBudget());
+    OutputReader::setPolicy(OutputReader::policyFromName(conf->getLogOverflow()));
+    HostResolver::instance()->setTtl(conf->getDnsCacheTtl());
+    HostResolver::instance()->prefetch(conf->serverHosts());
+    if (conf->isLogFile()) {
+        fileLog = new LogWriter(QFileInfo(Configuration::defaultFile()).absolutePath() + "/ss-qt5.log", qint64(conf->getLogFileSize()) << 20, conf->getLogFileAge() * 3600, conf->getLogFileCount(), conf->isLogFileCompress());
+        fileLog->installMessageHandler();
+    }
+    connect(backends, &BackendManager::processRead, this, &Daemon::onProcessRead);
+    connect(backends, &BackendManager::processStarted, this, &Daemon::onProcessStarted);
+    connect(backends, &BackendManager::stateChanged, this, &Daemon::onProcessStateChanged);
+
+    if (conf->getMetricsPort() > 0) {
+        monitor = new EventLoopMonitor(100, this);
+        monitor->start();
+        metrics = new MetricsServer(backends, monitor, this);
+        metrics->listen(static_cast<quint16>(conf->getMetricsPort()));
+    }
+
+    QStringList names;
+    for (int i = 0; i < args.size() - 1; ++i) {
+        if (args[i] == "--profile") {
+            names << args[i + 1];
+        }
+    }
+    QList<SSProfile *> profiles;
+    for (int i = 0; i < conf->count(); ++i) {
+        SSProfile *p = conf->profileAt(i);
+        if (args.contains("--all") || names.contains(p->profileName) || (names.isEmpty() && i == conf->getIndex())) {
+            profiles << p;
+        }
+    }
+
+    for (QList<SSProfile *>::iterator it = profiles.begin(); it != profiles.end(); ++it) {
+        SSProfile *p = *it;
+        if (!p->isValid()) {
+            qWarning() << "Skipping invalid profile" << p->profileName;
+            continue;
+        }
+        p->getBackend(conf->isRelativePath());
+        QList<SSProfile *> group;
+        if (conf->isLoadBalance() && profiles.size() == 1) {
+            group = conf->balancePoolFor(p);
+        }
+        else if (conf->isFailover() && profiles.size() == 1) {
+            group = conf->failoverChainFor(p);
+        }
+        for (QList<SSProfile *>::iterator g = group.begin(); g != group.end(); ++g) {
+            (*g)->getBackend(conf->isRelativePath());
+        }
+        bool started;
+        if (group.size() > 1 && conf->isLoadBalance()) {
+            started = backends->startBalanced(group, LoadBalancer::policyFromName(conf->getBalancePolicy()), conf->isDebug() || verbose);
+        }
+        else if (group.size() > 1) {
+            started = backends->startWithFailover(group, conf->isDebug() || verbose);
+        }
+        else {
+            started = backends->start(p, conf->isDebug() || verbose);
+        }
+        if (started) {
+            pending << p;
+        }
+    }
+    if (pending.isEmpty()) {
+        qCritical() << "No profile to run. Check gui-config.json or the --profile arguments.";
+        return false;
+    }
+
+    QTextStream(stdout) << "Initialised in " << launch.elapsed() << " ms, RSS " << residentSetSize() << " KiB" << endl;
+    return true;
+}
+
+void Daemon::onProcessRead(SSProfile *p, const QByteArray &o)
+{
+    if (fileLog) {
+        fileLog->append(p->profileName, o);
+    }
+    QTextStream out(stdout);
+    QList<QByteArray> lines = o.trimmed().split('\n');
+    for (QList<QByteArray>::iterator it = lines.begin(); it != lines.end(); ++it) {
+        out << "[" << p->profileName << "] " << it->trimmed() << endl;
+    }
+}
+
+void Daemon::onProcessStarted(SSProfile *p)
+{
+    if (pending.removeOne(p) && pending.isEmpty()) {
+        QTextStream(stdout) << "All profiles ready " << launch.elapsed() << " ms after launch, RSS " << residentSetSize() << " KiB" << endl;
+    }
+}
+
+void Daemon::onProcessStateChanged(SSProfile *p, SS_Process::State s)
+{
+    if (s == SS_Process::Failed || s == SS_Process::CrashLoop) {
+        qWarning() << "Profile" << p->profileName << (s == SS_Process::Failed ? "failed to start." : "keeps crashing, gave up restarting it.");
+        pending.removeOne(p);
+    }
+}
@@ -0,0 +1,56 @@
+/*
+ * Daemon Class
+ *
+ * Headless mode, ss-qt5 --daemon. Runs profiles from gui-config.json on a
+ * QCoreApplication without creating any widget, logs to stdout and stops
+ * the backends cleanly on SIGTERM or SIGINT.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef DAEMON_H
+#define DAEMON_H
+#include <QObject>
+#include <QStringList>
+#include <QElapsedTimer>
+#include <QSocketNotifier>
+#include "configuration.h"
+#include "backendmanager.h"
+#include "eventloopmonitor.h"
+#include "metricsserver.h"
+#include "logwriter.h"
+
+class Daemon : public QObject
+{
+    Q_OBJECT
+
+public:
+    Daemon(const QElapsedTimer &launchClock, QObject *parent = 0);
+    ~Daemon();
+
+    static bool isRequested(int argc, char *argv[]);
+    static qint64 residentSetSize();//in KiB, -1 where unknown
+    bool start(const QStringList &args);
+
+private:
+    QElapsedTimer launch;
+    Configuration *conf;
+    BackendManager *backends;
+    EventLoopMonitor *monitor;
+    MetricsServer *metrics;
+    LogWriter *fileLog;
+    QSocketNotifier *signalNotifier;
+    QList<SSProfile *> pending;//started profiles not Ready yet
+    bool verbose;
+
+    static int signalFd[2];
+    static void onSignal(int);
+    void installSignalHandlers();
+
+private slots:
+    void onProcessRead(SSProfile *, const QByteArray &);
+    void onProcessStarted(SSProfile *);
+    void onProcessStateChanged(SSProfile *, SS_Process::State);
+    void onSignalReceived();
+};
+
+#endif // DAEMON_H
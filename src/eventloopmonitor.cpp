@@ -0,0 +1,48 @@
+#include "eventloopmonitor.h"
+
+EventLoopMonitor::EventLoopMonitor(int interval, QObject *parent) :
+    QObject(parent),
+    m_interval(interval),
+    m_last(0),
+    m_max(0),
+    m_avg(0)
+{
+    timer = new QTimer(this);//child objects follow moveToThread()
+    timer->setTimerType(Qt::PreciseTimer);
+    timer->setInterval(m_interval);
+    connect(timer, &QTimer::timeout, this, &EventLoopMonitor::onTimeout);
+}
+
+/*
+ * start() and stop() must run in the monitored thread.
+ * Use a queued invocation if the object has been moved to another thread.
+ */
+void EventLoopMonitor::start()
+{
+    clock.start();
+    timer->start();
+}
+
+void EventLoopMonitor::stop()
+{
+    timer->stop();
+}
+
+void EventLoopMonitor::resetMax()
+{
+    m_max.store(0);
+}
+
+void EventLoopMonitor::onTimeout()
+{
+    qint64 elapsed = clock.nsecsElapsed() / 1000;
+    clock.start();
+    int lagUs = static_cast<int>(qMax(qint64(0), elapsed - qint64(m_interval) * 1000));
+    int lag = lagUs / 1000;
+    m_last.store(lag);
+    if (lag > m_max.load()) {
+        m_max.store(lag);
+    }
+    //exponentially weighted moving average, alpha = 1/8
+    m_avg.store(m_avg.load() + (lagUs - m_avg.load()) / 8);
+}
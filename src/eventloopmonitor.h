@@ -0,0 +1,45 @@
+/*
+ * Event Loop Monitor Class
+ *
+ * Measures how late a periodic timer fires in the thread this object
+ * lives in, which is the delay any queued event in that thread suffers.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef EVENTLOOPMONITOR_H
+#define EVENTLOOPMONITOR_H
+#include <QObject>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QAtomicInt>
+
+class EventLoopMonitor : public QObject
+{
+    Q_OBJECT
+
+public:
+    EventLoopMonitor(int interval = 100, QObject *parent = 0);
+
+    //all values are in milliseconds and can be read from any thread
+    inline int lastLag() const { return m_last.load(); }
+    inline int maxLag() const { return m_max.load(); }
+    inline double averageLag() const { return m_avg.load() / 1000.0; }
+
+public slots:
+    void start();
+    void stop();
+    void resetMax();
+
+private:
+    int m_interval;
+    QTimer *timer;
+    QElapsedTimer clock;
+    QAtomicInt m_last;
+    QAtomicInt m_max;
+    QAtomicInt m_avg;//microseconds, so that lags below a millisecond still move it
+
+private slots:
+    void onTimeout();
+};
+
+#endif // EVENTLOOPMONITOR_H
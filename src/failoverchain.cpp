@@ -0,0 +1,286 @@
+#include <QDebug>
+#include "failoverchain.h"
+#include "hostresolver.h"
+
+FailoverChain::FailoverChain(QThread *forwarderThread, QObject *parent) :
+    QObject(parent),
+    group(forwarderThread),
+    slot(0),
+    active(0),
+    pending(-1),
+    running(false),
+    debug(false),
+    failureLimit(2),
+    failures(0),
+    failbackBest(-1),
+    m_lastFailover(-1)
+{
+    healthTimer.setInterval(5000);
+    failbackTimer.setInterval(30000);
+    connect(&healthTimer, &QTimer::timeout, this, &FailoverChain::onHealthTimeout);
+    connect(&failbackTimer, &QTimer::timeout, this, &FailoverChain::onFailbackTimeout);
+    connect(&healthCheck, &LatencyTester::result, this, &FailoverChain::onHealthResult);
+    connect(&failbackCheck, &LatencyTester::result, this, &FailoverChain::onFailbackResult);
+    connect(&failbackCheck, &LatencyTester::finished, this, &FailoverChain::onFailbackFinished);
+
+    group.addMember();
+    group.addMember();
+    connect(&group, &FrontedGroup::targetsChanged, this, &FailoverChain::onTargetsChanged);
+    connect(&group, &FrontedGroup::info, this, [this] (const QString &s) {
+        emit processRead(group.profile(slot), s.toLocal8Bit());
+    });
+    connect(&group, &FrontedGroup::processRead, this, [this] (int i, const QByteArray &o, const QVector<BackendEvent> &events) {
+        emit processRead(group.profile(i), o, events);
+    });
+    connect(&group, &FrontedGroup::stateChanged, this, &FailoverChain::onProcessStateChanged);
+}
+
+FailoverChain::~FailoverChain()
+{
+    stop();
+}
+
+void FailoverChain::setRestartPolicy(bool enabled, int delay, int maxDelay, int limit)
+{
+    group.setRestartPolicy(enabled, delay, maxDelay, limit);
+}
+
+/*
+ * interval and failbackInterval are in milliseconds. The active profile
+ * is given up after failures consecutive failed checks or backend exits.
+ */
+void FailoverChain::setHealthPolicy(int interval, int failures, int failbackInterval)
+{
+    healthTimer.setInterval(qMax(100, interval));
+    healthCheck.setTimeout(qMin(3000, qMax(100, interval)));
+    failureLimit = qMax(1, failures);
+    failbackTimer.setInterval(qMax(1000, failbackInterval));
+}
+
+void FailoverChain::setHealthTarget(const QString &host, quint16 port)
+{
+    healthCheck.setHandshakeTarget(host, port);
+    failbackCheck.setHandshakeTarget(host, port);
+}
+
+void FailoverChain::start(const QList<SSProfile *> &c, bool d)
+{
+    stop();
+    if (c.isEmpty()) {
+        return;
+    }
+    chain = c;
+    debug = d;
+    slot = 0;
+    active = 0;
+    pending = -1;
+    failures = 0;
+    unhealthy.clear();
+    tried.clear();
+    running = true;
+    group.setFront(QHostAddress(chain.first()->local_addr), chain.first()->local_port.toUShort());
+    group.launch(slot, chain.at(active), debug);
+}
+
+void FailoverChain::stop()
+{
+    if (!running) {
+        return;
+    }
+    running = false;
+    pending = -1;
+    healthTimer.stop();
+    failbackTimer.stop();
+    healthCheck.abort();
+    failbackCheck.abort();
+    group.stop();
+    emit processStopped(chain.at(active));
+}
+
+bool FailoverChain::isRunning() const
+{
+    return running;
+}
+
+/*
+ * The next profile after from that is neither active nor failed to take
+ * over already. Profiles known to be down are only tried as a last resort.
+ */
+int FailoverChain::nextCandidate(int from) const
+{
+    int fallback = -1;
+    for (int k = 1; k < chain.size(); ++k) {
+        int j = (from + k) % chain.size();
+        SSProfile *p = chain.at(j);
+        if (j == active || tried.contains(p)) {
+            continue;
+        }
+        if (!unhealthy.contains(p)) {
+            return j;
+        }
+        if (fallback < 0) {
+            fallback = j;
+        }
+    }
+    return fallback;
+}
+
+void FailoverChain::failover(const QString &reason)
+{
+    if (pending >= 0) {
+        return;
+    }
+    SSProfile *p = chain.at(active);
+    unhealthy << p;
+    HostResolver::instance()->reportFailure(p->server, group.process(slot)->serverAddress());
+    tried.clear();
+    failures = 0;
+    failoverClock.start();
+    int next = nextCandidate(active);
+    if (next < 0) {
+        emit processRead(p, tr("%1, but no other profile in the failover chain is available.").arg(reason).toLocal8Bit());
+        failoverClock.invalidate();
+        return;
+    }
+    emit processRead(p, tr("%1, failing over to %2.").arg(reason).arg(chain.at(next)->profileName).toLocal8Bit());
+    switchTo(next);
+}
+
+void FailoverChain::switchTo(int i)
+{
+    pending = i;
+    group.launch(1 - slot, chain.at(i), debug);
+}
+
+void FailoverChain::onProcessStateChanged(int i, SS_Process::State s)
+{
+    if (group.profile(i)) {
+        emit stateChanged(group.profile(i), s);
+    }
+    if (!running) {
+        return;
+    }
+
+    if (i == slot) {
+        if (s == SS_Process::Ready && !group.isListening()) {
+            group.serve(QList<int>() << slot);
+            healthTimer.start();
+            emit processStarted(chain.at(active));
+        }
+        else if (s == SS_Process::Restarting && ++failures >= failureLimit) {
+            failover(tr("Backend of %1 exited %2 times").arg(chain.at(active)->profileName).arg(failures));
+        }
+        else if (s == SS_Process::Failed || s == SS_Process::CrashLoop) {
+            failover(tr("Backend of %1 failed").arg(chain.at(active)->profileName));
+        }
+        return;
+    }
+
+    if (pending < 0) {
+        return;
+    }
+    if (s == SS_Process::Failed || s == SS_Process::CrashLoop) {
+        int from = pending;
+        pending = -1;
+        tried << chain.at(from);
+        unhealthy << chain.at(from);
+        group.stopMember(i);
+        int next = nextCandidate(from);
+        if (next < 0) {
+            emit processRead(chain.at(from), tr("%1 failed to take over, no other profile in the failover chain is available.").arg(chain.at(from)->profileName).toLocal8Bit());
+            failoverClock.invalidate();
+            return;
+        }
+        switchTo(next);
+    }
+    else if (s == SS_Process::Ready) {
+        //the forwarder moves new connections over, then the old backend goes
+        SSProfile *from = chain.at(active);
+        int old = slot;
+        slot = i;
+        active = pending;
+        pending = -1;
+        failures = 0;
+        group.serve(QList<int>() << slot);
+        group.stopMember(old);
+        healthTimer.start();
+        if (active > 0) {
+            failbackTimer.start();
+        }
+        else {
+            failbackTimer.stop();
+            failbackCheck.abort();
+        }
+        emit processStopped(from);
+        emit processStarted(chain.at(active));
+    }
+}
+
+void FailoverChain::onTargetsChanged()
+{
+    if (failoverClock.isValid()) {
+        m_lastFailover = failoverClock.elapsed();
+        failoverClock.invalidate();
+        emit processRead(chain.at(active), tr("Local port %1 taken over by %2 in %3 ms.").arg(group.frontPort()).arg(chain.at(active)->profileName).arg(m_lastFailover).toLocal8Bit());
+    }
+}
+
+void FailoverChain::onHealthTimeout()
+{
+    if (!group.isListening() || pending >= 0 || healthCheck.isRunning()) {
+        return;
+    }
+    QHash<SSProfile *, quint16> through;
+    through.insert(chain.at(active), group.port(slot));
+    healthCheck.testThrough(through);
+}
+
+void FailoverChain::onHealthResult(SSProfile *p, qint64, qint64 handshakeTime)
+{
+    if (!running || pending >= 0 || p != chain.at(active)) {
+        return;
+    }
+    if (handshakeTime >= 0) {
+        failures = 0;
+        unhealthy.remove(p);
+    }
+    else if (++failures >= failureLimit) {
+        failover(tr("%1 failed %2 health checks in a row").arg(p->profileName).arg(failures));
+    }
+}
+
+/*
+ * Profiles ahead of the active one are tested with temporary backends,
+ * so that the port only moves back once the whole path works again.
+ */
+void FailoverChain::onFailbackTimeout()
+{
+    if (active == 0 || pending >= 0 || failbackCheck.isRunning()) {
+        return;
+    }
+    failbackBest = -1;
+    failbackCheck.test(chain.mid(0, active), true);
+}
+
+void FailoverChain::onFailbackResult(SSProfile *p, qint64, qint64 handshakeTime)
+{
+    int j = chain.indexOf(p);
+    if (handshakeTime < 0 || j < 0) {
+        return;
+    }
+    unhealthy.remove(p);
+    if (failbackBest < 0 || j < failbackBest) {
+        failbackBest = j;
+    }
+}
+
+void FailoverChain::onFailbackFinished()
+{
+    if (!running || pending >= 0 || failbackBest < 0 || failbackBest >= active) {
+        return;
+    }
+    emit processRead(chain.at(active), tr("%1 is reachable again, failing back.").arg(chain.at(failbackBest)->profileName).toLocal8Bit());
+    failoverClock.start();
+    tried.clear();
+    switchTo(failbackBest);
+}
@@ -0,0 +1,87 @@
+/*
+ * Failover Chain Class
+ *
+ * Serves the local port of the first profile in an ordered list with
+ * one backend at a time. The active profile is checked periodically by
+ * a handshake through its own backend; when it fails repeatedly, or its
+ * backend keeps exiting, the next healthy profile of the chain takes over
+ * the port. Profiles ahead of the active one are tested in the background
+ * and the chain falls back to them once they answer again.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef FAILOVERCHAIN_H
+#define FAILOVERCHAIN_H
+#include <QObject>
+#include <QList>
+#include <QSet>
+#include <QThread>
+#include <QTimer>
+#include <QElapsedTimer>
+#include "ss_process.h"
+#include "frontedgroup.h"
+#include "latencytester.h"
+#include "ssprofile.h"
+
+class FailoverChain : public QObject
+{
+    Q_OBJECT
+
+public:
+    FailoverChain(QThread *forwarderThread, QObject *parent = 0);
+    ~FailoverChain();
+
+    void start(const QList<SSProfile *> &chain, bool debug);
+    void stop();
+    void setRestartPolicy(bool enabled, int delay, int maxDelay, int limit);
+    void setHealthPolicy(int interval, int failures, int failbackInterval);
+    void setHealthTarget(const QString &host, quint16 port);
+    bool isRunning() const;
+    inline bool contains(SSProfile * const p) const { return running && chain.contains(p); }
+    inline SSProfile *primaryProfile() const { return chain.first(); }
+    inline SSProfile *activeProfile() const { return chain.at(active); }
+    inline SS_Process *activeProcess() const { return group.process(slot); }
+    //milliseconds from detecting a failure until the next profile served the port
+    inline qint64 lastFailoverTime() const { return m_lastFailover; }
+
+signals:
+    void processRead(SSProfile *p, const QByteArray &o, const QVector<BackendEvent> &events = QVector<BackendEvent>());
+    void processStarted(SSProfile *p);
+    void processStopped(SSProfile *p);
+    void stateChanged(SSProfile *p, SS_Process::State s);
+
+private:
+    QList<SSProfile *> chain;
+    QSet<SSProfile *> unhealthy;
+    QSet<SSProfile *> tried;//profiles that failed to take over during this failover
+    FrontedGroup group;//the active backend and the one taking over
+    int slot;//index of the active backend in group
+    int active;//index of the active profile in chain
+    int pending;//index of the profile being started to take over, -1 if none
+    bool running;
+    bool debug;
+    int failureLimit;
+    int failures;//consecutive failed health checks or backend exits
+    int failbackBest;//index of the first profile ahead of the active one that recovered
+    qint64 m_lastFailover;
+    QElapsedTimer failoverClock;
+    QTimer healthTimer;
+    QTimer failbackTimer;
+    LatencyTester healthCheck;
+    LatencyTester failbackCheck;
+
+    int nextCandidate(int from) const;
+    void failover(const QString &reason);
+    void switchTo(int i);
+    void onProcessStateChanged(int i, SS_Process::State s);
+
+private slots:
+    void onHealthTimeout();
+    void onHealthResult(SSProfile *, qint64, qint64);
+    void onFailbackTimeout();
+    void onFailbackResult(SSProfile *, qint64, qint64);
+    void onFailbackFinished();
+    void onTargetsChanged();
+};
+
+#endif // FAILOVERCHAIN_H
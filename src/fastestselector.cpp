@@ -0,0 +1,94 @@
+#include "fastestselector.h"
+
+FastestSelector::FastestSelector(QObject *parent) :
+    QObject(parent),
+    m_current(NULL),
+    thresholdPercent(20),
+    handshake(false),
+    active(false)
+{
+    timer.setInterval(600000);
+    connect(&timer, &QTimer::timeout, this, &FastestSelector::evaluate);
+    connect(&tester, &LatencyTester::result, this, &FastestSelector::onResult);
+    connect(&tester, &LatencyTester::finished, this, &FastestSelector::onFinished);
+}
+
+/*
+ * interval is in seconds, threshold in percent of the current profile's
+ * latency. With handshake on, full handshakes through temporary backends
+ * are compared instead of TCP connect times.
+ */
+void FastestSelector::setPolicy(int interval, int threshold, bool hs)
+{
+    timer.setInterval(qMax(10, interval) * 1000);
+    thresholdPercent = qBound(0, threshold, 99);
+    handshake = hs;
+}
+
+void FastestSelector::start(const QList<SSProfile *> &c)
+{
+    stop();
+    candidates = c;
+    active = true;
+    evaluate();
+    timer.start();
+}
+
+void FastestSelector::stop()
+{
+    active = false;
+    timer.stop();
+    tester.abort();
+    candidates.clear();
+    latency.clear();
+    m_current = NULL;
+}
+
+void FastestSelector::evaluate()
+{
+    if (tester.isRunning()) {
+        return;
+    }
+    latency.clear();
+    tester.test(candidates, handshake);
+}
+
+void FastestSelector::onResult(SSProfile *p, qint64 connectTime, qint64 handshakeTime)
+{
+    latency.insert(p, handshake ? handshakeTime : connectTime);
+}
+
+void FastestSelector::onFinished()
+{
+    if (!active) {
+        return;
+    }
+
+    SSProfile *best = NULL;
+    qint64 bestLatency = -1;
+    for (QList<SSProfile *>::iterator it = candidates.begin(); it != candidates.end(); ++it) {
+        qint64 l = latency.value(*it, -1);
+        if (l >= 0 && (best == NULL || l < bestLatency)) {
+            best = *it;
+            bestLatency = l;
+        }
+    }
+    if (best == NULL) {
+        emit info(tr("None of the %1 candidate profiles is reachable.").arg(candidates.size()));
+        return;
+    }
+    if (best == m_current) {
+        return;
+    }
+
+    qint64 currentLatency = m_current ? latency.value(m_current, -1) : -1;
+    if (m_current && currentLatency >= 0 && bestLatency * 100 >= currentLatency * (100 - thresholdPercent)) {
+        emit info(tr("Staying on %1 (%2 ms), %3 (%4 ms) isn't faster by %5%.").arg(m_current->profileName).arg(currentLatency).arg(best->profileName).arg(bestLatency).arg(thresholdPercent));
+        return;
+    }
+
+    SSProfile *previous = m_current;
+    m_current = best;
+    emit info(tr("Fastest profile is %1 (%2 ms).").arg(best->profileName).arg(bestLatency));
+    emit selected(best, previous);
+}
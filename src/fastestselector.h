@@ -0,0 +1,53 @@
+/*
+ * Fastest Selector Class
+ *
+ * Picks the profile with the lowest measured latency out of a list of
+ * candidates, then measures again on a schedule. It only moves to another
+ * profile if that one is faster by more than the threshold, so that
+ * jitter doesn't make it flap between servers.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef FASTESTSELECTOR_H
+#define FASTESTSELECTOR_H
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QTimer>
+#include "latencytester.h"
+#include "ssprofile.h"
+
+class FastestSelector : public QObject
+{
+    Q_OBJECT
+
+public:
+    FastestSelector(QObject *parent = 0);
+
+    void setPolicy(int interval, int threshold, bool handshake);
+    void start(const QList<SSProfile *> &candidates);
+    void stop();
+    inline bool isActive() const { return active; }
+    inline SSProfile *current() const { return m_current; }
+
+signals:
+    void selected(SSProfile *best, SSProfile *previous);
+    void info(const QString &);
+
+private:
+    LatencyTester tester;
+    QList<SSProfile *> candidates;
+    QHash<SSProfile *, qint64> latency;
+    SSProfile *m_current;
+    QTimer timer;
+    int thresholdPercent;
+    bool handshake;
+    bool active;
+
+private slots:
+    void evaluate();
+    void onResult(SSProfile *, qint64, qint64);
+    void onFinished();
+};
+
+#endif // FASTESTSELECTOR_H
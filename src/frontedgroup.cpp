@@ -0,0 +1,118 @@
+#include <QTimer>
+#include "frontedgroup.h"
+
+FrontedGroup::FrontedGroup(QThread *forwarderThread, QObject *parent) :
+    QObject(parent),
+    m_frontPort(0),
+    listening(false),
+    autoRestart(false),
+    restartDelay(100),
+    restartMaxDelay(30000),
+    restartLimit(5)
+{
+    m_forwarder = new PortForwarder;
+    m_forwarder->moveToThread(forwarderThread);
+    connect(forwarderThread, &QThread::finished, m_forwarder, &QObject::deleteLater);
+    connect(m_forwarder, &PortForwarder::info, this, &FrontedGroup::info);
+    connect(m_forwarder, &PortForwarder::targetsChanged, this, &FrontedGroup::targetsChanged);
+    if (!forwarderThread->isRunning()) {
+        forwarderThread->start();
+    }
+}
+
+int FrontedGroup::addMember()
+{
+    const int i = procs.size();
+    SS_Process *proc = new SS_Process(this);
+    proc->setRestartPolicy(autoRestart, restartDelay, restartMaxDelay, restartLimit);
+    connect(proc, &SS_Process::processRead, this, [this, i] (const QByteArray &o, const QVector<BackendEvent> &events) {
+        emit processRead(i, o, events);
+    });
+    connect(proc, &SS_Process::stateChanged, this, [this, i] (SS_Process::State s) {
+        //a served member that came back on another port
+        if (s == SS_Process::Ready && listening && served.contains(i) && !servedPorts.contains(port(i))) {
+            serve(served);
+        }
+        emit stateChanged(i, s);
+    });
+    procs << proc;
+    profiles << NULL;
+    return i;
+}
+
+void FrontedGroup::clear()
+{
+    stop();
+    for (QList<SS_Process *>::iterator it = procs.begin(); it != procs.end(); ++it) {
+        (*it)->disconnect(this);
+        (*it)->deleteLater();
+    }
+    procs.clear();
+    profiles.clear();
+}
+
+void FrontedGroup::setRestartPolicy(bool enabled, int delay, int maxDelay, int limit)
+{
+    autoRestart = enabled;
+    restartDelay = delay;
+    restartMaxDelay = maxDelay;
+    restartLimit = limit;
+    for (QList<SS_Process *>::iterator it = procs.begin(); it != procs.end(); ++it) {
+        (*it)->setRestartPolicy(enabled, delay, maxDelay, limit);
+    }
+}
+
+//the member's backend listens on a spare loopback port, the forwarder owns the real one
+void FrontedGroup::launch(int i, SSProfile * const p, bool debug)
+{
+    profiles[i] = p;
+    procs[i]->startOnSparePort(p, debug);
+}
+
+void FrontedGroup::stopMember(int i)
+{
+    procs[i]->stop();
+}
+
+void FrontedGroup::setFront(const QHostAddress &addr, quint16 port)
+{
+    frontAddr = addr;
+    m_frontPort = port;
+}
+
+void FrontedGroup::serve(const QList<int> &members)
+{
+    QList<quint16> targets;
+    for (QList<int>::const_iterator it = members.begin(); it != members.end(); ++it) {
+        targets << port(*it);
+    }
+    served = members;
+    servedPorts = targets;
+    PortForwarder *f = m_forwarder;
+    if (listening) {
+        QTimer::singleShot(0, f, [f, targets] { f->setTargets(targets); });
+        return;
+    }
+    listening = true;
+    QHostAddress addr = frontAddr;
+    quint16 listenPort = m_frontPort;
+    QTimer::singleShot(0, f, [f, targets, addr, listenPort] {
+        f->setTargets(targets);
+        f->listen(addr, listenPort);
+    });
+}
+
+void FrontedGroup::stop()
+{
+    listening = false;
+    served.clear();
+    servedPorts.clear();
+    PortForwarder *f = m_forwarder;
+    QTimer::singleShot(0, f, [f] {
+        f->close();
+        f->setTargets(QList<quint16>());
+    });
+    for (QList<SS_Process *>::iterator it = procs.begin(); it != procs.end(); ++it) {
+        (*it)->stop();
+    }
+}
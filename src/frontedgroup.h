@@ -0,0 +1,74 @@
+/*
+ * Fronted Group Class
+ *
+ * A set of backends on spare loopback ports behind one forwarder that
+ * owns a user-facing local port. Hot standby, failover and load balancing
+ * decide which members get the connections, this class runs the members
+ * and the forwarder. The forwarder lives in a thread shared with the
+ * other fronts, which has to outlive the group's forwarder use.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef FRONTEDGROUP_H
+#define FRONTEDGROUP_H
+#include <QObject>
+#include <QList>
+#include <QThread>
+#include <QHostAddress>
+#include "ss_process.h"
+#include "portforwarder.h"
+#include "ssprofile.h"
+
+class FrontedGroup : public QObject
+{
+    Q_OBJECT
+
+public:
+    FrontedGroup(QThread *forwarderThread, QObject *parent = 0);
+
+    //appends a member without a profile, returns its index
+    int addMember();
+    //stops and removes all members
+    void clear();
+    inline int size() const { return procs.size(); }
+    inline SS_Process *process(int i) const { return procs.at(i); }
+    //NULL until the member was launched
+    inline SSProfile *profile(int i) const { return profiles.at(i); }
+    //valid once the member is Ready, its backend may have moved off a taken port
+    inline quint16 port(int i) const { return procs.at(i)->listenPort(); }
+    void setRestartPolicy(bool enabled, int delay, int maxDelay, int limit);
+
+    void launch(int i, SSProfile * const p, bool debug);
+    void stopMember(int i);
+    void setFront(const QHostAddress &addr, quint16 port);
+    //points the forwarder at these members, it starts listening on the first call
+    void serve(const QList<int> &members);
+    //closes the front and stops every member
+    void stop();
+    inline bool isListening() const { return listening; }
+    inline quint16 frontPort() const { return m_frontPort; }
+    //for policies, weights and connection counts, slots must be invoked in its thread
+    inline PortForwarder *forwarder() const { return m_forwarder; }
+
+signals:
+    void processRead(int i, const QByteArray &o, const QVector<BackendEvent> &events);
+    void stateChanged(int i, SS_Process::State s);
+    void info(const QString &);
+    void targetsChanged();
+
+private:
+    QList<SS_Process *> procs;
+    QList<SSProfile *> profiles;
+    QList<int> served;
+    QList<quint16> servedPorts;//their ports when the forwarder was pointed at them
+    PortForwarder *m_forwarder;
+    QHostAddress frontAddr;
+    quint16 m_frontPort;
+    bool listening;
+    bool autoRestart;
+    int restartDelay;
+    int restartMaxDelay;
+    int restartLimit;
+};
+
+#endif // FRONTEDGROUP_H
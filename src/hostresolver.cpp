@@ -0,0 +1,174 @@
+#include <QDebug>
+#include <QCoreApplication>
+#include "hostresolver.h"
+
+//milliseconds before a name that couldn't be resolved is looked up again
+static const int RETRY_INTERVAL = 5000;
+
+HostResolver::HostResolver(QObject *parent) :
+    QObject(parent),
+    m_ttl(0),
+    m_hits(0),
+    m_misses(0)
+{
+    connect(&refreshTimer, &QTimer::timeout, this, &HostResolver::onRefreshTimeout);
+}
+
+HostResolver *HostResolver::instance()
+{
+    static HostResolver *resolver = new HostResolver(QCoreApplication::instance());
+    return resolver;
+}
+
+/*
+ * Qt's resolver doesn't report the TTL of the records, so every entry
+ * lives for the configured number of seconds. 0 turns pinning off and
+ * backends get the host names as they are.
+ */
+void HostResolver::setTtl(int seconds)
+{
+    m_ttl = qMax(0, seconds);
+    if (m_ttl > 0) {
+        refreshTimer.start(qMax(1000, m_ttl * 250));
+    }
+    else {
+        refreshTimer.stop();
+        clear();
+    }
+}
+
+/*
+ * Returns false if host is being resolved, resolved() is emitted once
+ * it's done. Otherwise addr is set to the pinned address, or to a null
+ * address if host should be passed on as it is: it's an address
+ * already, pinning is off, or the name couldn't be resolved lately.
+ * A stale entry is still used while it's refreshed.
+ */
+bool HostResolver::pin(const QString &host, QHostAddress *addr)
+{
+    *addr = QHostAddress();
+    if (m_ttl == 0 || host.isEmpty() || !QHostAddress(host).isNull()) {
+        return true;
+    }
+
+    QHash<QString, Entry>::iterator it = cache.find(host);
+    if (it == cache.end()) {
+        Entry e;
+        e.pinned = 0;
+        e.pending = false;
+        it = cache.insert(host, e);
+    }
+    it->lastUse.start();
+    if (!it->addresses.isEmpty()) {
+        ++m_hits;
+        *addr = it->addresses.at(it->pinned);
+        if (!it->pending && it->age.elapsed() > qint64(m_ttl) * 1000) {
+            lookup(host);
+        }
+        return true;
+    }
+    if (it->lastFailure.isValid() && it->lastFailure.elapsed() < RETRY_INTERVAL) {
+        return true;
+    }
+    ++m_misses;
+    if (!it->pending) {
+        lookup(host);
+    }
+    return false;
+}
+
+void HostResolver::prefetch(const QStringList &hosts)
+{
+    QHostAddress addr;
+    for (QStringList::const_iterator it = hosts.begin(); it != hosts.end(); ++it) {
+        pin(*it, &addr);
+    }
+}
+
+//the next address of host is pinned, unless addr isn't the pinned one anymore
+void HostResolver::reportFailure(const QString &host, const QHostAddress &addr)
+{
+    QHash<QString, Entry>::iterator it = cache.find(host);
+    if (addr.isNull() || it == cache.end() || it->addresses.isEmpty()) {
+        return;
+    }
+    if (it->addresses.size() > 1 && it->addresses.at(it->pinned) == addr) {
+        it->pinned = (it->pinned + 1) % it->addresses.size();
+        qDebug() << "Address" << addr.toString() << "of" << host << "failed, switching to" << it->addresses.at(it->pinned).toString();
+    }
+    if (!it->pending) {
+        lookup(host);
+    }
+}
+
+void HostResolver::clear()
+{
+    for (QHash<int, QString>::iterator it = lookups.begin(); it != lookups.end(); ++it) {
+        QHostInfo::abortHostLookup(it.key());
+    }
+    lookups.clear();
+    cache.clear();
+}
+
+void HostResolver::lookup(const QString &host)
+{
+    cache[host].pending = true;
+    lookups.insert(QHostInfo::lookupHost(host, this, SLOT(onHostInfo(QHostInfo))), host);
+}
+
+void HostResolver::onHostInfo(const QHostInfo &info)
+{
+    QString host = lookups.take(info.lookupId());
+    if (!host.isEmpty()) {
+        onLookedUp(host, info.error() == QHostInfo::NoError ? info.addresses() : QList<QHostAddress>(), info.errorString());
+    }
+}
+
+/*
+ * The pinned address stays pinned as long as the name still resolves
+ * to it, so that refreshes don't move backends between addresses.
+ */
+void HostResolver::onLookedUp(const QString &host, const QList<QHostAddress> &addresses, const QString &error)
+{
+    QHash<QString, Entry>::iterator it = cache.find(host);
+    if (it == cache.end()) {
+        return;
+    }
+    it->pending = false;
+    if (addresses.isEmpty()) {
+        it->lastFailure.start();
+        qWarning() << "Cannot resolve" << host << error;
+    }
+    else {
+        QHostAddress old = it->addresses.isEmpty() ? QHostAddress() : it->addresses.at(it->pinned);
+        it->addresses = addresses;
+        it->pinned = qMax(0, addresses.indexOf(old));
+        it->age.start();
+        it->lastFailure.invalidate();
+    }
+    emit resolved(host, !it->addresses.isEmpty());
+}
+
+/*
+ * Entries are refreshed once they're four fifths through their lifetime.
+ * Names nobody asked for during four lifetimes are dropped instead.
+ */
+void HostResolver::onRefreshTimeout()
+{
+    QStringList due;
+    for (QHash<QString, Entry>::iterator it = cache.begin(); it != cache.end();) {
+        if (it->lastUse.elapsed() > qint64(m_ttl) * 4000) {
+            it = cache.erase(it);
+            continue;
+        }
+        bool stale = !it->age.isValid() || it->age.elapsed() > qint64(m_ttl) * 800;
+        bool retry = !it->lastFailure.isValid() || it->lastFailure.elapsed() >= RETRY_INTERVAL;
+        if (!it->pending && stale && retry) {
+            due << it.key();
+        }
+        ++it;
+    }
+    for (QStringList::iterator it = due.begin(); it != due.end(); ++it) {
+        lookup(*it);
+    }
+}
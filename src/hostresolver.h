@@ -0,0 +1,73 @@
+/*
+ * Host Resolver Class
+ *
+ * Process-wide cache of server host name lookups. Names are resolved
+ * asynchronously ahead of time, and one address per name is pinned and
+ * handed to backends, so that starting or restarting a backend doesn't
+ * wait for DNS. Entries are refreshed in the background before they
+ * expire; while a refresh is running, or if it fails, the old addresses
+ * keep being used. An address reported as failing is replaced by the
+ * next one of the same name. Only used from the GUI thread.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef HOSTRESOLVER_H
+#define HOSTRESOLVER_H
+#include <QObject>
+#include <QHash>
+#include <QList>
+#include <QStringList>
+#include <QHostAddress>
+#include <QHostInfo>
+#include <QElapsedTimer>
+#include <QTimer>
+
+class HostResolver : public QObject
+{
+    Q_OBJECT
+
+public:
+    static HostResolver *instance();
+
+    void setTtl(int seconds);
+    inline int ttl() const { return m_ttl; }
+    bool pin(const QString &host, QHostAddress *addr);
+    void prefetch(const QStringList &hosts);
+    void reportFailure(const QString &host, const QHostAddress &addr);
+    void clear();
+
+    inline quint64 hits() const { return m_hits; }
+    inline quint64 misses() const { return m_misses; }
+
+signals:
+    void resolved(const QString &host, bool ok);
+
+private:
+    HostResolver(QObject *parent = 0);
+
+    struct Entry
+    {
+        QList<QHostAddress> addresses;
+        int pinned;//index into addresses
+        bool pending;
+        QElapsedTimer age;//since the last successful lookup
+        QElapsedTimer lastUse;
+        QElapsedTimer lastFailure;
+    };
+
+    QHash<QString, Entry> cache;
+    QHash<int, QString> lookups;//lookup id to host name
+    int m_ttl;//seconds, 0 turns pinning off
+    QTimer refreshTimer;
+    quint64 m_hits;
+    quint64 m_misses;
+
+    void lookup(const QString &host);
+    void onLookedUp(const QString &host, const QList<QHostAddress> &addresses, const QString &error);
+
+private slots:
+    void onHostInfo(const QHostInfo &info);
+    void onRefreshTimeout();
+};
+
+#endif // HOSTRESOLVER_H
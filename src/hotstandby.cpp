@@ -0,0 +1,104 @@
+#include <QDebug>
+#include "hotstandby.h"
+
+HotStandby::HotStandby(QThread *forwarderThread, QObject *parent) :
+    QObject(parent),
+    group(forwarderThread),
+    active(0),
+    running(false),
+    m_lastSwitchover(-1)
+{
+    group.addMember();
+    group.addMember();
+    connect(&group, &FrontedGroup::targetsChanged, this, &HotStandby::onTargetsChanged);
+    connect(&group, &FrontedGroup::info, this, [this] (const QString &s) {
+        emit processRead(activeProfile(), s.toLocal8Bit());
+    });
+    connect(&group, &FrontedGroup::processRead, this, [this] (int i, const QByteArray &o, const QVector<BackendEvent> &events) {
+        emit processRead(group.profile(i), o, events);
+    });
+    connect(&group, &FrontedGroup::stateChanged, this, &HotStandby::onProcessStateChanged);
+}
+
+HotStandby::~HotStandby()
+{
+    stop();
+}
+
+void HotStandby::setRestartPolicy(bool enabled, int delay, int maxDelay, int limit)
+{
+    group.setRestartPolicy(enabled, delay, maxDelay, limit);
+}
+
+void HotStandby::start(SSProfile * const primary, SSProfile * const standby, bool debug)
+{
+    stop();
+    active = 0;
+    running = true;
+    group.setFront(QHostAddress(primary->local_addr), primary->local_port.toUShort());
+    group.launch(0, primary, debug);
+    group.launch(1, standby, debug);
+}
+
+void HotStandby::stop()
+{
+    if (!running) {
+        return;
+    }
+    running = false;
+    group.stop();
+    emit processStopped(activeProfile());
+}
+
+bool HotStandby::isRunning() const
+{
+    return running;
+}
+
+/*
+ * Hands the local port over to the standby backend.
+ * Connections already relayed by the old backend are left alone.
+ */
+void HotStandby::switchOver()
+{
+    if (!running || group.process(1 - active)->state() != SS_Process::Ready) {
+        return;
+    }
+    switchClock.start();
+    SSProfile *from = activeProfile();
+    active = 1 - active;
+    group.serve(QList<int>() << active);
+
+    emit processStopped(from);
+    emit processStarted(activeProfile());
+}
+
+void HotStandby::onTargetsChanged()
+{
+    if (switchClock.isValid()) {
+        m_lastSwitchover = switchClock.elapsed();
+        switchClock.invalidate();
+        emit processRead(activeProfile(), tr("Local port %1 handed over to %2 in %3 ms.").arg(group.frontPort()).arg(activeProfile()->profileName).arg(m_lastSwitchover).toLocal8Bit());
+    }
+}
+
+void HotStandby::onProcessStateChanged(int i, SS_Process::State s)
+{
+    emit stateChanged(group.profile(i), s);
+    if (!running) {
+        return;
+    }
+
+    if (i == active && s == SS_Process::Ready && !group.isListening()) {
+        group.serve(QList<int>() << active);
+        emit processStarted(activeProfile());
+    }
+    else if (i == active && s != SS_Process::Ready && group.isListening()) {
+        emit processRead(group.profile(i), tr("Active backend %1 is down, switching to standby.").arg(group.profile(i)->profileName).toLocal8Bit());
+        switchOver();
+    }
+    else if (i != active && s == SS_Process::Ready && group.isListening() && group.process(active)->state() != SS_Process::Ready) {
+        //the standby came up after the active one died
+        switchOver();
+    }
+}
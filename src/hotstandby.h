@@ -0,0 +1,58 @@
+/*
+ * Hot Standby Class
+ *
+ * Runs a primary and a standby profile on spare loopback ports behind
+ * one forwarder that owns the user-facing local port. When the active
+ * backend dies, or the standby is started explicitly, the forwarder is
+ * pointed at the other backend without a cold start.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef HOTSTANDBY_H
+#define HOTSTANDBY_H
+#include <QObject>
+#include <QThread>
+#include <QElapsedTimer>
+#include "ss_process.h"
+#include "frontedgroup.h"
+#include "ssprofile.h"
+
+class HotStandby : public QObject
+{
+    Q_OBJECT
+
+public:
+    HotStandby(QThread *forwarderThread, QObject *parent = 0);
+    ~HotStandby();
+
+    void start(SSProfile * const primary, SSProfile * const standby, bool debug);
+    void stop();
+    void switchOver();
+    void setRestartPolicy(bool enabled, int delay, int maxDelay, int limit);
+    bool isRunning() const;
+    inline SSProfile *primaryProfile() const { return group.profile(0); }
+    inline SSProfile *activeProfile() const { return group.profile(active); }
+    inline SSProfile *standbyProfile() const { return group.profile(1 - active); }
+    inline SS_Process *activeProcess() const { return group.process(active); }
+    inline qint64 lastSwitchoverTime() const { return m_lastSwitchover; }
+
+signals:
+    void processRead(SSProfile *p, const QByteArray &o, const QVector<BackendEvent> &events = QVector<BackendEvent>());
+    void processStarted(SSProfile *p);
+    void processStopped(SSProfile *p);
+    void stateChanged(SSProfile *p, SS_Process::State s);
+
+private:
+    FrontedGroup group;//member 0 is the primary, 1 the standby
+    int active;
+    bool running;
+    qint64 m_lastSwitchover;
+    QElapsedTimer switchClock;
+
+    void onProcessStateChanged(int i, SS_Process::State s);
+
+private slots:
+    void onTargetsChanged();
+};
+
+#endif // HOTSTANDBY_H
@@ -0,0 +1,248 @@
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include "latencytester.h"
+#include "ss_process.h"
+#include "hostresolver.h"
+
+//a temporary backend gets this long to answer on its port, on top of the probe timeout
+static const int BACKEND_START_TIMEOUT = 10000;
+
+struct LatencyTester::Probe
+{
+    SSProfile *profile;
+    QTcpSocket *socket;
+    SS_Process *backend;
+    QTimer *timer;
+    QElapsedTimer clock;
+    QHostAddress server;//pinned address of the server, null if connected by name
+    qint64 connectTime;
+    qint64 handshakeTime;
+    int stage;//of the handshake: greeting, connect reply, first byte of the response
+};
+
+LatencyTester::LatencyTester(QObject *parent) :
+    QObject(parent),
+    withHandshake(false),
+    concurrency(8),
+    timeout(3000),
+    targetHost("www.gstatic.com"),
+    targetPort(80)
+{}
+
+LatencyTester::~LatencyTester()
+{
+    abort();
+}
+
+void LatencyTester::setConcurrency(int n)
+{
+    concurrency = qMax(1, n);
+}
+
+void LatencyTester::setTimeout(int msec)
+{
+    timeout = qMax(100, msec);
+}
+
+void LatencyTester::setHandshakeTarget(const QString &host, quint16 port)
+{
+    targetHost = host;
+    targetPort = port;
+}
+
+void LatencyTester::test(const QList<SSProfile *> &profiles, bool handshake)
+{
+    abort();
+    withHandshake = handshake;
+    queue = profiles;
+    next();
+}
+
+/*
+ * Measures the handshake through backends that are already running on
+ * the given loopback ports, i.e. the path clients actually use.
+ */
+void LatencyTester::testThrough(const QHash<SSProfile *, quint16> &localPorts)
+{
+    abort();
+    withHandshake = true;
+    queue = localPorts.keys();
+    throughPorts = localPorts;
+    next();
+}
+
+void LatencyTester::abort()
+{
+    queue.clear();
+    throughPorts.clear();
+    while (!probes.isEmpty()) {
+        release(probes.takeFirst());
+    }
+}
+
+void LatencyTester::next()
+{
+    while (probes.size() < concurrency && !queue.isEmpty()) {
+        Probe *pr = new Probe;
+        pr->profile = queue.takeFirst();
+        pr->socket = NULL;
+        pr->backend = NULL;
+        pr->connectTime = -1;
+        pr->handshakeTime = -1;
+        pr->stage = 0;
+        pr->timer = new QTimer(this);
+        pr->timer->setSingleShot(true);
+        connect(pr->timer, &QTimer::timeout, this, [this, pr] { done(pr); });
+        probes << pr;
+        if (throughPorts.contains(pr->profile)) {
+            pr->timer->start(timeout);
+            startSocks(pr, throughPorts.take(pr->profile));
+        }
+        else {
+            startConnect(pr);
+        }
+    }
+    if (probes.isEmpty()) {
+        emit finished();
+    }
+}
+
+/*
+ * The clock starts once the host name is resolved, so
+ * only the TCP handshake with the server is measured.
+ * The pinned address is tested, that's the one backends get.
+ */
+void LatencyTester::startConnect(Probe *pr)
+{
+    HostResolver::instance()->pin(pr->profile->server, &pr->server);
+    pr->socket = new QTcpSocket(this);
+    connect(pr->socket, &QTcpSocket::hostFound, this, [pr] { pr->clock.start(); });
+    connect(pr->socket, &QTcpSocket::connected, this, [this, pr] {
+        pr->connectTime = pr->clock.elapsed();
+        pr->socket->disconnect(this);
+        pr->socket->abort();
+        if (withHandshake) {
+            startHandshake(pr);
+        }
+        else {
+            done(pr);
+        }
+    });
+    connect(pr->socket, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QTcpSocket::error), this, [this, pr] { done(pr); });
+    pr->timer->start(timeout);
+    if (pr->server.isNull()) {
+        pr->socket->connectToHost(pr->profile->server, pr->profile->server_port.toUShort());
+    }
+    else {
+        pr->socket->connectToHost(pr->server, pr->profile->server_port.toUShort());
+    }
+}
+
+void LatencyTester::startHandshake(Probe *pr)
+{
+    SSProfile tmp = *pr->profile;
+    tmp.workers = 1;
+
+    pr->backend = new SS_Process(this);
+    connect(pr->backend, &SS_Process::stateChanged, this, [this, pr] (SS_Process::State s) {
+        if (s == SS_Process::Failed || s == SS_Process::Stopped) {
+            done(pr);
+        }
+    });
+    connect(pr->backend, &SS_Process::processStarted, this, [this, pr] { startSocks(pr, pr->backend->listenPort()); });
+    pr->timer->start(BACKEND_START_TIMEOUT + timeout);
+    pr->backend->startOnSparePort(&tmp, false);
+}
+
+void LatencyTester::startSocks(Probe *pr, quint16 port)
+{
+    if (pr->socket) {
+        pr->socket->disconnect(this);
+    }
+    else {
+        pr->socket = new QTcpSocket(this);
+    }
+    connect(pr->socket, &QTcpSocket::connected, this, [pr] {
+        pr->socket->write("\x05\x01\x00", 3);
+    });
+    connect(pr->socket, &QTcpSocket::readyRead, this, [this, pr] { onHandshakeRead(pr); });
+    connect(pr->socket, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QTcpSocket::error), this, [this, pr] { done(pr); });
+    pr->socket->connectToHost(QHostAddress::LocalHost, port);
+}
+
+void LatencyTester::onHandshakeRead(Probe *pr)
+{
+    QTcpSocket *s = pr->socket;
+    switch (pr->stage) {
+    case 0:
+        if (s->bytesAvailable() < 2) {
+            return;
+        }
+        if (s->read(2) != QByteArray("\x05\x00", 2)) {
+            done(pr);
+            return;
+        }
+        {
+            QByteArray host = targetHost.toUtf8();
+            QByteArray req("\x05\x01\x00\x03", 4);
+            req.append(static_cast<char>(host.size())).append(host);
+            req.append(static_cast<char>(targetPort >> 8)).append(static_cast<char>(targetPort & 0xff));
+            pr->clock.start();
+            s->write(req);
+        }
+        pr->stage = 1;
+        break;
+    case 1:
+        /*
+         * Backends answer CONNECT before they reached the server, so the
+         * request goes on to the target and the clock stops at its answer.
+         */
+        if (s->bytesAvailable() < 10) {
+            return;
+        }
+        s->readAll();
+        s->write(QString("HEAD /generate_204 HTTP/1.1\r\nHost: %1\r\nConnection: close\r\n\r\n").arg(targetHost).toUtf8());
+        pr->stage = 2;
+        break;
+    default:
+        pr->handshakeTime = pr->clock.elapsed();
+        done(pr);
+        break;
+    }
+}
+
+void LatencyTester::done(Probe *pr)
+{
+    if (!probes.removeOne(pr)) {
+        return;
+    }
+    SSProfile *p = pr->profile;
+    qint64 connectTime = pr->connectTime;
+    qint64 handshakeTime = pr->handshakeTime;
+    if (connectTime < 0 && !pr->server.isNull()) {
+        HostResolver::instance()->reportFailure(p->server, pr->server);
+    }
+    release(pr);
+    emit result(p, connectTime, handshakeTime);
+    next();
+}
+
+void LatencyTester::release(Probe *pr)
+{
+    pr->timer->disconnect(this);
+    pr->timer->stop();
+    pr->timer->deleteLater();
+    if (pr->socket) {
+        pr->socket->disconnect(this);
+        pr->socket->abort();
+        pr->socket->deleteLater();
+    }
+    if (pr->backend) {
+        pr->backend->disconnect(this);
+        pr->backend->stop();
+        pr->backend->deleteLater();
+    }
+    delete pr;
+}
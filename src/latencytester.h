@@ -0,0 +1,62 @@
+/*
+ * Latency Tester Class
+ *
+ * Measures the TCP connect time to the servers of many profiles at once,
+ * with at most a few probes in flight. Optionally it also measures a full
+ * handshake: a temporary backend is started on a spare loopback port and
+ * the time from the SOCKS5 CONNECT request to the first response byte of
+ * the target is taken.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef LATENCYTESTER_H
+#define LATENCYTESTER_H
+#include <QObject>
+#include <QList>
+#include <QHash>
+#include <QString>
+#include "ssprofile.h"
+
+class LatencyTester : public QObject
+{
+    Q_OBJECT
+
+public:
+    LatencyTester(QObject *parent = 0);
+    ~LatencyTester();
+
+    void setConcurrency(int n);
+    void setTimeout(int msec);
+    void setHandshakeTarget(const QString &host, quint16 port);
+    void test(const QList<SSProfile *> &profiles, bool handshake);
+    void testThrough(const QHash<SSProfile *, quint16> &localPorts);
+    void abort();
+    inline bool isRunning() const { return !queue.isEmpty() || !probes.isEmpty(); }
+
+signals:
+    //milliseconds, -1 if it failed or timed out, handshakeTime is -1 if not tested
+    void result(SSProfile *p, qint64 connectTime, qint64 handshakeTime);
+    void finished();
+
+private:
+    struct Probe;
+
+    QList<SSProfile *> queue;
+    QList<Probe *> probes;
+    QHash<SSProfile *, quint16> throughPorts;
+    bool withHandshake;
+    int concurrency;
+    int timeout;
+    QString targetHost;
+    quint16 targetPort;
+
+    void next();
+    void startConnect(Probe *);
+    void startHandshake(Probe *);
+    void startSocks(Probe *, quint16 port);
+    void onHandshakeRead(Probe *);
+    void done(Probe *);
+    void release(Probe *);
+};
+
+#endif // LATENCYTESTER_H
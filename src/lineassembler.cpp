@@ -0,0 +1,42 @@
+#include "lineassembler.h"
+
+LineAssembler::LineAssembler(int maxLength) :
+    m_maxLength(maxLength)
+{}
+
+/*
+ * Both \n and \r\n end a line. The rest of the chunk after the last line
+ * feed is kept; if it grows beyond the maximum length, it's given out as
+ * a line of its own.
+ */
+QList<QByteArray> LineAssembler::feed(const QByteArray &data)
+{
+    QList<QByteArray> lines;
+    int from = 0;
+    int nl;
+    while ((nl = data.indexOf('\n', from)) >= 0) {
+        QByteArray line = partial.isEmpty() ? data.mid(from, nl - from) : partial + data.mid(from, nl - from);
+        partial.clear();
+        if (line.endsWith('\r')) {
+            line.chop(1);
+        }
+        lines << line;
+        from = nl + 1;
+    }
+    partial.append(data.constData() + from, data.size() - from);
+    while (partial.size() >= m_maxLength) {
+        lines << partial.left(m_maxLength);
+        partial.remove(0, m_maxLength);
+    }
+    return lines;
+}
+
+QByteArray LineAssembler::takeRest()
+{
+    QByteArray rest = partial;
+    partial.clear();
+    if (rest.endsWith('\r')) {
+        rest.chop(1);
+    }
+    return rest;
+}
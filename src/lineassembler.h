@@ -0,0 +1,31 @@
+/*
+ * Line Assembler Class
+ *
+ * Cuts a byte stream that arrives in arbitrary chunks into whole lines.
+ * A line that isn't terminated yet is kept until the rest arrives, and
+ * an overlong one is cut, so that memory stays bounded.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef LINEASSEMBLER_H
+#define LINEASSEMBLER_H
+#include <QByteArray>
+#include <QList>
+
+class LineAssembler
+{
+public:
+    LineAssembler(int maxLength = 65536);
+
+    //complete lines in data, without their line endings
+    QList<QByteArray> feed(const QByteArray &data);
+    //the unterminated rest, once the stream ended
+    QByteArray takeRest();
+    inline void clear() { partial.clear(); }
+
+private:
+    QByteArray partial;
+    int m_maxLength;
+};
+
+#endif // LINEASSEMBLER_H
@@ -0,0 +1,294 @@
+#include <QDebug>
+#include "loadbalancer.h"
+#include "hostresolver.h"
+
+//milliseconds between weight updates, and how much of the old rate a new sample keeps
+static const int WEIGHT_INTERVAL = 2000;
+static const double RATE_SMOOTHING = 0.7;
+
+LoadBalancer::LoadBalancer(QThread *forwarderThread, QObject *parent) :
+    QObject(parent),
+    group(forwarderThread),
+    m_policy(PortForwarder::RoundRobin),
+    running(false),
+    debug(false),
+    failureLimit(2)
+{
+    group.setRestartPolicy(true, 100, 30000, 5);
+    healthTimer.setInterval(5000);
+    weightTimer.setInterval(WEIGHT_INTERVAL);
+    connect(&healthTimer, &QTimer::timeout, this, &LoadBalancer::onHealthTimeout);
+    connect(&weightTimer, &QTimer::timeout, this, &LoadBalancer::updateWeights);
+    connect(&healthCheck, &LatencyTester::result, this, &LoadBalancer::onHealthResult);
+
+    connect(&group, &FrontedGroup::info, this, [this] (const QString &s) {
+        if (!members.isEmpty()) {
+            emit processRead(frontProfile(), s.toLocal8Bit());
+        }
+    });
+    connect(&group, &FrontedGroup::processRead, this, [this] (int i, const QByteArray &o, const QVector<BackendEvent> &events) {
+        emit processRead(members.at(i)->profile, o, events);
+    });
+    connect(&group, &FrontedGroup::stateChanged, this, &LoadBalancer::onProcessStateChanged);
+}
+
+LoadBalancer::~LoadBalancer()
+{
+    stop();
+}
+
+PortForwarder::Policy LoadBalancer::policyFromName(const QString &name)
+{
+    if (name.compare("leastActive", Qt::CaseInsensitive) == 0) {
+        return PortForwarder::LeastActive;
+    }
+    if (name.compare("throughput", Qt::CaseInsensitive) == 0) {
+        return PortForwarder::Weighted;
+    }
+    return PortForwarder::RoundRobin;
+}
+
+void LoadBalancer::setRestartPolicy(bool enabled, int delay, int maxDelay, int limit)
+{
+    group.setRestartPolicy(enabled, delay, maxDelay, limit);
+}
+
+//interval in milliseconds, a backend is ejected after failures failed checks in a row
+void LoadBalancer::setHealthPolicy(int interval, int failures)
+{
+    healthTimer.setInterval(qMax(100, interval));
+    healthCheck.setTimeout(qMin(3000, qMax(100, interval)));
+    failureLimit = qMax(1, failures);
+}
+
+void LoadBalancer::setHealthTarget(const QString &host, quint16 port)
+{
+    healthCheck.setHandshakeTarget(host, port);
+}
+
+void LoadBalancer::setPolicy(PortForwarder::Policy policy)
+{
+    m_policy = policy;
+    PortForwarder *f = group.forwarder();
+    QTimer::singleShot(0, f, [f, policy] { f->setPolicy(policy); });
+}
+
+void LoadBalancer::setHedging(int budgetPercent)
+{
+    PortForwarder *f = group.forwarder();
+    QTimer::singleShot(0, f, [f, budgetPercent] { f->setHedging(budgetPercent); });
+}
+
+void LoadBalancer::start(const QList<SSProfile *> &pool, bool d)
+{
+    stop();
+    if (pool.isEmpty()) {
+        return;
+    }
+    running = true;
+    debug = d;
+    group.setFront(QHostAddress(pool.first()->local_addr), pool.first()->local_port.toUShort());
+
+    for (QList<SSProfile *>::const_iterator it = pool.begin(); it != pool.end(); ++it) {
+        Member *m = new Member;
+        int i = group.addMember();
+        m->profile = *it;
+        m->proc = group.process(i);
+        m->failures = 0;
+        m->ejected = false;
+        m->lastBytes = 0;
+        m->rate = -1;
+        members << m;
+        group.launch(i, m->profile, debug);
+    }
+    PortForwarder::Policy policy = m_policy;
+    PortForwarder *f = group.forwarder();
+    QTimer::singleShot(0, f, [f, policy] { f->setPolicy(policy); });
+}
+
+void LoadBalancer::stop()
+{
+    if (!running) {
+        return;
+    }
+    running = false;
+    healthTimer.stop();
+    weightTimer.stop();
+    healthCheck.abort();
+    group.clear();
+    for (QList<Member *>::iterator it = members.begin(); it != members.end(); ++it) {
+        emit processStopped((*it)->profile);
+    }
+    qDeleteAll(members);
+    members.clear();
+}
+
+bool LoadBalancer::isRunning() const
+{
+    return running;
+}
+
+LoadBalancer::Member *LoadBalancer::memberFor(SSProfile * const p) const
+{
+    for (QList<Member *>::const_iterator it = members.begin(); it != members.end(); ++it) {
+        if ((*it)->profile == p) {
+            return *it;
+        }
+    }
+    return NULL;
+}
+
+bool LoadBalancer::contains(SSProfile * const p) const
+{
+    return running && memberFor(p) != NULL;
+}
+
+bool LoadBalancer::isEjected(SSProfile * const p) const
+{
+    Member *m = memberFor(p);
+    return m && m->ejected;
+}
+
+SS_Process *LoadBalancer::process(SSProfile * const p) const
+{
+    Member *m = running ? memberFor(p) : NULL;
+    return m ? m->proc : NULL;
+}
+
+QList<SSProfile *> LoadBalancer::profiles() const
+{
+    QList<SSProfile *> l;
+    if (running) {
+        for (QList<Member *>::const_iterator it = members.begin(); it != members.end(); ++it) {
+            l << (*it)->profile;
+        }
+    }
+    return l;
+}
+
+/*
+ * Only ready backends that aren't ejected get connections. If all of
+ * them are ejected, all ready ones are used rather than none.
+ */
+void LoadBalancer::updateTargets()
+{
+    QList<int> targets, fallback;
+    for (int i = 0; i < members.size(); ++i) {
+        if (members.at(i)->proc->state() != SS_Process::Ready) {
+            continue;
+        }
+        fallback << i;
+        if (!members.at(i)->ejected) {
+            targets << i;
+        }
+    }
+    if (targets.isEmpty()) {
+        targets = fallback;
+    }
+    //the port is only taken once a backend is ready
+    if (group.isListening() || !targets.isEmpty()) {
+        group.serve(targets);
+    }
+}
+
+void LoadBalancer::onProcessStateChanged(int i, SS_Process::State s)
+{
+    Member *m = members.at(i);
+    emit stateChanged(m->profile, s);
+    if (!running) {
+        return;
+    }
+    bool wasListening = group.isListening();
+    updateTargets();
+    if (s == SS_Process::Ready) {
+        m->lastBytes = m->proc->trafficMeter().bytesUp() + m->proc->trafficMeter().bytesDown();
+        if (!wasListening) {
+            healthTimer.start();
+            weightTimer.start();
+        }
+        emit processStarted(m->profile);
+    }
+    else if (s == SS_Process::Failed || s == SS_Process::CrashLoop) {
+        emit processRead(m->profile, tr("%1 left the load balancing pool.").arg(m->profile->profileName).toLocal8Bit());
+    }
+}
+
+void LoadBalancer::onHealthTimeout()
+{
+    if (healthCheck.isRunning()) {
+        return;
+    }
+    QHash<SSProfile *, quint16> through;
+    for (int i = 0; i < members.size(); ++i) {
+        if (members.at(i)->proc->state() == SS_Process::Ready) {
+            through.insert(members.at(i)->profile, group.port(i));
+        }
+    }
+    healthCheck.testThrough(through);
+}
+
+void LoadBalancer::onHealthResult(SSProfile *p, qint64, qint64 handshakeTime)
+{
+    Member *m = memberFor(p);
+    if (!running || m == NULL) {
+        return;
+    }
+    if (handshakeTime >= 0) {
+        m->failures = 0;
+        if (m->ejected) {
+            m->ejected = false;
+            emit processRead(p, tr("%1 passed the health check, back in the pool.").arg(p->profileName).toLocal8Bit());
+            updateTargets();
+        }
+    }
+    else if (++m->failures >= failureLimit && !m->ejected) {
+        m->ejected = true;
+        emit processRead(p, tr("%1 failed %2 health checks in a row, ejected from the pool.").arg(p->profileName).arg(m->failures).toLocal8Bit());
+        updateTargets();
+
+        //if the server name has another address, the backend is moved there
+        QHostAddress addr;
+        HostResolver::instance()->reportFailure(p->server, m->proc->serverAddress());
+        if (HostResolver::instance()->pin(p->server, &addr) && !addr.isNull() && addr != m->proc->serverAddress()) {
+            emit processRead(p, tr("Restarting %1 on %2.").arg(p->profileName).arg(addr.toString()).toLocal8Bit());
+            group.launch(members.indexOf(m), p, debug);
+        }
+    }
+}
+
+/*
+ * Throughput per active connection, so that a backend isn't favoured
+ * just because it already carries more connections. Backends that were
+ * idle so far get the average weight.
+ */
+void LoadBalancer::updateWeights()
+{
+    if (m_policy != PortForwarder::Weighted) {
+        return;
+    }
+    double maxRate = 0, sum = 0;
+    int measured = 0;
+    for (int i = 0; i < members.size(); ++i) {
+        Member *m = members.at(i);
+        quint64 bytes = m->proc->trafficMeter().bytesUp() + m->proc->trafficMeter().bytesDown();
+        int conns = group.forwarder()->activeConnections(group.port(i));
+        if (conns > 0 && bytes > m->lastBytes) {
+            double r = (bytes - m->lastBytes) * 1000.0 / WEIGHT_INTERVAL / conns;
+            m->rate = m->rate < 0 ? r : RATE_SMOOTHING * m->rate + (1 - RATE_SMOOTHING) * r;
+        }
+        m->lastBytes = bytes;
+        if (m->rate >= 0) {
+            maxRate = qMax(maxRate, m->rate);
+            sum += m->rate;
+            ++measured;
+        }
+    }
+
+    QHash<quint16, int> weights;
+    for (int i = 0; i < members.size(); ++i) {
+        double r = members.at(i)->rate >= 0 ? members.at(i)->rate : (measured > 0 ? sum / measured : 1);
+        weights.insert(group.port(i), maxRate > 0 ? qMax(1, qRound(100 * r / maxRate)) : 1);
+    }
+    PortForwarder *f = group.forwarder();
+    QTimer::singleShot(0, f, [f, weights] { f->setWeights(weights); });
+}
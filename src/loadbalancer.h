@@ -0,0 +1,93 @@
+/*
+ * Load Balancer Class
+ *
+ * Runs a pool of profiles on spare loopback ports behind one forwarder
+ * that owns the local port of the first profile, so that new connections
+ * are spread over several servers. Every backend is checked periodically
+ * by a handshake through it; one that fails repeatedly is ejected from
+ * the pool until it passes again. With the Weighted policy each backend
+ * is weighted by the throughput per connection it recently achieved.
+ * With hedging, a share of the connections is raced over two backends.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef LOADBALANCER_H
+#define LOADBALANCER_H
+#include <QObject>
+#include <QList>
+#include <QThread>
+#include <QTimer>
+#include "ss_process.h"
+#include "frontedgroup.h"
+#include "latencytester.h"
+#include "ssprofile.h"
+
+class LoadBalancer : public QObject
+{
+    Q_OBJECT
+
+public:
+    LoadBalancer(QThread *forwarderThread, QObject *parent = 0);
+    ~LoadBalancer();
+
+    static PortForwarder::Policy policyFromName(const QString &name);
+
+    void start(const QList<SSProfile *> &pool, bool debug);
+    void stop();
+    void setRestartPolicy(bool enabled, int delay, int maxDelay, int limit);
+    void setHealthPolicy(int interval, int failures);
+    void setHealthTarget(const QString &host, quint16 port);
+    void setPolicy(PortForwarder::Policy policy);
+    void setHedging(int budgetPercent);
+    bool isRunning() const;
+    bool contains(SSProfile * const p) const;
+    bool isEjected(SSProfile * const p) const;
+    SS_Process *process(SSProfile * const p) const;
+    QList<SSProfile *> profiles() const;
+    //the same without building a list
+    inline int memberCount() const { return running ? members.size() : 0; }
+    inline SSProfile *memberAt(int i) const { return members.at(i)->profile; }
+    inline int hedgedConnections() const { return group.forwarder()->hedgedConnections(); }
+    inline int hedgeWins() const { return group.forwarder()->hedgeWins(); }
+    //only valid while running
+    inline SSProfile *frontProfile() const { return members.first()->profile; }
+
+signals:
+    void processRead(SSProfile *p, const QByteArray &o, const QVector<BackendEvent> &events = QVector<BackendEvent>());
+    void processStarted(SSProfile *p);
+    void processStopped(SSProfile *p);
+    void stateChanged(SSProfile *p, SS_Process::State s);
+
+private:
+    //members[i] is member i of group
+    struct Member
+    {
+        SSProfile *profile;
+        SS_Process *proc;
+        int failures;//failed health checks in a row
+        bool ejected;
+        quint64 lastBytes;
+        double rate;//bytes per second and connection, smoothed
+    };
+
+    FrontedGroup group;
+    QList<Member *> members;
+    PortForwarder::Policy m_policy;
+    bool running;
+    bool debug;
+    int failureLimit;
+    QTimer healthTimer;
+    QTimer weightTimer;
+    LatencyTester healthCheck;
+
+    Member *memberFor(SSProfile * const p) const;
+    void onProcessStateChanged(int i, SS_Process::State s);
+    void updateTargets();
+
+private slots:
+    void onHealthTimeout();
+    void onHealthResult(SSProfile *, qint64, qint64);
+    void updateWeights();
+};
+
+#endif // LOADBALANCER_H
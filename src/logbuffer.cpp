@@ -0,0 +1,496 @@
+#include <QStringList>
+#include <QColor>
+#include <algorithm>
+#include "logbuffer.h"
+
+//bytes a line takes on top of its characters: the string header, the line, the list node and its index entries
+static const qint64 LINE_OVERHEAD = 96;
+
+bool LogBuffer::Query::refines(const Query &broader) const
+{
+    return type == broader.type && profile == broader.profile && from == broader.from && to == broader.to
+            && host.contains(broader.host, Qt::CaseInsensitive) && text.contains(broader.text, Qt::CaseInsensitive);
+}
+
+LogBuffer::LogBuffer(QObject *parent) :
+    QAbstractListModel(parent),
+    m_limit(16 << 20),
+    m_bytes(0),
+    pendingBytes(0),
+    m_dropped(0),
+    m_first(0),
+    compacted(0)
+{
+    flushTimer.setSingleShot(true);
+    flushTimer.setInterval(100);
+    connect(&flushTimer, &QTimer::timeout, this, &LogBuffer::flush);
+}
+
+void LogBuffer::setLimit(qint64 bytes)
+{
+    m_limit = qMax(qint64(1 << 16), bytes);
+    flush();
+}
+
+void LogBuffer::setFlushInterval(int msec)
+{
+    flushTimer.setInterval(qMax(0, msec));
+}
+
+qint64 LogBuffer::cost(const QString &line)
+{
+    return LINE_OVERHEAD + line.size() * static_cast<qint64>(sizeof(QChar));
+}
+
+/*
+ * The timer isn't restarted by later chunks, so a steady stream is
+ * still shown once per interval. Queued output beyond the limit is
+ * flushed right away, which keeps the queue bounded as well.
+ */
+void LogBuffer::enqueue(const Chunk &c, qint64 size)
+{
+    pending << c;
+    pendingBytes += size;
+    if (pendingBytes > m_limit) {
+        flush();
+    }
+    else if (!flushTimer.isActive()) {
+        flushTimer.start();
+    }
+}
+
+void LogBuffer::append(const QByteArray &chunk, const QString &profile, const QVector<BackendEvent> &events, bool showProfile)
+{
+    Chunk c;
+    c.profile = profile;
+    c.data = chunk;
+    c.events = events;
+    c.time = QDateTime::currentMSecsSinceEpoch();
+    c.showProfile = showProfile;
+    enqueue(c, chunk.size() * 2);
+}
+
+void LogBuffer::append(const QString &text)
+{
+    Chunk c;
+    c.text = text;
+    c.time = QDateTime::currentMSecsSinceEpoch();
+    c.showProfile = false;
+    enqueue(c, text.size() * 2);
+}
+
+//sequence numbers go on after a clear, so that filters can't mistake new lines for old ones
+void LogBuffer::clear()
+{
+    flushTimer.stop();
+    pending.clear();
+    pendingBytes = 0;
+    beginResetModel();
+    m_first += lines.size();
+    compacted = m_first;
+    lines.clear();
+    for (int i = 0; i < BackendEvent::TypeCount; ++i) {
+        typeIndex[i].clear();
+    }
+    for (QVector<QVector<qint64> >::iterator it = profileIndex.begin(); it != profileIndex.end(); ++it) {
+        it->clear();
+    }
+    for (QVector<QVector<qint64> >::iterator it = hostIndex.begin(); it != hostIndex.end(); ++it) {
+        it->clear();
+    }
+    pruneHosts();
+    m_bytes = 0;
+    endResetModel();
+}
+
+int LogBuffer::profileId(const QString &name)
+{
+    QHash<QString, int>::const_iterator it = profileIds.find(name);
+    if (it != profileIds.end()) {
+        return it.value();
+    }
+    int id = profileNames.size();
+    profileIds.insert(name, id);
+    profileNames << name;
+    profileIndex.resize(id + 1);
+    emit profileAdded(name);
+    return id;
+}
+
+int LogBuffer::hostId(const QByteArray &host)
+{
+    QByteArray key = host.toLower();
+    QHash<QByteArray, int>::const_iterator it = hostIds.find(key);
+    if (it != hostIds.end()) {
+        return it.value();
+    }
+    int id = hostNames.size();
+    hostIds.insert(key, id);
+    hostNames << QString::fromLocal8Bit(key);
+    hostIndex.resize(id + 1);
+    emit hostAdded(hostNames.last());
+    return id;
+}
+
+void LogBuffer::index(const Line &l, qint64 seq)
+{
+    typeIndex[l.type] << seq;
+    if (l.profile >= 0) {
+        profileIndex[l.profile] << seq;
+    }
+    if (l.host >= 0) {
+        hostIndex[l.host] << seq;
+    }
+}
+
+/*
+ * Index entries of dropped lines are skipped by the searches and only
+ * removed once as many lines were dropped as are kept, which keeps the
+ * cost per dropped line constant.
+ */
+void LogBuffer::compact()
+{
+    for (int i = 0; i < BackendEvent::TypeCount; ++i) {
+        QVector<qint64> &v = typeIndex[i];
+        v.erase(v.begin(), std::lower_bound(v.begin(), v.end(), m_first));
+    }
+    for (QVector<QVector<qint64> >::iterator it = profileIndex.begin(); it != profileIndex.end(); ++it) {
+        it->erase(it->begin(), std::lower_bound(it->begin(), it->end(), m_first));
+    }
+    for (QVector<QVector<qint64> >::iterator it = hostIndex.begin(); it != hostIndex.end(); ++it) {
+        it->erase(it->begin(), std::lower_bound(it->begin(), it->end(), m_first));
+    }
+    compacted = m_first;
+    pruneHosts();
+}
+
+/*
+ * Hosts left without index entries belong to dropped lines only. They are
+ * removed and the ids of the others close up, so a log of ever new hosts
+ * doesn't grow the host lists past the lines kept.
+ */
+void LogBuffer::pruneHosts()
+{
+    QVector<int> remap(hostIndex.size(), -1);
+    int kept = 0;
+    for (int i = 0; i < hostIndex.size(); ++i) {
+        if (!hostIndex.at(i).isEmpty()) {
+            remap[i] = kept++;
+        }
+    }
+    if (kept == hostIndex.size()) {
+        return;
+    }
+
+    QStringList names;
+    QVector<QVector<qint64> > index;
+    index.reserve(kept);
+    for (int i = 0; i < hostIndex.size(); ++i) {
+        if (remap.at(i) >= 0) {
+            names << hostNames.at(i);
+            index << hostIndex.at(i);
+        }
+    }
+    for (QHash<QByteArray, int>::iterator it = hostIds.begin(); it != hostIds.end();) {
+        if (remap.at(it.value()) < 0) {
+            it = hostIds.erase(it);
+        }
+        else {
+            it.value() = remap.at(it.value());
+            ++it;
+        }
+    }
+    hostNames = names;
+    hostIndex = index;
+    for (QList<Line>::iterator it = lines.begin(); it != lines.end(); ++it) {
+        if (it->host >= 0) {
+            it->host = remap.at(it->host);
+        }
+    }
+    emit hostsPruned();
+}
+
+/*
+ * Lines are removed from the front and appended at the back in one step
+ * each, so that the view only updates twice per flush. If the batch alone
+ * exceeds the limit, its own oldest lines are dropped first.
+ */
+void LogBuffer::flush()
+{
+    flushTimer.stop();
+    if (pending.isEmpty()) {
+        return;
+    }
+
+    QList<Line> batch;
+    Line line;
+    for (QList<Chunk>::iterator it = pending.begin(); it != pending.end(); ++it) {
+        line.time = it->time;
+        line.profile = it->profile.isEmpty() ? -1 : profileId(it->profile);
+        if (it->data.isNull()) {
+            QStringList parts = it->text.split('\n', QString::SkipEmptyParts);
+            for (QStringList::iterator l = parts.begin(); l != parts.end(); ++l) {
+                line.text = l->trimmed();
+                line.type = BackendEvent::Other;
+                line.host = -1;
+                if (!line.text.isEmpty()) {
+                    batch << line;
+                }
+            }
+            continue;
+        }
+        QString prefix;
+        if (it->showProfile && !it->profile.isEmpty()) {
+            prefix = QString("[%1] ").arg(it->profile);
+        }
+        QList<QByteArray> parts = it->data.split('\n');
+        for (int i = 0; i < parts.size(); ++i) {
+            QByteArray raw = parts.at(i).trimmed();
+            if (raw.isEmpty()) {
+                continue;
+            }
+            line.text = prefix + QString::fromLocal8Bit(raw);
+            line.type = BackendEvent::Other;
+            line.host = -1;
+            if (i < it->events.size()) {
+                const BackendEvent &e = it->events.at(i);
+                line.type = e.type;
+                if (!e.host.isEmpty()) {
+                    line.host = hostId(e.host);
+                }
+            }
+            batch << line;
+        }
+    }
+    pending.clear();
+    pendingBytes = 0;
+
+    qint64 added = 0;
+    for (QList<Line>::iterator it = batch.begin(); it != batch.end(); ++it) {
+        added += cost(it->text);
+    }
+    int skip = 0;
+    while (added > m_limit && skip < batch.size()) {
+        added -= cost(batch.at(skip++).text);
+    }
+
+    int evict = 0;
+    qint64 kept = m_bytes;
+    while (kept + added > m_limit && evict < lines.size()) {
+        kept -= cost(lines.at(evict++).text);
+    }
+    if (evict > 0) {
+        beginRemoveRows(QModelIndex(), 0, evict - 1);
+        lines.erase(lines.begin(), lines.begin() + evict);
+        m_first += evict;
+        m_bytes = kept;
+        endRemoveRows();
+    }
+    m_dropped += skip + evict;
+
+    if (skip < batch.size()) {
+        beginInsertRows(QModelIndex(), lines.size(), lines.size() + batch.size() - skip - 1);
+        for (int i = skip; i < batch.size(); ++i) {
+            index(batch.at(i), endSeq());
+            lines << batch.at(i);
+        }
+        m_bytes += added;
+        endInsertRows();
+    }
+    //after the batch is indexed, its new hosts would look unused before
+    if (m_first - compacted > lines.size()) {
+        compact();
+    }
+}
+
+//the first line at or after msecs, lines come in in order of time
+qint64 LogBuffer::seqAtTime(qint64 msecs) const
+{
+    int lo = 0;
+    int hi = lines.size();
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (lines.at(mid).time < msecs) {
+            lo = mid + 1;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return m_first + lo;
+}
+
+//false if no line can match
+bool LogBuffer::resolve(const Query &q, Match *m) const
+{
+    m->profile = -1;
+    if (!q.profile.isEmpty()) {
+        m->profile = profileIds.value(q.profile, -1);
+        if (m->profile < 0) {
+            return false;
+        }
+    }
+    m->hosts.clear();
+    if (!q.host.isEmpty()) {
+        bool any = false;
+        m->hosts.fill(false, hostNames.size());
+        for (int i = 0; i < hostNames.size(); ++i) {
+            if (hostNames.at(i).contains(q.host, Qt::CaseInsensitive)) {
+                m->hosts[i] = true;
+                any = true;
+            }
+        }
+        if (!any) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool LogBuffer::matches(const Line &l, const Query &q, const Match &m) const
+{
+    if (q.type >= 0 && l.type != q.type) {
+        return false;
+    }
+    if (m.profile >= 0 && l.profile != m.profile) {
+        return false;
+    }
+    if (!m.hosts.isEmpty() && (l.host < 0 || l.host >= m.hosts.size() || !m.hosts.at(l.host))) {
+        return false;
+    }
+    return q.text.isEmpty() || l.text.contains(q.text, Qt::CaseInsensitive);
+}
+
+/*
+ * The time range is a range of sequence numbers. Within it, only the
+ * lines listed under the query's type, profile or hosts are tested,
+ * whichever list is the shortest. Without any of those, every line in
+ * the range is.
+ */
+QVector<qint64> LogBuffer::find(const Query &q, qint64 seq) const
+{
+    QVector<qint64> result;
+    Match m;
+    if (!resolve(q, &m)) {
+        return result;
+    }
+    qint64 lo = qMax(seq, m_first);
+    qint64 hi = endSeq();
+    if (q.from.isValid()) {
+        lo = qMax(lo, seqAtTime(q.from.toMSecsSinceEpoch()));
+    }
+    if (q.to.isValid()) {
+        hi = qMin(hi, seqAtTime(q.to.toMSecsSinceEpoch() + 1));
+    }
+    if (lo >= hi) {
+        return result;
+    }
+
+    const QVector<qint64> *candidates = NULL;
+    if (q.type >= 0) {
+        candidates = &typeIndex[q.type];
+    }
+    if (m.profile >= 0 && (!candidates || profileIndex.at(m.profile).size() < candidates->size())) {
+        candidates = &profileIndex.at(m.profile);
+    }
+    QVector<qint64> hostLines;
+    if (!m.hosts.isEmpty()) {
+        int total = 0;
+        int matched = 0;
+        for (int i = 0; i < m.hosts.size(); ++i) {
+            if (m.hosts.at(i)) {
+                total += hostIndex.at(i).size();
+                ++matched;
+            }
+        }
+        if (!candidates || total < candidates->size()) {
+            hostLines.reserve(total);
+            for (int i = 0; i < m.hosts.size(); ++i) {
+                if (m.hosts.at(i)) {
+                    hostLines += hostIndex.at(i);
+                }
+            }
+            //a single host's list is in order already
+            if (matched > 1) {
+                std::sort(hostLines.begin(), hostLines.end());
+            }
+            candidates = &hostLines;
+        }
+    }
+
+    if (candidates) {
+        QVector<qint64>::const_iterator it = std::lower_bound(candidates->begin(), candidates->end(), lo);
+        for (; it != candidates->end() && *it < hi; ++it) {
+            if (matches(lines.at(static_cast<int>(*it - m_first)), q, m)) {
+                result << *it;
+            }
+        }
+    }
+    else {
+        for (qint64 s = lo; s < hi; ++s) {
+            if (matches(lines.at(static_cast<int>(s - m_first)), q, m)) {
+                result << s;
+            }
+        }
+    }
+    return result;
+}
+
+QVector<qint64> LogBuffer::refine(const QVector<qint64> &seqs, const Query &q) const
+{
+    QVector<qint64> result;
+    Match m;
+    if (!resolve(q, &m)) {
+        return result;
+    }
+    qint64 from = q.from.isValid() ? q.from.toMSecsSinceEpoch() : 0;
+    qint64 to = q.to.isValid() ? q.to.toMSecsSinceEpoch() : Q_INT64_C(0x7fffffffffffffff);
+    QVector<qint64>::const_iterator it = std::lower_bound(seqs.begin(), seqs.end(), m_first);
+    for (; it != seqs.end() && *it < endSeq(); ++it) {
+        const Line &l = lines.at(static_cast<int>(*it - m_first));
+        if (l.time >= from && l.time <= to && matches(l, q, m)) {
+            result << *it;
+        }
+    }
+    return result;
+}
+
+int LogBuffer::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : lines.size();
+}
+
+QVariant LogBuffer::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid()) {
+        return QVariant();
+    }
+    return dataAt(m_first + index.row(), role);
+}
+
+QVariant LogBuffer::dataAt(qint64 seq, int role) const
+{
+    if (seq < m_first || seq >= endSeq()) {
+        return QVariant();
+    }
+    const Line &l = lines.at(static_cast<int>(seq - m_first));
+    switch (role) {
+    case Qt::DisplayRole:
+        return l.text;
+    case TypeRole:
+        return static_cast<int>(l.type);
+    case TimeRole:
+        return QDateTime::fromMSecsSinceEpoch(l.time);
+    case ProfileRole:
+        return l.profile < 0 ? QString() : profileNames.at(l.profile);
+    case HostRole:
+        return l.host < 0 ? QString() : hostNames.at(l.host);
+    case Qt::ForegroundRole:
+        if (l.type == BackendEvent::Error || l.type == BackendEvent::Timeout) {
+            return QColor(255, 110, 110);
+        }
+        return QVariant();
+    default:
+        return QVariant();
+    }
+}
@@ -0,0 +1,149 @@
+/*
+ * Log Buffer Class
+ *
+ * Bounded ring of log lines, which is also the model of the log view.
+ * Backend output is queued as it arrives and decoded, split into lines
+ * and handed to the view in one batch per flush interval. Once the lines
+ * take more memory than the limit, the oldest ones are dropped. Each line
+ * keeps the event SS_Process parsed it as, lines aren't parsed again here.
+ *
+ * Every line also keeps its time, profile and destination host, and gets
+ * a sequence number that stays the same while the line is kept. Lists of
+ * sequence numbers per type, profile and host are updated as lines come
+ * in, so that a query only walks the lines of its rarest field. Hosts no
+ * kept line refers to anymore are forgotten when the lists are compacted.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef LOGBUFFER_H
+#define LOGBUFFER_H
+#include <QAbstractListModel>
+#include <QList>
+#include <QVector>
+#include <QHash>
+#include <QString>
+#include <QStringList>
+#include <QByteArray>
+#include <QDateTime>
+#include <QTimer>
+#include "logparser.h"
+
+class LogBuffer : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    enum Role {TypeRole = Qt::UserRole, TimeRole, ProfileRole, HostRole};
+
+    /*
+     * Lines that match every field set: type -1 and empty strings match
+     * anything, invalid times leave that end of the range open. host and
+     * text match case-insensitive parts of the host and of the line.
+     */
+    struct Query
+    {
+        Query() : type(-1) {}
+        int type;
+        QString profile;
+        QString host;
+        QDateTime from;
+        QDateTime to;
+        QString text;
+
+        inline bool isEmpty() const { return type < 0 && profile.isEmpty() && host.isEmpty() && !from.isValid() && !to.isValid() && text.isEmpty(); }
+        //every line this matches is matched by broader as well
+        bool refines(const Query &broader) const;
+    };
+
+    LogBuffer(QObject *parent = 0);
+
+    void setLimit(qint64 bytes);
+    inline qint64 limit() const { return m_limit; }
+    void setFlushInterval(int msec);
+    //events, if any, has one entry per line of chunk; showProfile prefixes the lines with the profile name
+    void append(const QByteArray &chunk, const QString &profile = QString(), const QVector<BackendEvent> &events = QVector<BackendEvent>(), bool showProfile = false);
+    void append(const QString &text);
+    void clear();
+    inline qint64 bytes() const { return m_bytes; }
+    //lines that were dropped to stay within the limit
+    inline quint64 dropped() const { return m_dropped; }
+
+    //sequence numbers of the lines kept, from firstSeq() up to but excluding endSeq()
+    inline qint64 firstSeq() const { return m_first; }
+    inline qint64 endSeq() const { return m_first + lines.size(); }
+    QVariant dataAt(qint64 seq, int role = Qt::DisplayRole) const;
+    //matching lines from seq on, in order
+    QVector<qint64> find(const Query &q, qint64 seq = 0) const;
+    //the lines of seqs still kept that match q
+    QVector<qint64> refine(const QVector<qint64> &seqs, const Query &q) const;
+    inline const QStringList &profiles() const { return profileNames; }
+    inline const QStringList &hosts() const { return hostNames; }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+public slots:
+    void flush();
+
+signals:
+    void profileAdded(const QString &name);
+    void hostAdded(const QString &host);
+    //hosts() lost the hosts of dropped lines
+    void hostsPruned();
+
+private:
+    struct Chunk
+    {
+        QString profile;
+        QByteArray data;
+        QString text;//already decoded if data is null
+        QVector<BackendEvent> events;
+        qint64 time;
+        bool showProfile;
+    };
+    struct Line
+    {
+        QString text;
+        qint64 time;//msecs since epoch
+        BackendEvent::Type type;
+        int profile;//index into profileNames, -1 for ss-qt5's own lines
+        int host;//index into hostNames, -1 if the line has none
+    };
+    //a query's profile and host resolved to indexes
+    struct Match
+    {
+        int profile;
+        QVector<bool> hosts;//empty if any host matches
+    };
+
+    QList<Line> lines;
+    QList<Chunk> pending;
+    qint64 m_limit;
+    qint64 m_bytes;
+    qint64 pendingBytes;
+    quint64 m_dropped;
+    QTimer flushTimer;
+
+    qint64 m_first;
+    qint64 compacted;//m_first when stale index entries were last removed
+    QVector<qint64> typeIndex[BackendEvent::TypeCount];
+    QVector<QVector<qint64> > profileIndex;
+    QVector<QVector<qint64> > hostIndex;
+    QHash<QString, int> profileIds;
+    QStringList profileNames;
+    QHash<QByteArray, int> hostIds;//keyed by the lower-cased host
+    QStringList hostNames;
+
+    static qint64 cost(const QString &line);
+    void enqueue(const Chunk &c, qint64 size);
+    int profileId(const QString &name);
+    int hostId(const QByteArray &host);
+    void index(const Line &l, qint64 seq);
+    void compact();
+    void pruneHosts();
+    qint64 seqAtTime(qint64 msecs) const;
+    bool resolve(const Query &q, Match *m) const;
+    bool matches(const Line &l, const Query &q, const Match &m) const;
+};
+
+#endif // LOGBUFFER_H
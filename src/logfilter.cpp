@@ -0,0 +1,68 @@
+#include <algorithm>
+#include "logfilter.h"
+
+LogFilter::LogFilter(LogBuffer *buffer, QObject *parent) :
+    QAbstractListModel(parent),
+    buffer(buffer)
+{
+    rows = buffer->find(m_query);
+    scanned = buffer->endSeq();
+    connect(buffer, &LogBuffer::rowsInserted, this, &LogFilter::onLinesInserted);
+    connect(buffer, &LogBuffer::rowsRemoved, this, &LogFilter::onLinesRemoved);
+    connect(buffer, &LogBuffer::modelReset, this, &LogFilter::onReset);
+}
+
+void LogFilter::setQuery(const LogBuffer::Query &q)
+{
+    QVector<qint64> found = q.refines(m_query) ? buffer->refine(rows, q) : buffer->find(q);
+    beginResetModel();
+    m_query = q;
+    rows = found;
+    scanned = buffer->endSeq();
+    endResetModel();
+}
+
+void LogFilter::onLinesInserted()
+{
+    QVector<qint64> found = buffer->find(m_query, scanned);
+    scanned = buffer->endSeq();
+    if (found.isEmpty()) {
+        return;
+    }
+    beginInsertRows(QModelIndex(), rows.size(), rows.size() + found.size() - 1);
+    rows += found;
+    endInsertRows();
+}
+
+//the buffer drops its oldest lines, which are the first rows here
+void LogFilter::onLinesRemoved()
+{
+    int gone = std::lower_bound(rows.begin(), rows.end(), buffer->firstSeq()) - rows.begin();
+    if (gone == 0) {
+        return;
+    }
+    beginRemoveRows(QModelIndex(), 0, gone - 1);
+    rows.remove(0, gone);
+    endRemoveRows();
+}
+
+void LogFilter::onReset()
+{
+    beginResetModel();
+    rows = buffer->find(m_query);
+    scanned = buffer->endSeq();
+    endResetModel();
+}
+
+int LogFilter::rowCount(const QModelIndex &parent) const
+{
+    return parent.isValid() ? 0 : rows.size();
+}
+
+QVariant LogFilter::data(const QModelIndex &index, int role) const
+{
+    if (!index.isValid() || index.row() >= rows.size()) {
+        return QVariant();
+    }
+    return buffer->dataAt(rows.at(index.row()), role);
+}
@@ -0,0 +1,43 @@
+/*
+ * Log Filter Class
+ *
+ * The lines of a LogBuffer that match a query, as the model of the log
+ * view. New lines are matched as the buffer flushes them and dropped
+ * lines leave the filter with it, the whole buffer is only searched when
+ * the query changes. A query that only narrows the previous one, such as
+ * a search text that got longer, just tests the lines shown already.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef LOGFILTER_H
+#define LOGFILTER_H
+#include <QAbstractListModel>
+#include <QVector>
+#include "logbuffer.h"
+
+class LogFilter : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    LogFilter(LogBuffer *buffer, QObject *parent = 0);
+
+    void setQuery(const LogBuffer::Query &q);
+    inline const LogBuffer::Query &query() const { return m_query; }
+
+    int rowCount(const QModelIndex &parent = QModelIndex()) const;
+    QVariant data(const QModelIndex &index, int role = Qt::DisplayRole) const;
+
+private:
+    LogBuffer *buffer;
+    LogBuffer::Query m_query;
+    QVector<qint64> rows;//sequence numbers of the matching lines
+    qint64 scanned;//lines before this sequence number were matched already
+
+private slots:
+    void onLinesInserted();
+    void onLinesRemoved();
+    void onReset();
+};
+
+#endif // LOGFILTER_H
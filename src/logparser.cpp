@@ -0,0 +1,168 @@
+#include "logparser.h"
+
+/*
+ * The phrases each backend logs. Timeouts are checked before errors,
+ * since backends log most timeouts as errors.
+ */
+static const char * const timeoutMarkers[] = {"timed out", "timeout:", "i/o timeout", "connection timeout", NULL};
+
+static const char * const libevConnect[] = {"connect to ", NULL};
+static const char * const libevError[] = {"error:", NULL};
+static const char * const libevUdp[] = {"udp assc", "udp associate", NULL};
+
+static const char * const pythonConnect[] = {"connecting ", NULL};
+static const char * const pythonError[] = {"error", "traceback", NULL};
+static const char * const pythonUdp[] = {"udp associate", NULL};
+
+//the Go backend doesn't relay UDP
+static const char * const goConnect[] = {"connected to ", "connecting to ", NULL};
+static const char * const goError[] = {"error", "failed", NULL};
+static const char * const goUdp[] = {NULL};
+
+static const char * const nodejsConnect[] = {"connecting ", NULL};
+static const char * const nodejsError[] = {"error", NULL};
+static const char * const nodejsUdp[] = {"udp assc", "udp associate", NULL};
+
+static const char * const qssConnect[] = {"connecting ", "connected to ", NULL};
+static const char * const qssError[] = {"error", NULL};
+static const char * const qssUdp[] = {"udp associate", NULL};
+
+static const char * const anyConnect[] = {"connect to ", "connecting ", "connected to ", NULL};
+static const char * const anyError[] = {"error", NULL};
+static const char * const anyUdp[] = {"udp assc", "udp associate", NULL};
+
+static QList<QByteArray> markerList(const char * const *markers)
+{
+    QList<QByteArray> l;
+    for (; *markers; ++markers) {
+        l << QByteArray(*markers);
+    }
+    return l;
+}
+
+LogParser::LogParser(const char * const *connect, const char * const *error, const char * const *udp) :
+    connectMarkers(markerList(connect)),
+    errorMarkers(markerList(error)),
+    udpMarkers(markerList(udp))
+{}
+
+const LogParser *LogParser::forBackend(SSProfile::BackendType type)
+{
+    static const LogParser libev(libevConnect, libevError, libevUdp);
+    static const LogParser python(pythonConnect, pythonError, pythonUdp);
+    static const LogParser go(goConnect, goError, goUdp);
+    static const LogParser nodejs(nodejsConnect, nodejsError, nodejsUdp);
+    static const LogParser qss(qssConnect, qssError, qssUdp);
+    static const LogParser any(anyConnect, anyError, anyUdp);
+
+    switch (type) {
+    case SSProfile::LIBEV:
+        return &libev;
+    case SSProfile::PYTHON:
+        return &python;
+    case SSProfile::GO:
+        return &go;
+    case SSProfile::NODEJS:
+        return &nodejs;
+    case SSProfile::LIBQSS:
+        return &qss;
+    default:
+        return &any;
+    }
+}
+
+const char *LogParser::typeName(BackendEvent::Type type)
+{
+    static const char * const names[] = {"other", "connect", "error", "timeout", "udp_associate"};
+    return names[type];
+}
+
+bool LogParser::containsAny(const QByteArray &line, const QList<QByteArray> &markers)
+{
+    for (QList<QByteArray>::const_iterator it = markers.begin(); it != markers.end(); ++it) {
+        if (line.contains(*it)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+/*
+ * The destination is the word after the marker, host:port or [v6]:port.
+ * The port is 0 if the word has none.
+ */
+bool LogParser::parseTarget(const QByteArray &line, int from, QByteArray *host, quint16 *port)
+{
+    while (from < line.size() && line.at(from) == ' ') {
+        ++from;
+    }
+    int end = from;
+    while (end < line.size() && line.at(end) != ' ' && line.at(end) != ',') {
+        ++end;
+    }
+    QByteArray word = line.mid(from, end - from);
+    if (word.isEmpty()) {
+        return false;
+    }
+
+    *port = 0;
+    int colon = word.lastIndexOf(':');
+    int bracket = word.lastIndexOf(']');
+    bool hasPort = bracket >= 0 ? colon == bracket + 1 : colon >= 0 && word.indexOf(':') == colon;
+    if (hasPort) {
+        bool ok;
+        quint16 p = word.mid(colon + 1).toUShort(&ok);
+        if (ok) {
+            *port = p;
+            word.truncate(colon);
+        }
+    }
+    if (word.startsWith('[') && word.endsWith(']')) {
+        word = word.mid(1, word.size() - 2);
+    }
+    *host = word;
+    return true;
+}
+
+BackendEvent LogParser::parse(const QByteArray &line) const
+{
+    BackendEvent e;
+    e.type = BackendEvent::Other;
+    e.port = 0;
+
+    static const QList<QByteArray> timeouts = markerList(timeoutMarkers);
+    QByteArray lower = line.toLower();
+    if (containsAny(lower, timeouts)) {
+        e.type = BackendEvent::Timeout;
+    }
+    else if (containsAny(lower, errorMarkers)) {
+        e.type = BackendEvent::Error;
+    }
+    else if (containsAny(lower, udpMarkers)) {
+        e.type = BackendEvent::UdpAssociate;
+    }
+    else {
+        for (QList<QByteArray>::const_iterator it = connectMarkers.begin(); it != connectMarkers.end(); ++it) {
+            int i = lower.indexOf(*it);
+            if (i >= 0 && parseTarget(line, i + it->size(), &e.host, &e.port)) {
+                e.type = BackendEvent::Connect;
+                break;
+            }
+        }
+    }
+    return e;
+}
+
+QVector<BackendEvent> LogParser::parseLines(const QByteArray &chunk) const
+{
+    QVector<BackendEvent> events;
+    QList<QByteArray> lines = chunk.split('\n');
+    if (chunk.endsWith('\n')) {
+        lines.removeLast();
+    }
+    events.reserve(lines.size());
+    for (QList<QByteArray>::const_iterator it = lines.begin(); it != lines.end(); ++it) {
+        events << parse(*it);
+    }
+    return events;
+}
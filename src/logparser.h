@@ -0,0 +1,52 @@
+/*
+ * Log Parser Class
+ *
+ * Turns lines of backend output into typed events: connections to a
+ * destination, errors, timeouts and UDP associations. Every backend words
+ * these differently, so there is one parser per backend type, each
+ * matching the fixed phrases its backend logs with plain substring
+ * searches.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef LOGPARSER_H
+#define LOGPARSER_H
+#include <QByteArray>
+#include <QList>
+#include <QVector>
+#include "ssprofile.h"
+
+struct BackendEvent
+{
+    enum Type {Other, Connect, Error, Timeout, UdpAssociate};
+    static const int TypeCount = UdpAssociate + 1;
+
+    Type type;
+    QByteArray host;//destination of Connect, empty otherwise
+    quint16 port;
+};
+
+class LogParser
+{
+public:
+    static const LogParser *forBackend(SSProfile::BackendType type);
+    static const char *typeName(BackendEvent::Type type);
+
+    BackendEvent parse(const QByteArray &line) const;
+    inline BackendEvent::Type classify(const QByteArray &line) const { return parse(line).type; }
+    //one event per line of chunk, as LogBuffer::append() takes them
+    QVector<BackendEvent> parseLines(const QByteArray &chunk) const;
+
+private:
+    LogParser(const char * const *connect, const char * const *error, const char * const *udp);
+
+    //lower case, matched against the lower-cased line
+    QList<QByteArray> connectMarkers;
+    QList<QByteArray> errorMarkers;
+    QList<QByteArray> udpMarkers;
+
+    static bool containsAny(const QByteArray &line, const QList<QByteArray> &markers);
+    static bool parseTarget(const QByteArray &line, int from, QByteArray *host, quint16 *port);
+};
+
+#endif // LOGPARSER_H
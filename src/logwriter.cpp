@@ -0,0 +1,273 @@
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <stdio.h>
+#include <zlib.h>
+#include "logwriter.h"
+
+//the log has server names and destinations, only its owner may read it
+static const QFileDevice::Permissions FILE_PERMISSIONS = QFileDevice::ReadOwner | QFileDevice::WriteOwner;
+//lines queued beyond this are dropped until the writer catches up
+static const qint64 MAX_PENDING = 8 << 20;
+//a burst this big is written right away rather than on the next tick
+static const qint64 WAKE_BYTES = 256 << 10;
+static const int FLUSH_INTERVAL = 1000;
+static const char * const TIME_FORMAT = "yyyy-MM-dd HH:mm:ss.zzz";
+static const int TIME_LENGTH = 23;
+static const int COMPRESS_CHUNK = 64 << 10;
+
+QMutex LogWriter::handlerMutex;
+LogWriter *LogWriter::handlerTarget = NULL;
+QtMessageHandler LogWriter::previousHandler = NULL;
+
+LogWriter::LogWriter(const QString &path, qint64 maxSize, int maxAge, int keep, bool compress, QObject *parent) :
+    QObject(parent),
+    pendingBytes(0),
+    droppedLines(0),
+    wakeQueued(false)
+{
+    file = new LogFile(this, path, maxSize, maxAge, keep, compress);
+    file->moveToThread(&thread);
+    connect(&thread, &QThread::started, file, &LogFile::start);
+    connect(&thread, &QThread::finished, file, &QObject::deleteLater);
+    connect(this, &LogWriter::wakeRequested, file, &LogFile::flush, Qt::QueuedConnection);
+    thread.setObjectName("log-writer");
+    thread.start(QThread::LowPriority);
+}
+
+//the LogFile writes out what is still queued when it's deleted
+LogWriter::~LogWriter()
+{
+    QMutexLocker locker(&handlerMutex);
+    if (handlerTarget == this) {
+        handlerTarget = NULL;
+        qInstallMessageHandler(previousHandler);
+    }
+    locker.unlock();
+    thread.quit();
+    thread.wait();
+}
+
+void LogWriter::append(const QString &source, const QByteArray &text)
+{
+    Entry e;
+    e.time = QDateTime::currentMSecsSinceEpoch();
+    e.source = source;
+    e.text = text;
+
+    QMutexLocker locker(&mutex);
+    if (pendingBytes + text.size() > MAX_PENDING) {
+        droppedLines += qMax(1, text.count('\n'));
+        return;
+    }
+    pending.append(e);
+    pendingBytes += text.size();
+    if (pendingBytes >= WAKE_BYTES && !wakeQueued) {
+        wakeQueued = true;
+        locker.unlock();
+        emit wakeRequested();
+    }
+}
+
+quint64 LogWriter::take(QList<Entry> *entries)
+{
+    QMutexLocker locker(&mutex);
+    entries->swap(pending);
+    pendingBytes = 0;
+    wakeQueued = false;
+    quint64 d = droppedLines;
+    droppedLines = 0;
+    return d;
+}
+
+void LogWriter::installMessageHandler()
+{
+    QMutexLocker locker(&handlerMutex);
+    if (handlerTarget == NULL) {
+        handlerTarget = this;
+        previousHandler = qInstallMessageHandler(messageHandler);
+    }
+}
+
+void LogWriter::debugToConsole(const QString &msg)
+{
+    toConsole(QtDebugMsg, QMessageLogContext(), msg);
+}
+
+void LogWriter::messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    QMutexLocker locker(&handlerMutex);
+    if (handlerTarget) {
+        handlerTarget->append(QStringLiteral("ss-qt5"), msg.toUtf8());
+    }
+    locker.unlock();
+    toConsole(type, context, msg);
+}
+
+void LogWriter::toConsole(QtMsgType type, const QMessageLogContext &context, const QString &msg)
+{
+    if (previousHandler) {
+        previousHandler(type, context, msg);
+    }
+    else {
+        fprintf(stderr, "%s\n", qPrintable(qFormatLogMessage(type, context, msg)));
+        fflush(stderr);
+    }
+}
+
+LogFile::LogFile(LogWriter *writer, const QString &path, qint64 maxSize, int maxAge, int keep, bool compress) :
+    writer(writer),
+    path(path),
+    maxSize(maxSize),
+    maxAge(maxAge),
+    keep(keep),
+    compress(compress),
+    size(0),
+    timer(NULL)
+{}
+
+LogFile::~LogFile()
+{
+    flush();
+}
+
+void LogFile::start()
+{
+    open();
+    timer = new QTimer(this);
+    connect(timer, &QTimer::timeout, this, &LogFile::flush);
+    timer->start(FLUSH_INTERVAL);
+}
+
+/*
+ * A file that already has lines carries its start time in the timestamp
+ * of the first one, so the age limit holds across restarts.
+ */
+void LogFile::open()
+{
+    QDir().mkpath(QFileInfo(path).absolutePath());
+    file.setFileName(path);
+    started = QDateTime::currentDateTime();
+    if (file.open(QIODevice::ReadOnly)) {
+        QDateTime first = QDateTime::fromString(QString::fromLatin1(file.read(TIME_LENGTH)), TIME_FORMAT);
+        if (first.isValid()) {
+            started = first;
+        }
+        file.close();
+    }
+    if (!file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+        qWarning() << "Can't write log file" << path << file.errorString();
+        return;
+    }
+    file.setPermissions(FILE_PERMISSIONS);
+    size = file.size();
+}
+
+void LogFile::flush()
+{
+    QList<LogWriter::Entry> entries;
+    quint64 dropped = writer->take(&entries);
+    if (!file.isOpen() || (entries.isEmpty() && dropped == 0)) {
+        return;
+    }
+
+    QByteArray batch;
+    if (dropped > 0) {
+        batch += QDateTime::currentDateTime().toString(TIME_FORMAT).toLatin1();
+        batch += " [ss-qt5] " + QByteArray::number(dropped) + " lines dropped, the log file couldn't keep up\n";
+    }
+    for (QList<LogWriter::Entry>::const_iterator it = entries.begin(); it != entries.end(); ++it) {
+        QByteArray stamp = QDateTime::fromMSecsSinceEpoch(it->time).toString(TIME_FORMAT).toLatin1() + " [" + it->source.toUtf8() + "] ";
+        QList<QByteArray> lines = it->text.split('\n');
+        for (QList<QByteArray>::iterator l = lines.begin(); l != lines.end(); ++l) {
+            if (l->endsWith('\r')) {
+                l->chop(1);
+            }
+            if (!l->trimmed().isEmpty()) {
+                batch += stamp + *l + '\n';
+            }
+        }
+    }
+    if (batch.isEmpty()) {
+        return;
+    }
+
+    bool tooBig = maxSize > 0 && size > 0 && size + batch.size() > maxSize;
+    bool tooOld = maxAge > 0 && size > 0 && started.secsTo(QDateTime::currentDateTime()) >= maxAge;
+    if (tooBig || tooOld) {
+        rotate();
+        if (!file.isOpen()) {
+            return;
+        }
+    }
+    if (size == 0) {
+        started = QDateTime::currentDateTime();
+    }
+    file.write(batch);
+    file.flush();
+    size += batch.size();
+}
+
+QString LogFile::rotatedName(int i, bool gz) const
+{
+    return QString("%1.%2%3").arg(path).arg(i).arg(gz ? ".gz" : "");
+}
+
+//ss-qt5.log becomes ss-qt5.log.1, ss-qt5.log.1 becomes ss-qt5.log.2 and so on
+void LogFile::rotate()
+{
+    file.close();
+    if (keep > 0) {
+        QFile::remove(rotatedName(keep, false));
+        QFile::remove(rotatedName(keep, true));
+        for (int i = keep - 1; i >= 1; --i) {
+            QFile::rename(rotatedName(i, false), rotatedName(i + 1, false));
+            QFile::rename(rotatedName(i, true), rotatedName(i + 1, true));
+        }
+        QFile::rename(path, rotatedName(1, false));
+        if (compress) {
+            compressFile(rotatedName(1, false));
+        }
+    }
+    else {
+        QFile::remove(path);
+    }
+    open();
+}
+
+/*
+ * Streamed through zlib in chunks, so a big log isn't read into memory.
+ * The .gz file is created first to give it the log's permissions.
+ */
+void LogFile::compressFile(const QString &name)
+{
+    QFile in(name);
+    if (!in.open(QIODevice::ReadOnly) || in.size() == 0) {
+        return;
+    }
+    QFile out(name + ".gz");
+    if (!out.open(QIODevice::WriteOnly | QIODevice::Truncate) || !out.setPermissions(FILE_PERMISSIONS)) {
+        out.remove();
+        return;
+    }
+    out.close();
+
+    gzFile gz = gzopen(QFile::encodeName(out.fileName()).constData(), "wb6");
+    bool ok = gz != NULL;
+    QByteArray chunk(COMPRESS_CHUNK, Qt::Uninitialized);
+    while (ok && !in.atEnd()) {
+        qint64 n = in.read(chunk.data(), chunk.size());
+        ok = n >= 0 && gzwrite(gz, chunk.constData(), static_cast<unsigned>(n)) == n;
+    }
+    if (gz != NULL && gzclose(gz) != Z_OK) {
+        ok = false;
+    }
+    if (ok) {
+        in.remove();
+    }
+    else {
+        qWarning() << "Can't compress log file" << name;
+        out.remove();
+    }
+}
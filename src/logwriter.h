@@ -0,0 +1,111 @@
+/*
+ * Log Writer Class
+ *
+ * Optional on-disk copy of the backend output and of ss-qt5's own
+ * messages. Callers only queue the lines under a short lock, from any
+ * thread. A LogFile on the writer's own thread timestamps them and
+ * writes them in batches, once a second or as soon as a burst has
+ * queued enough. The file is rotated once it gets too big or too old
+ * and the rotated files may be gzipped.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef LOGWRITER_H
+#define LOGWRITER_H
+#include <QObject>
+#include <QThread>
+#include <QMutex>
+#include <QFile>
+#include <QTimer>
+#include <QDateTime>
+#include <QList>
+#include <QByteArray>
+#include <QString>
+
+class LogFile;
+
+class LogWriter : public QObject
+{
+    Q_OBJECT
+
+public:
+    /*
+     * maxSize in bytes and maxAge in seconds, either 0 for no limit.
+     * keep is the number of rotated files kept next to the log.
+     */
+    LogWriter(const QString &path, qint64 maxSize, int maxAge, int keep, bool compress, QObject *parent = 0);
+    ~LogWriter();
+
+    //thread-safe
+    void append(const QString &source, const QByteArray &text);
+
+    //copies qDebug and qWarning output of the whole application to the file
+    void installMessageHandler();
+    //debug output that skips the file, for lines appended to it already
+    static void debugToConsole(const QString &msg);
+
+signals:
+    void wakeRequested();
+
+private:
+    friend class LogFile;
+
+    struct Entry
+    {
+        qint64 time;//msecs since epoch
+        QString source;
+        QByteArray text;
+    };
+
+    QThread thread;
+    LogFile *file;
+    QMutex mutex;
+    QList<Entry> pending;//guarded by mutex
+    qint64 pendingBytes;
+    quint64 droppedLines;
+    bool wakeQueued;
+
+    quint64 take(QList<Entry> *entries);//returns lines dropped since the last take
+
+    //held while a message is appended, so the writer can't go away in the middle
+    static QMutex handlerMutex;
+    static LogWriter *handlerTarget;//guarded by handlerMutex
+    static QtMessageHandler previousHandler;
+    static void messageHandler(QtMsgType type, const QMessageLogContext &context, const QString &msg);
+    static void toConsole(QtMsgType type, const QMessageLogContext &context, const QString &msg);
+};
+
+/*
+ * Lives on the thread of its LogWriter, nothing else touches the file.
+ */
+class LogFile : public QObject
+{
+    Q_OBJECT
+
+public:
+    LogFile(LogWriter *writer, const QString &path, qint64 maxSize, int maxAge, int keep, bool compress);
+    ~LogFile();
+
+public slots:
+    void start();
+    void flush();
+
+private:
+    LogWriter *writer;
+    QString path;
+    qint64 maxSize;
+    int maxAge;
+    int keep;
+    bool compress;
+    QFile file;
+    qint64 size;
+    QDateTime started;//time of the first line in the file
+    QTimer *timer;
+
+    void open();
+    void rotate();
+    void compressFile(const QString &name);
+    QString rotatedName(int i, bool gz) const;
+};
+
+#endif // LOGWRITER_H
@@ -1,10 +1,15 @@
 #include "mainwindow.h"
 #include "ss_process.h"
+#include "cipherbenchmark.h"
+#include "daemon.h"
 #include <QApplication>
 #include <QTranslator>
 #include <QLibraryInfo>
 #include <QLocale>
 #include <QSharedMemory>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QDebug>
 #include <signal.h>
 
 static void onSIGINT_TERM(int sig)
@@ -14,6 +19,27 @@ static void onSIGINT_TERM(int sig)
 
 int main(int argc, char *argv[])
 {
+    QElapsedTimer launchClock;
+    launchClock.start();
+
+    //the Benchmark button runs this in a child process
+    if (CipherBenchmark::isRequested(argc, argv)) {
+        QCoreApplication b(argc, argv);
+        return CipherBenchmark::run();
+    }
+
+    //no QApplication, hence no display connection and no widget at all
+    if (Daemon::isRequested(argc, argv)) {
+        QCoreApplication d(argc, argv);
+        d.setApplicationName(QString("shadowsocks-qt5"));
+        d.setApplicationVersion(APP_VERSION);
+        Daemon daemon(launchClock);
+        if (!daemon.start(d.arguments())) {
+            return 1;
+        }
+        return d.exec();
+    }
+
     QApplication a(argc, argv);
 
     signal(SIGINT, onSIGINT_TERM);
@@ -55,5 +81,12 @@ int main(int argc, char *argv[])
         w.show();
     }
 
+    if (a.arguments().contains("-v")) {
+        //the first event loop pass, after the window has been shown
+        QTimer::singleShot(0, [&launchClock] {
+            qDebug() << "Initialised in" << launchClock.elapsed() << "ms, RSS" << Daemon::residentSetSize() << "KiB";
+        });
+    }
+
     return a.exec();
 }
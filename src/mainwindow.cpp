@@ -1,9 +1,21 @@
 #include <QMenu>
 #include <QDebug>
 #include <QWindow>
+#include <QTimer>
+#include <QFileInfo>
+#include <QProcess>
+#include <QRegularExpression>
+#include <QScrollBar>
+#include <QClipboard>
+#include <QCompleter>
+#include <QStringListModel>
+#include <algorithm>
+#include <limits>
 #include "mainwindow.h"
 #include "ui_mainwindow.h"
 #include "sharedialogue.h"
+#include "backendregistry.h"
+#include "hostresolver.h"
 
 #ifdef Q_OS_WIN
 #include <QtWin>
@@ -23,20 +35,47 @@ MainWindow::MainWindow(bool verbose, QWidget *parent) :
 
     //initialisation
     verboseOutput = verbose;
+    guiMonitor = NULL;
+    fileLog = NULL;
+    metrics = NULL;
+    benchmarkProc = NULL;
+    latencyTester = new LatencyTester(this);
+    fastest = new FastestSelector(this);
+    logs = new LogBuffer(this);
+    logFilter = new LogFilter(logs, this);
+    logFollow = true;
+    jsonconfigFile = Configuration::defaultFile();
+    BackendRegistry::instance()->setCacheFile(QFileInfo(jsonconfigFile).absolutePath() + "/backend-cache.json");
+    m_conf = new Configuration(jsonconfigFile);
+    backends = new BackendManager(this);
+    backends->setRestartPolicy(m_conf->isAutoRestart(), m_conf->getRestartDelay(), m_conf->getRestartMaxDelay(), m_conf->getRestartLimit());
+    backends->setDrainPolicy(m_conf->isGracefulDrain(), m_conf->getDrainDeadline());
+    backends->setFailoverPolicy(m_conf->getHealthCheckInterval(), m_conf->getHealthCheckFailures(), m_conf->getFailbackInterval(), m_conf->getHealthCheckTarget());
+    backends->setHedging(m_conf->getHedgeBudget());
+    logs->setLimit(qint64(m_conf->getLogBufferSize()) << 20);
+    OutputReader::setPolicy(OutputReader::policyFromName(m_conf->getLogOverflow()));
+    HostResolver::instance()->setTtl(m_conf->getDnsCacheTtl());
+    HostResolver::instance()->prefetch(m_conf->serverHosts());
+    if (m_conf->isLogFile()) {
+        fileLog = new LogWriter(QFileInfo(jsonconfigFile).absolutePath() + "/ss-qt5.log", qint64(m_conf->getLogFileSize()) << 20, m_conf->getLogFileAge() * 3600, m_conf->getLogFileCount(), m_conf->isLogFileCompress(), this);
+        fileLog->installMessageHandler();
+    }
+
+    if (verboseOutput || m_conf->getMetricsPort() > 0) {
+        //compare GUI thread latency with the latency of libQtShadowsocks worker threads
+        guiMonitor = new EventLoopMonitor(100, this);
+        guiMonitor->start();
+    }
     if (verboseOutput) {
         qDebug() << "Verbose Enabled.";
+        QTimer *lagReportTimer = new QTimer(this);
+        connect(lagReportTimer, &QTimer::timeout, this, &MainWindow::reportEventLoopLag);
+        lagReportTimer->start(10000);
     }
-#ifdef Q_OS_WIN
-    jsonconfigFile = QCoreApplication::applicationDirPath() + "/gui-config.json";
-#else
-    QDir ssConfigDir = QDir::homePath() + "/.config/shadowsocks";
-    jsonconfigFile = ssConfigDir.absolutePath() + "/gui-config.json";
-    if (!ssConfigDir.exists()) {
-        ssConfigDir.mkpath(ssConfigDir.absolutePath());
+    if (m_conf->getMetricsPort() > 0) {
+        metrics = new MetricsServer(backends, guiMonitor, this);
+        metrics->listen(static_cast<quint16>(m_conf->getMetricsPort()));
     }
-#endif
-    m_conf = new Configuration(jsonconfigFile);
-    ssProcess = new SS_Process(this);
 
     ui->laddrEdit->setValidator(&ipv4addrValidator);
     ui->lportEdit->setValidator(&portValidator);
@@ -44,10 +83,38 @@ MainWindow::MainWindow(bool verbose, QWidget *parent) :
     ui->profileComboBox->addItems(m_conf->getProfileList());
     ui->sportEdit->setValidator(&portValidator);
     ui->stopButton->setEnabled(false);
+    ui->logView->setModel(logFilter);
+    ui->logLevelCombo->addItem(tr("All Lines"), -1);
+    ui->logLevelCombo->addItem(tr("Connections"), BackendEvent::Connect);
+    ui->logLevelCombo->addItem(tr("Errors"), BackendEvent::Error);
+    ui->logLevelCombo->addItem(tr("Timeouts"), BackendEvent::Timeout);
+    ui->logLevelCombo->addItem(tr("UDP"), BackendEvent::UdpAssociate);
+    ui->logLevelCombo->addItem(tr("Other"), BackendEvent::Other);
+    ui->logProfileCombo->addItem(tr("All Profiles"));
+    ui->logTimeCombo->addItem(tr("Any Time"), 0);
+    ui->logTimeCombo->addItem(tr("Last 5 Minutes"), 300);
+    ui->logTimeCombo->addItem(tr("Last Hour"), 3600);
+    ui->logTimeCombo->addItem(tr("Last Day"), 86400);
+    QStringListModel *logHosts = new QStringListModel(this);
+    QCompleter *hostCompleter = new QCompleter(logHosts, this);
+    hostCompleter->setCaseSensitivity(Qt::CaseInsensitive);
+    hostCompleter->setFilterMode(Qt::MatchContains);
+    ui->logHostEdit->setCompleter(hostCompleter);
+    QAction *copyLog = new QAction(tr("Copy"), ui->logView);
+    copyLog->setShortcut(QKeySequence::Copy);
+    ui->logView->addAction(copyLog);
+    connect(copyLog, &QAction::triggered, this, &MainWindow::copyLogSelection);
 
     ui->autohideCheck->setChecked(m_conf->isAutoHide());
+    ui->autoRestartCheck->setChecked(m_conf->isAutoRestart());
     ui->autostartCheck->setChecked(m_conf->isAutoStart());
     ui->debugCheck->setChecked(m_conf->isDebug());
+    ui->hotStandbyCheck->setChecked(m_conf->isHotStandby());
+    ui->gracefulDrainCheck->setChecked(m_conf->isGracefulDrain());
+    ui->pickFastestCheck->setChecked(m_conf->isPickFastest());
+    ui->failoverCheck->setChecked(m_conf->isFailover());
+    ui->loadBalanceCheck->setChecked(m_conf->isLoadBalance());
+    ui->balancePolicyCombo->setCurrentIndex(LoadBalancer::policyFromName(m_conf->getBalancePolicy()));
 #ifdef Q_OS_LINUX
     ui->translucentCheck->setVisible(false);
 #else
@@ -80,9 +147,38 @@ MainWindow::MainWindow(bool verbose, QWidget *parent) :
     /*
      * SIGNALs and SLOTs
      */
-    connect(ssProcess, &SS_Process::processRead, this, &MainWindow::onProcessReadyRead);
-    connect(ssProcess, &SS_Process::processStarted, this, &MainWindow::onProcessStarted);
-    connect(ssProcess, &SS_Process::processStopped, this, &MainWindow::onProcessStopped);
+    connect(backends, &BackendManager::processRead, this, &MainWindow::onProcessReadyRead);
+    connect(backends, &BackendManager::processStarted, this, &MainWindow::onProcessStarted);
+    connect(backends, &BackendManager::processStopped, this, &MainWindow::onProcessStopped);
+    connect(backends, &BackendManager::stateChanged, this, &MainWindow::onProcessStateChanged);
+    connect(backends, &BackendManager::statsUpdated, this, &MainWindow::updateStatsTable);
+    connect(ui->tabWidget, &QTabWidget::currentChanged, this, &MainWindow::updateStatsTable);
+    //keeps following new lines, unless the user scrolled up
+    connect(logFilter, &LogFilter::rowsAboutToBeInserted, this, [this] {
+        QScrollBar *bar = ui->logView->verticalScrollBar();
+        logFollow = bar->value() == bar->maximum();
+    });
+    connect(logFilter, &LogFilter::rowsInserted, this, [this] {
+        if (logFollow) {
+            ui->logView->scrollToBottom();
+        }
+    });
+    connect(logs, &LogBuffer::profileAdded, this, [this](const QString &name) {
+        ui->logProfileCombo->addItem(name, name);
+    });
+    connect(logs, &LogBuffer::hostAdded, logHosts, [logHosts](const QString &host) {
+        int row = logHosts->rowCount();
+        logHosts->insertRow(row);
+        logHosts->setData(logHosts->index(row), host);
+    });
+    connect(logs, &LogBuffer::hostsPruned, logHosts, [this, logHosts] {
+        logHosts->setStringList(logs->hosts());
+    });
+    connect(ui->logLevelCombo, SIGNAL(currentIndexChanged(int)), this, SLOT(applyLogFilter()));
+    connect(ui->logProfileCombo, SIGNAL(currentIndexChanged(int)), this, SLOT(applyLogFilter()));
+    connect(ui->logTimeCombo, SIGNAL(currentIndexChanged(int)), this, SLOT(applyLogFilter()));
+    connect(ui->logHostEdit, &QLineEdit::textChanged, this, &MainWindow::applyLogFilter);
+    connect(ui->logSearchEdit, &QLineEdit::textChanged, this, &MainWindow::applyLogFilter);
 
     connect(ui->backendToolButton, &QToolButton::clicked, this, &MainWindow::onBackendToolButtonPressed);
 
@@ -106,10 +202,22 @@ MainWindow::MainWindow(bool verbose, QWidget *parent) :
     connect(ui->laddrEdit, &QLineEdit::textChanged, this, &MainWindow::onLAddrEditFinished);
     connect(ui->lportEdit, &QLineEdit::textChanged, this, &MainWindow::onLPortEditFinished);
     connect(ui->methodComboBox, &QComboBox::currentTextChanged, this, &MainWindow::onMethodChanged);
+    connect(ui->benchmarkButton, &QToolButton::clicked, this, &MainWindow::onBenchmarkButtonClicked);
+
+    QMenu *latencyMenu = new QMenu(this);
+    connect(latencyMenu->addAction(tr("Test latency")), &QAction::triggered, this, [this] { testLatency(false); });
+    connect(latencyMenu->addAction(tr("Test latency with handshake")), &QAction::triggered, this, [this] { testLatency(true); });
+    connect(latencyMenu->addAction(tr("Sort profiles by latency")), &QAction::triggered, this, &MainWindow::sortProfilesByLatency);
+    ui->latencyButton->setMenu(latencyMenu);
+    connect(latencyTester, &LatencyTester::result, this, &MainWindow::onLatencyResult);
+    connect(latencyTester, &LatencyTester::finished, this, &MainWindow::onLatencyFinished);
+    connect(fastest, &FastestSelector::selected, this, &MainWindow::onFastestSelected);
+    connect(fastest, &FastestSelector::info, this, &MainWindow::onFastestInfo);
     connect(ui->pwdEdit, &QLineEdit::textChanged, this, &MainWindow::onPasswordEditFinished);
     connect(ui->serverEdit, &QLineEdit::textChanged, this, &MainWindow::onServerEditFinished);
     connect(ui->sportEdit, &QLineEdit::textChanged, this, &MainWindow::onSPortEditFinished);
     connect(ui->timeoutSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &MainWindow::onTimeoutChanged);
+    connect(ui->workersSpinBox, static_cast<void (QSpinBox::*)(int)>(&QSpinBox::valueChanged), this, &MainWindow::onWorkersChanged);
 #ifdef Q_OS_LINUX
     connect(ui->tfoCheckBox, &QCheckBox::toggled, this, &MainWindow::onTcpFastOpenChanged);
 #endif
@@ -117,8 +225,15 @@ MainWindow::MainWindow(bool verbose, QWidget *parent) :
     connect(ui->profileSaveButton, &QPushButton::clicked, this, &MainWindow::onProfileSaveClicked);
 
     connect(ui->autohideCheck, &QCheckBox::stateChanged, this, &MainWindow::onAutoHideToggled);
+    connect(ui->autoRestartCheck, &QCheckBox::toggled, this, &MainWindow::onAutoRestartToggled);
     connect(ui->autostartCheck, &QCheckBox::stateChanged, this, &MainWindow::onAutoStartToggled);
     connect(ui->debugCheck, &QCheckBox::stateChanged, this, &MainWindow::onDebugToggled);
+    connect(ui->hotStandbyCheck, &QCheckBox::toggled, this, &MainWindow::onHotStandbyToggled);
+    connect(ui->gracefulDrainCheck, &QCheckBox::toggled, this, &MainWindow::onGracefulDrainToggled);
+    connect(ui->pickFastestCheck, &QCheckBox::toggled, this, &MainWindow::onPickFastestToggled);
+    connect(ui->failoverCheck, &QCheckBox::toggled, this, &MainWindow::onFailoverToggled);
+    connect(ui->loadBalanceCheck, &QCheckBox::toggled, this, &MainWindow::onLoadBalanceToggled);
+    connect(ui->balancePolicyCombo, static_cast<void (QComboBox::*)(int)>(&QComboBox::currentIndexChanged), this, &MainWindow::onBalancePolicyChanged);
     connect(ui->translucentCheck, &QCheckBox::toggled, this, &MainWindow::onTransculentToggled);
     connect(ui->relativePathCheck, &QCheckBox::toggled, this, &MainWindow::onRelativePathToggled);
     connect(ui->useSystrayCheck, &QCheckBox::toggled, this, &MainWindow::onUseSystrayToggled);
@@ -142,9 +257,9 @@ MainWindow::MainWindow(bool verbose, QWidget *parent) :
 
 MainWindow::~MainWindow()
 {
-    if (ui->stopButton->isEnabled()) {//stop if it's still running
-        ssProcess->stop();//prevent crashes
-    }
+    backends->shutdown();//stop all running profiles to prevent crashes
+    //the backends are deleted after ui, with our other children
+    backends->disconnect(this);
     delete ui;
     delete m_conf;
 }
@@ -177,7 +292,6 @@ void MainWindow::onCurrentProfileChanged(int i)
      */
     blockChildrenSignals(true);
 
-    ssProcess->stop();//Q: should we stop the backend when profile changed?
     if(i != m_conf->getIndex()) {
         emit configurationChanged();
     }
@@ -202,9 +316,11 @@ void MainWindow::onCurrentProfileChanged(int i)
     ui->serverEdit->setText(current_profile->server);
     ui->sportEdit->setText(current_profile->server_port);
     ui->timeoutSpinBox->setValue(current_profile->timeout.toInt());
+    ui->workersSpinBox->setValue(current_profile->workers);
 #ifdef Q_OS_LINUX
     ui->tfoCheckBox->setChecked(current_profile->fast_open);
 #endif
+    updateRunningState();
 
     blockChildrenSignals(false);
 }
@@ -275,6 +391,15 @@ void MainWindow::minimizeToSysTray()
 
 void MainWindow::onProfileResetClicked()
 {
+    //profiles read from the file survive revert(), only the unsaved ones go away
+    QList<SSProfile *> unsaved = m_conf->unsavedProfiles();
+    for (QList<SSProfile *>::iterator it = unsaved.begin(); it != unsaved.end(); ++it) {
+        backends->remove(*it);
+    }
+    latencyTester->abort();
+    fastest->stop();
+    connectLatency.clear();
+    handshakeLatency.clear();
     m_conf->revert();
     this->blockChildrenSignals(true);
     ui->profileComboBox->clear();
@@ -291,13 +416,114 @@ void MainWindow::onProfileSaveClicked()
 }
 
 void MainWindow::onStartButtonPressed()
+{
+    if (!m_conf->isPickFastest()) {
+        startCurrentProfile();
+        return;
+    }
+
+    QList<SSProfile *> candidates;
+    for (int i = 0; i < m_conf->count(); ++i) {
+        SSProfile *p = m_conf->profileAt(i);
+        if (p->isValid() && (m_conf->getFastestGroup().isEmpty() || p->group == m_conf->getFastestGroup())) {
+            candidates << p;
+        }
+    }
+    if (candidates.isEmpty()) {
+        QMessageBox::critical(this, tr("Error"), tr("No valid profile in group %1.").arg(m_conf->getFastestGroup()));
+        return;
+    }
+    logs->append(tr("Testing latency of %1 profiles to pick the fastest...").arg(candidates.size()));
+    fastest->setPolicy(m_conf->getFastestInterval(), m_conf->getFastestThreshold(), m_conf->isFastestHandshake());
+    fastest->start(candidates);
+}
+
+void MainWindow::onStopButtonPressed()
+{
+    if (fastest->current() == current_profile) {
+        fastest->stop();
+    }
+    backends->stop(current_profile);
+}
+
+/*
+ * Switches the UI to the selected profile and starts it. The previous
+ * pick is stopped afterwards, drained first if graceful drain is on.
+ */
+void MainWindow::onFastestSelected(SSProfile *best, SSProfile *previous)
+{
+    for (int i = 0; i < m_conf->count(); ++i) {
+        if (m_conf->profileAt(i) == best) {
+            ui->profileComboBox->setCurrentIndex(i);
+            break;
+        }
+    }
+    if (!backends->isRunning(best)) {
+        startCurrentProfile();
+    }
+    if (previous && previous != best && backends->isRunning(previous)) {
+        backends->stop(previous);
+    }
+}
+
+void MainWindow::onFastestInfo(const QString &msg)
+{
+    logs->append(msg);
+}
+
+void MainWindow::startCurrentProfile()
 {
     if (!current_profile->isValid()) {
         QMessageBox::critical(this, tr("Error"), tr("Invalid profile or configuration."));
         return;
     }
 
-    ssProcess->start(current_profile, m_conf->isDebug());
+    //a fresh start the user asked for, restarts and switch-overs keep what led to them
+    if (backends->runningCount() == 0) {//don't wipe logs of other running profiles
+        logs->clear();
+    }
+
+    if (m_conf->isLoadBalance()) {
+        QList<SSProfile *> pool = m_conf->balancePoolFor(current_profile);
+        if (pool.size() > 1) {
+            if (!backends->startBalanced(pool, LoadBalancer::policyFromName(m_conf->getBalancePolicy()), m_conf->isDebug())) {
+                SSProfile *other = backends->conflictingProfile(current_profile);
+                QMessageBox::critical(this, tr("Error"), tr("Local port %1 is already used by running profile %2.").arg(current_profile->local_port).arg(other ? other->profileName : QString()));
+            }
+            return;
+        }
+    }
+    if (m_conf->isFailover()) {
+        QList<SSProfile *> chain = m_conf->failoverChainFor(current_profile);
+        if (chain.size() > 1) {
+            if (!backends->startWithFailover(chain, m_conf->isDebug())) {
+                SSProfile *other = backends->conflictingProfile(current_profile);
+                QMessageBox::critical(this, tr("Error"), tr("Local port %1 is already used by running profile %2.").arg(current_profile->local_port).arg(other ? other->profileName : QString()));
+            }
+            return;
+        }
+    }
+
+    /*
+     * In hot standby mode the next valid profile is pre-started on a spare port,
+     * unless this profile is itself the standby, in which case start() switches over.
+     */
+    SSProfile *standby = NULL;
+    if (m_conf->isHotStandby() && !backends->isStandby(current_profile)) {
+        for (int i = 1; i < m_conf->count(); ++i) {
+            SSProfile *p = m_conf->profileAt((m_conf->getIndex() + i) % m_conf->count());
+            if (p->isValid() && !backends->isRunning(p)) {
+                standby = p;
+                break;
+            }
+        }
+    }
+
+    bool started = standby ? backends->startWithStandby(current_profile, standby, m_conf->isDebug()) : backends->start(current_profile, m_conf->isDebug());
+    if (!started) {
+        SSProfile *other = backends->conflictingProfile(current_profile);
+        QMessageBox::critical(this, tr("Error"), tr("Local port %1 is already used by running profile %2.").arg(current_profile->local_port).arg(other ? other->profileName : QString()));
+    }
 }
 
 #ifdef UBUNTU_UNITY
@@ -349,15 +575,6 @@ void MainWindow::createSystemTray()
         systrayMenu->addAction(QIcon::fromTheme("exit"), tr("Quit"), this, SLOT(close()));
         systrayMenu->actions().at(2)->setVisible(false);
 
-        connect(ssProcess, &SS_Process::processStarted, [&]{
-            systrayMenu->actions().at(1)->setVisible(false);
-            systrayMenu->actions().at(2)->setVisible(true);
-        });
-        connect(ssProcess, &SS_Process::processStopped, [&]{
-            systrayMenu->actions().at(1)->setVisible(true);
-            systrayMenu->actions().at(2)->setVisible(false);
-        });
-
         systray = new QSystemTrayIcon(QIcon(":/icon/shadowsocks-qt5.png"), this);
         systray->setToolTip(QString("Shadowsocks-Qt5"));
         systray->setContextMenu(systrayMenu);
@@ -384,29 +601,79 @@ void MainWindow::showNotification(const QString &msg)
 
 void MainWindow::deleteProfile()
 {
-    if (ui->stopButton->isEnabled()) {
-        this->onStopButtonPressed();
-    }
     int i = ui->profileComboBox->currentIndex();
+    latencyTester->abort();
+    fastest->stop();
+    connectLatency.remove(m_conf->profileAt(i));
+    handshakeLatency.remove(m_conf->profileAt(i));
+    backends->remove(m_conf->profileAt(i));
     m_conf->deleteProfile(i);
     ui->profileComboBox->removeItem(i);
 }
 
-void MainWindow::onProcessStarted()
+void MainWindow::onProcessStarted(SSProfile *p)
 {
-    ui->stopButton->setEnabled(true);
-    ui->startButton->setEnabled(false);
-    ui->logBrowser->clear();
+    updateRunningState();
 
-    showNotification(tr("Profile: %1 Started").arg(current_profile->profileName));
+    showNotification(tr("Profile: %1 Started").arg(p->profileName));
 }
 
-void MainWindow::onProcessStopped()
+void MainWindow::onProcessStopped(SSProfile *p)
 {
-    ui->stopButton->setEnabled(false);
-    ui->startButton->setEnabled(true);
+    updateRunningState();
+
+    showNotification(tr("Profile: %1 Stopped").arg(p->profileName));
+}
 
-    showNotification(tr("Profile: %1 Stopped").arg(current_profile->profileName));
+void MainWindow::onProcessStateChanged(SSProfile *p, SS_Process::State s)
+{
+    updateRunningState();
+    if (s == SS_Process::Failed) {
+        showNotification(tr("Profile: %1 Failed to Start").arg(p->profileName));
+    }
+    else if (s == SS_Process::CrashLoop) {
+        showNotification(tr("Profile: %1 Keeps Crashing").arg(p->profileName));
+    }
+}
+
+void MainWindow::updateRunningState()
+{
+    bool running = backends->isRunning(current_profile);
+    ui->stopButton->setEnabled(running);
+    ui->startButton->setEnabled(!running);
+
+    //mark every running profile in the profile list
+    QStringList runningNames;
+    for (int i = 0; i < m_conf->count() && i < ui->profileComboBox->count(); ++i) {
+        SSProfile *p = m_conf->profileAt(i);
+        if (backends->isDraining(p)) {
+            ui->profileComboBox->setItemIcon(i, QIcon::fromTheme("media-playback-stop"));
+            runningNames << tr("%1 (draining %2 connections)").arg(p->profileName).arg(backends->activeConnections(p));
+        }
+        else if (backends->isRunning(p)) {
+            ui->profileComboBox->setItemIcon(i, QIcon::fromTheme("media-playback-start"));
+            runningNames << QString("%1 (%2:%3)").arg(p->profileName).arg(p->local_addr).arg(p->local_port);
+        }
+        else if (backends->isStandby(p)) {
+            ui->profileComboBox->setItemIcon(i, QIcon::fromTheme("media-playback-pause"));
+        }
+        else {
+            ui->profileComboBox->setItemIcon(i, QIcon());
+        }
+    }
+
+#ifndef UBUNTU_UNITY
+    if (systray) {
+        systrayMenu->actions().at(1)->setVisible(!running);
+        systrayMenu->actions().at(2)->setVisible(running);
+        if (runningNames.isEmpty()) {
+            systray->setToolTip(QString("Shadowsocks-Qt5"));
+        }
+        else {
+            systray->setToolTip(QString("Shadowsocks-Qt5\n") + tr("Running: %1").arg(runningNames.join(", ")));
+        }
+    }
+#endif
 }
 
 void MainWindow::showWindow()
@@ -447,15 +714,62 @@ void MainWindow::closeEvent(QCloseEvent *e)
     QWidget::closeEvent(e);
 }
 
-void MainWindow::onProcessReadyRead(const QByteArray &o)
+/*
+ * Only queued here. The buffer decodes and shows everything that came in
+ * during its flush interval at once, so a chatty backend costs the GUI
+ * thread one view update per interval rather than one per chunk.
+ */
+void MainWindow::onProcessReadyRead(SSProfile *p, const QByteArray &o, const QVector<BackendEvent> &events)
 {
-    QString str = QString::fromLocal8Bit(o).trimmed();
+    bool showProfile = backends->runningCount() > 1;
     if (verboseOutput) {
-        qDebug() << str;
+        QString echo = (showProfile ? QString("[%1] ").arg(p->profileName) : QString()) + QString::fromLocal8Bit(o).trimmed();
+        if (fileLog) {
+            //the file gets the chunk below, through qDebug it would get it twice
+            LogWriter::debugToConsole(echo);
+        }
+        else {
+            qDebug() << echo;
+        }
+    }
+    logs->append(o, p->profileName, events, showProfile);
+    if (fileLog) {
+        fileLog->append(p->profileName, o);
     }
+}
 
-    ui->logBrowser->append(str);
-    ui->logBrowser->moveCursor(QTextCursor::End);
+/*
+ * The time range starts when it's picked, so that typing a search text
+ * afterwards only narrows the lines shown.
+ */
+void MainWindow::applyLogFilter()
+{
+    int since = ui->logTimeCombo->currentData().toInt();
+    QDateTime from = since > 0 ? QDateTime::currentDateTime().addSecs(-since) : QDateTime();
+    if (sender() != ui->logTimeCombo && since > 0 && logSince.isValid()) {
+        from = logSince;
+    }
+    logSince = from;
+
+    LogBuffer::Query q;
+    q.type = ui->logLevelCombo->currentData().toInt();
+    q.profile = ui->logProfileCombo->currentData().toString();
+    q.host = ui->logHostEdit->text().trimmed();
+    q.from = from;
+    q.text = ui->logSearchEdit->text();
+    logFilter->setQuery(q);
+    ui->logView->scrollToBottom();
+}
+
+void MainWindow::copyLogSelection()
+{
+    QModelIndexList rows = ui->logView->selectionModel()->selectedRows();
+    std::sort(rows.begin(), rows.end());
+    QStringList text;
+    for (QModelIndexList::iterator it = rows.begin(); it != rows.end(); ++it) {
+        text << it->data().toString();
+    }
+    QApplication::clipboard()->setText(text.join('\n'));
 }
 
 void MainWindow::onConfigurationChanged(bool saved)
@@ -486,6 +800,8 @@ void MainWindow::onBackendTypeChanged(const QString &type)
         ui->backendToolButton->setEnabled(false);
         ui->customArgEdit->setEnabled(false);
         ui->customArgLabel->setEnabled(false);
+        ui->workersSpinBox->setEnabled(true);
+        ui->workersLabel->setEnabled(true);
     }
     else {
         ui->backendEdit->setEnabled(true);
@@ -493,15 +809,15 @@ void MainWindow::onBackendTypeChanged(const QString &type)
         ui->backendToolButton->setEnabled(true);
         ui->customArgEdit->setEnabled(true);
         ui->customArgLabel->setEnabled(true);
+        ui->workersSpinBox->setEnabled(false);
+        ui->workersLabel->setEnabled(false);
     }
 
 #ifdef Q_OS_LINUX
-    if ((tID == SSProfile::LIBEV || tID == SSProfile::PYTHON) && m_conf->isTFOAvailable()) {
-        ui->tfoCheckBox->setEnabled(true);
-    }
-    else {
-        ui->tfoCheckBox->setEnabled(false);
-    }
+    //the probed capabilities if this backend has been started before
+    BackendCapabilities caps = BackendCapabilities::defaults(tID);
+    BackendRegistry::instance()->capabilities(current_profile->backend, &caps);
+    ui->tfoCheckBox->setEnabled(caps.fastOpen && m_conf->isTFOAvailable());
 #endif
     emit configurationChanged();
 }
@@ -548,6 +864,12 @@ void MainWindow::onTimeoutChanged(int t)
     emit configurationChanged();
 }
 
+void MainWindow::onWorkersChanged(int w)
+{
+    current_profile->workers = w;
+    emit configurationChanged();
+}
+
 #ifdef Q_OS_LINUX
 void MainWindow::onTcpFastOpenChanged(bool t)
 {
@@ -562,6 +884,13 @@ void MainWindow::onAutoHideToggled(bool c)
     emit configurationChanged();
 }
 
+void MainWindow::onAutoRestartToggled(bool c)
+{
+    m_conf->setAutoRestart(c);
+    backends->setRestartPolicy(c, m_conf->getRestartDelay(), m_conf->getRestartMaxDelay(), m_conf->getRestartLimit());
+    emit configurationChanged();
+}
+
 void MainWindow::onAutoStartToggled(bool c)
 {
     m_conf->setAutoStart(c);
@@ -574,6 +903,48 @@ void MainWindow::onDebugToggled(bool c)
     emit configurationChanged();
 }
 
+void MainWindow::onHotStandbyToggled(bool c)
+{
+    m_conf->setHotStandby(c);
+    emit configurationChanged();
+}
+
+void MainWindow::onGracefulDrainToggled(bool c)
+{
+    m_conf->setGracefulDrain(c);
+    backends->setDrainPolicy(c, m_conf->getDrainDeadline());
+    emit configurationChanged();
+}
+
+void MainWindow::onPickFastestToggled(bool c)
+{
+    m_conf->setPickFastest(c);
+    if (!c) {
+        fastest->stop();//keeps the picked profile running
+    }
+    emit configurationChanged();
+}
+
+void MainWindow::onFailoverToggled(bool c)
+{
+    m_conf->setFailover(c);
+    emit configurationChanged();
+}
+
+void MainWindow::onLoadBalanceToggled(bool c)
+{
+    m_conf->setLoadBalance(c);
+    emit configurationChanged();
+}
+
+//same order as PortForwarder::Policy
+void MainWindow::onBalancePolicyChanged(int i)
+{
+    static const char *names[] = {"roundRobin", "leastActive", "throughput"};
+    m_conf->setBalancePolicy(QString(names[qBound(0, i, 2)]));
+    emit configurationChanged();
+}
+
 void MainWindow::onTransculentToggled(bool c)
 {
     m_conf->setTranslucent(c);
@@ -598,6 +969,198 @@ void MainWindow::onSingleInstanceToggled(bool s)
     emit configurationChanged();
 }
 
+void MainWindow::reportEventLoopLag()
+{
+    qDebug() << "Event loop lag (ms) of GUI thread: avg" << guiMonitor->averageLag() << "max" << guiMonitor->maxLag();
+    guiMonitor->resetMax();
+
+    QList<SSProfile *> running = backends->runningProfiles();
+    for (QList<SSProfile *>::iterator it = running.begin(); it != running.end(); ++it) {
+        if ((*it)->getBackendType() != SSProfile::LIBQSS) {
+            continue;
+        }
+        const EventLoopMonitor *m = backends->process(*it)->qssLoopMonitor();
+        qDebug() << "Event loop lag (ms) of relay thread" << (*it)->profileName << ": avg" << m->averageLag() << "max" << m->maxLag();
+    }
+}
+
+QString MainWindow::formatBytes(quint64 bytes)
+{
+    static const char *units[] = {"B", "KiB", "MiB", "GiB", "TiB"};
+    double v = bytes;
+    int u = 0;
+    while (v >= 1024 && u < 4) {
+        v /= 1024;
+        ++u;
+    }
+    return QString("%1 %2").arg(v, 0, 'f', u == 0 ? 0 : 2).arg(units[u]);
+}
+
+void MainWindow::updateStatsTable()
+{
+    //nobody looks at it, don't spend the repaint
+    if (ui->tabWidget->currentWidget() != ui->statsTab || !this->isVisible()) {
+        return;
+    }
+
+    QList<SSProfile *> running = backends->runningProfiles();
+    ui->statsTable->setRowCount(running.size());
+    for (int row = 0; row < running.size(); ++row) {
+        const SS_Process *proc = backends->process(running[row]);
+        const TrafficMeter &t = proc->trafficMeter();
+        QStringList cells;
+        cells << (backends->isEjected(running[row]) ? tr("%1 (ejected)").arg(running[row]->profileName) : running[row]->profileName)
+              << formatBytes(t.bytesUp())
+              << formatBytes(t.bytesDown())
+              << QString::number(t.upMbps(), 'f', 2)
+              << QString::number(t.downMbps(), 'f', 2)
+              << QString::number(t.connections())
+              << QString::number(proc->eventCount(BackendEvent::Connect))
+              << QString::number(proc->eventCount(BackendEvent::Error) + proc->eventCount(BackendEvent::Timeout));
+        for (int col = 0; col < cells.size(); ++col) {
+            QTableWidgetItem *item = ui->statsTable->item(row, col);
+            if (item == NULL) {
+                item = new QTableWidgetItem;
+                ui->statsTable->setItem(row, col, item);
+            }
+            item->setText(cells[col]);
+        }
+    }
+}
+
+/*
+ * The benchmark runs in a child process. QSS::Encryptor keeps the method in
+ * global state, re-initialising it here would break running libQSS relays.
+ */
+void MainWindow::onBenchmarkButtonClicked()
+{
+    if (benchmarkProc == NULL) {
+        benchmarkProc = new QProcess(this);
+        benchmarkProc->setProcessChannelMode(QProcess::MergedChannels);
+        connect(benchmarkProc, static_cast<void (QProcess::*)(int)>(&QProcess::finished), this, &MainWindow::onBenchmarkFinished);
+    }
+    ui->benchmarkButton->setEnabled(false);
+    logs->append(tr("Benchmarking encryption methods..."));
+    benchmarkProc->start(QCoreApplication::applicationFilePath(), QStringList() << "--bench-ciphers");
+}
+
+void MainWindow::onBenchmarkFinished(int)
+{
+    ui->benchmarkButton->setEnabled(true);
+    QString fastest;
+    QRegularExpression result("^(\\S+)\\s+enc\\s+([\\d.]+) MB/s\\s+dec\\s+([\\d.]+) MB/s\\s+avg\\s+([\\d.]+) MB/s");
+    QStringList lines = QString::fromLocal8Bit(benchmarkProc->readAll()).split('\n', QString::SkipEmptyParts);
+    for (QStringList::iterator it = lines.begin(); it != lines.end(); ++it) {
+        logs->append(*it);
+        if (it->startsWith("Fastest safe method: ")) {
+            fastest = it->mid(21).trimmed();
+            continue;
+        }
+        QRegularExpressionMatch m = result.match(*it);
+        int i = m.hasMatch() ? ui->methodComboBox->findText(m.captured(1)) : -1;
+        if (i >= 0) {
+            ui->methodComboBox->setItemData(i, tr("%1 MB/s (encrypt %2, decrypt %3)").arg(m.captured(4)).arg(m.captured(2)).arg(m.captured(3)), Qt::ToolTipRole);
+        }
+    }
+
+    QFont bold = ui->methodComboBox->font();
+    bold.setBold(true);
+    for (int i = 0; i < ui->methodComboBox->count(); ++i) {
+        ui->methodComboBox->setItemData(i, ui->methodComboBox->itemText(i) == fastest ? QVariant(bold) : QVariant(), Qt::FontRole);
+    }
+    if (!fastest.isEmpty() && fastest != "none") {
+        showNotification(tr("%1 is the fastest safe encryption method on this machine.").arg(fastest));
+    }
+}
+
+void MainWindow::testLatency(bool handshake)
+{
+    QList<SSProfile *> profiles;
+    for (int i = 0; i < m_conf->count(); ++i) {
+        profiles << m_conf->profileAt(i);
+    }
+    ui->latencyButton->setEnabled(false);
+    latencyTester->test(profiles, handshake);
+}
+
+void MainWindow::onLatencyResult(SSProfile *p, qint64 connectTime, qint64 handshakeTime)
+{
+    connectLatency.insert(p, connectTime);
+    if (handshakeTime >= 0 || handshakeLatency.contains(p)) {
+        handshakeLatency.insert(p, handshakeTime);
+    }
+    for (int i = 0; i < m_conf->count() && i < ui->profileComboBox->count(); ++i) {
+        if (m_conf->profileAt(i) == p) {
+            ui->profileComboBox->setItemText(i, profileItemText(p));
+            break;
+        }
+    }
+}
+
+void MainWindow::onLatencyFinished()
+{
+    ui->latencyButton->setEnabled(true);
+}
+
+QString MainWindow::profileItemText(SSProfile *p) const
+{
+    if (!connectLatency.contains(p)) {
+        return p->profileName;
+    }
+    qint64 c = connectLatency.value(p);
+    if (c < 0) {
+        return tr("%1 (unreachable)").arg(p->profileName);
+    }
+    if (handshakeLatency.contains(p)) {
+        qint64 h = handshakeLatency.value(p);
+        return h < 0 ? tr("%1 (%2 ms, handshake failed)").arg(p->profileName).arg(c) : tr("%1 (%2 ms, handshake %3 ms)").arg(p->profileName).arg(c).arg(h);
+    }
+    return tr("%1 (%2 ms)").arg(p->profileName).arg(c);
+}
+
+//handshake time if tested, connect time otherwise, failed and untested profiles last
+qint64 MainWindow::latencyRank(SSProfile *p) const
+{
+    qint64 c = connectLatency.value(p, -1);
+    qint64 h = handshakeLatency.value(p, c);
+    if (c < 0 || h < 0) {
+        return std::numeric_limits<qint64>::max();
+    }
+    return h;
+}
+
+void MainWindow::sortProfilesByLatency()
+{
+    QList<SSProfile *> order;
+    for (int i = 0; i < m_conf->count(); ++i) {
+        order << m_conf->profileAt(i);
+    }
+    std::stable_sort(order.begin(), order.end(), [this] (SSProfile *a, SSProfile *b) {
+        return latencyRank(a) < latencyRank(b);
+    });
+    //profiles are moved, not copied, so every pointer stays valid
+    for (int to = 0; to < order.size(); ++to) {
+        for (int from = to; from < m_conf->count(); ++from) {
+            if (m_conf->profileAt(from) == order[to]) {
+                m_conf->moveProfile(from, to);
+                break;
+            }
+        }
+    }
+
+    this->blockChildrenSignals(true);
+    ui->profileComboBox->clear();
+    for (int i = 0; i < m_conf->count(); ++i) {
+        ui->profileComboBox->addItem(profileItemText(m_conf->profileAt(i)));
+    }
+    int current = order.indexOf(current_profile);
+    m_conf->setIndex(current);
+    ui->profileComboBox->setCurrentIndex(current);
+    this->blockChildrenSignals(false);
+    updateRunningState();
+    emit configurationChanged();
+}
+
 void MainWindow::blockChildrenSignals(bool b)
 {
     QList<QWidget *> children = this->findChildren<QWidget *>();
@@ -19,7 +19,14 @@
 #include <QCloseEvent>
 #include "ssprofile.h"
 #include "configuration.h"
-#include "ss_process.h"
+#include "backendmanager.h"
+#include "eventloopmonitor.h"
+#include "metricsserver.h"
+#include "latencytester.h"
+#include "fastestselector.h"
+#include "logbuffer.h"
+#include "logfilter.h"
+#include "logwriter.h"
 #include "ssvalidator.h"
 #include "ip4validator.h"
 #include "portvalidator.h"
@@ -58,7 +65,9 @@ public slots:
     void onStartButtonPressed();
 
 private slots:
-    inline void onStopButtonPressed() { ssProcess->stop(); }
+    void onStopButtonPressed();
+    void onFastestSelected(SSProfile *best, SSProfile *previous);
+    void onFastestInfo(const QString &);
     void addProfileDialogue(bool);
     void onBackendTypeChanged(const QString &);
     void deleteProfile();
@@ -72,9 +81,10 @@ private slots:
     void onCurrentProfileChanged(int);
     void onCustomArgsEditFinished(const QString &);
     void onShareButtonClicked();
-    void onProcessReadyRead(const QByteArray &);
-    void onProcessStarted();
-    void onProcessStopped();
+    void onProcessReadyRead(SSProfile *, const QByteArray &, const QVector<BackendEvent> &);
+    void onProcessStarted(SSProfile *);
+    void onProcessStopped(SSProfile *);
+    void onProcessStateChanged(SSProfile *, SS_Process::State);
     void onProfileResetClicked();
     void onProfileSaveClicked();
     void onPasswordEditFinished(const QString &);
@@ -83,28 +93,58 @@ private slots:
     void onSPortEditFinished(const QString &);
     void systrayActivated(QSystemTrayIcon::ActivationReason);
     void onTimeoutChanged(int);
+    void onWorkersChanged(int);
 #ifdef Q_OS_LINUX
     void onTcpFastOpenChanged(bool);
 #endif
     inline void onAboutButtonClicked() { QMessageBox::about(this, tr("About"), aboutText); }
     void onAutoHideToggled(bool);
+    void onAutoRestartToggled(bool);
     void onAutoStartToggled(bool);
     void onDebugToggled(bool);
+    void onHotStandbyToggled(bool);
+    void onGracefulDrainToggled(bool);
+    void onPickFastestToggled(bool);
+    void onFailoverToggled(bool);
+    void onLoadBalanceToggled(bool);
+    void onBalancePolicyChanged(int);
     void onRelativePathToggled(bool);
     void onTransculentToggled(bool);
     void onUseSystrayToggled(bool);
     void onSingleInstanceToggled(bool);
     void saveConfig();
+    void reportEventLoopLag();
+    void updateStatsTable();
+    void onBenchmarkButtonClicked();
+    void onBenchmarkFinished(int);
+    void copyLogSelection();
+    void applyLogFilter();
+    void onLatencyResult(SSProfile *, qint64, qint64);
+    void onLatencyFinished();
+    void testLatency(bool handshake);
+    void sortProfilesByLatency();
 
 private:
     AddProfileDialogue *addProfileDlg;
     bool verboseOutput;
+    EventLoopMonitor *guiMonitor;
+    MetricsServer *metrics;
+    QProcess *benchmarkProc;
+    LatencyTester *latencyTester;
+    FastestSelector *fastest;
+    LogBuffer *logs;
+    LogFilter *logFilter;//what the log view shows of logs
+    QDateTime logSince;//start of the time range the log is filtered by
+    bool logFollow;//the log view was at the end before the latest lines came in
+    LogWriter *fileLog;//NULL unless logging to a file
+    QHash<SSProfile *, qint64> connectLatency;//milliseconds, -1 if the test failed
+    QHash<SSProfile *, qint64> handshakeLatency;
     IP4Validator ipv4addrValidator;
     PortValidator portValidator;
     QString jsonconfigFile;
     QMenu *systrayMenu;
     QSystemTrayIcon *systray;
-    SS_Process *ssProcess;
+    BackendManager *backends;
     SSProfile *current_profile;
     static const QString aboutText;
     Ui::MainWindow *ui;
@@ -114,6 +154,11 @@ private:
     void createSystemTray();
     void showNotification(const QString &);
     void blockChildrenSignals(bool);
+    void updateRunningState();
+    void startCurrentProfile();
+    static QString formatBytes(quint64);
+    QString profileItemText(SSProfile *) const;
+    qint64 latencyRank(SSProfile *) const;
 
 protected:
     void changeEvent(QEvent *);
@@ -0,0 +1,211 @@
+#include <QDebug>
+#include <QHostAddress>
+#include "metricsserver.h"
+
+//enough for a dozen profiles, grows once if there are more
+static const int PAGE_RESERVE = 16384;
+//a scrape request larger than this isn't a scrape
+static const int MAX_REQUEST = 8192;
+
+static const char *stateNames[] = {"stopped", "starting", "ready", "failed", "restarting", "crash_loop"};
+
+MetricsServer::MetricsServer(BackendManager *b, const EventLoopMonitor *guiMonitor, QObject *parent) :
+    QObject(parent),
+    backends(b),
+    gui(guiMonitor),
+    renders(0)
+{
+    page.reserve(PAGE_RESERVE);
+    connect(&server, &QTcpServer::newConnection, this, &MetricsServer::onNewConnection);
+}
+
+bool MetricsServer::listen(quint16 port)
+{
+    if (!server.listen(QHostAddress::LocalHost, port)) {
+        qWarning() << "Metrics endpoint cannot listen on port" << port << server.errorString();
+        return false;
+    }
+    qDebug() << "Metrics served on http://127.0.0.1:" << port << "/metrics";
+    return true;
+}
+
+void MetricsServer::close()
+{
+    server.close();
+}
+
+void MetricsServer::onNewConnection()
+{
+    while (server.hasPendingConnections()) {
+        QTcpSocket *s = server.nextPendingConnection();
+        connect(s, &QTcpSocket::disconnected, s, &QTcpSocket::deleteLater);
+        //the header is read line by line into a buffer on the stack, its first line decides the answer
+        int received = 0;
+        bool requestLine = true;
+        bool scrape = false;
+        connect(s, &QTcpSocket::readyRead, this, [this, s, received, requestLine, scrape] () mutable {
+            char line[MAX_REQUEST];
+            while (s->canReadLine()) {
+                qint64 n = s->readLine(line, sizeof(line));
+                received += n;
+                if (requestLine) {
+                    requestLine = false;
+                    scrape = qstrncmp(line, "GET /metrics ", 13) == 0 || qstrncmp(line, "GET / ", 6) == 0;
+                }
+                else if (line[0] == '\r' || line[0] == '\n') {
+                    //answer once the whole header arrived, so no unread data is left when closing
+                    while (s->read(line, sizeof(line)) > 0) {}
+                    respond(s, scrape);
+                    return;
+                }
+            }
+            if (received + s->bytesAvailable() > MAX_REQUEST) {
+                s->abort();
+                s->deleteLater();
+            }
+        });
+    }
+}
+
+void MetricsServer::respond(QTcpSocket *s, bool scrape)
+{
+    s->disconnect(this);
+
+    char header[160];
+    if (scrape) {
+        render();
+        int n = qsnprintf(header, sizeof(header), "HTTP/1.1 200 OK\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %d\r\nConnection: close\r\n\r\n", page.size());
+        s->write(header, n);
+        //raw bytes, a QByteArray could be shared by the socket and cost a detach next time
+        s->write(page.constData(), page.size());
+    }
+    else {
+        static const char notFound[] = "HTTP/1.1 404 Not Found\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
+        s->write(notFound, sizeof(notFound) - 1);
+    }
+    s->disconnectFromHost();
+}
+
+/*
+ * Label values escape backslash, double quote and line feed.
+ * Cached by profile name, render() drops the names no profile has anymore.
+ */
+const QByteArray &MetricsServer::labelFor(SSProfile *p)
+{
+    QHash<QString, Label>::iterator it = labels.find(p->profileName);
+    if (it == labels.end()) {
+        Label l;
+        l.escaped = p->profileName.toUtf8().replace('\\', "\\\\").replace('"', "\\\"").replace('\n', "\\n");
+        it = labels.insert(p->profileName, l);
+    }
+    it->rendered = renders;
+    return it->escaped;
+}
+
+void MetricsServer::family(const char *name, const char *type, const char *help)
+{
+    page.append("# HELP ").append(name).append(' ').append(help).append('\n');
+    page.append("# TYPE ").append(name).append(' ').append(type).append('\n');
+}
+
+void MetricsServer::sample(const char *name, const QByteArray &profile, const char *extra, double value)
+{
+    char buf[32];
+    int n = qsnprintf(buf, sizeof(buf), "%.6g", value);
+    page.append(name).append("{profile=\"").append(profile).append('"');
+    if (extra) {
+        page.append(',').append(extra);
+    }
+    page.append("} ").append(buf, n).append('\n');
+}
+
+void MetricsServer::sample(const char *name, const QByteArray &profile, const char *extra, quint64 value)
+{
+    char buf[32];
+    int n = qsnprintf(buf, sizeof(buf), "%llu", static_cast<unsigned long long>(value));
+    page.append(name).append("{profile=\"").append(profile).append('"');
+    if (extra) {
+        page.append(',').append(extra);
+    }
+    page.append("} ").append(buf, n).append('\n');
+}
+
+void MetricsServer::render()
+{
+    //resize keeps the reserved capacity, clear() would free it
+    page.resize(0);
+    backends->profiles(&profiles);
+    ++renders;
+
+    family("ssqt5_backend_state", "gauge", "Backend state, 1 for the current one.");
+    for (QVector<SSProfile *>::const_iterator it = profiles.constBegin(); it != profiles.constEnd(); ++it) {
+        const SS_Process *proc = backends->process(*it);
+        char extra[40];
+        for (int s = SS_Process::Stopped; s <= SS_Process::CrashLoop; ++s) {
+            qsnprintf(extra, sizeof(extra), "state=\"%s\"", stateNames[s]);
+            sample("ssqt5_backend_state", labelFor(*it), extra, static_cast<quint64>(proc->state() == s ? 1 : 0));
+        }
+    }
+
+    family("ssqt5_backend_restarts_total", "counter", "Restarts by the supervisor after unexpected exits.");
+    for (QVector<SSProfile *>::const_iterator it = profiles.constBegin(); it != profiles.constEnd(); ++it) {
+        sample("ssqt5_backend_restarts_total", labelFor(*it), NULL, static_cast<quint64>(backends->process(*it)->restartCount()));
+    }
+
+    family("ssqt5_backend_ready_latency_seconds", "gauge", "Time from spawning the backend to its first SOCKS5 answer.");
+    for (QVector<SSProfile *>::const_iterator it = profiles.constBegin(); it != profiles.constEnd(); ++it) {
+        qint64 ms = backends->process(*it)->readyLatency();
+        if (ms >= 0) {
+            sample("ssqt5_backend_ready_latency_seconds", labelFor(*it), NULL, ms / 1000.0);
+        }
+    }
+
+    family("ssqt5_backend_downtime_seconds_total", "counter", "Time spent restarting after crashes.");
+    for (QVector<SSProfile *>::const_iterator it = profiles.constBegin(); it != profiles.constEnd(); ++it) {
+        sample("ssqt5_backend_downtime_seconds_total", labelFor(*it), NULL, backends->process(*it)->totalDowntime() / 1000.0);
+    }
+
+    family("ssqt5_relayed_bytes_total", "counter", "Bytes relayed since the profile was started.");
+    for (QVector<SSProfile *>::const_iterator it = profiles.constBegin(); it != profiles.constEnd(); ++it) {
+        const TrafficMeter &t = backends->process(*it)->trafficMeter();
+        sample("ssqt5_relayed_bytes_total", labelFor(*it), "direction=\"up\"", t.bytesUp());
+        sample("ssqt5_relayed_bytes_total", labelFor(*it), "direction=\"down\"", t.bytesDown());
+    }
+
+    family("ssqt5_active_connections", "gauge", "Established client connections on the backend's port.");
+    for (QVector<SSProfile *>::const_iterator it = profiles.constBegin(); it != profiles.constEnd(); ++it) {
+        sample("ssqt5_active_connections", labelFor(*it), NULL, static_cast<quint64>(backends->process(*it)->trafficMeter().connections()));
+    }
+
+    family("ssqt5_backend_events_total", "counter", "Lines of backend output by event type, connect requests only show with debug logging.");
+    for (QVector<SSProfile *>::const_iterator it = profiles.constBegin(); it != profiles.constEnd(); ++it) {
+        const SS_Process *proc = backends->process(*it);
+        char extra[40];
+        for (int e = BackendEvent::Connect; e < BackendEvent::TypeCount; ++e) {
+            qsnprintf(extra, sizeof(extra), "type=\"%s\"", LogParser::typeName(static_cast<BackendEvent::Type>(e)));
+            sample("ssqt5_backend_events_total", labelFor(*it), extra, proc->eventCount(static_cast<BackendEvent::Type>(e)));
+        }
+    }
+
+    family("ssqt5_event_loop_lag_seconds", "gauge", "Average event loop lag of the GUI thread and of each profile's relay thread.");
+    if (gui) {
+        char buf[32];
+        int n = qsnprintf(buf, sizeof(buf), "%.6g", gui->averageLag() / 1000.0);
+        page.append("ssqt5_event_loop_lag_seconds{thread=\"gui\"} ").append(buf, n).append('\n');
+    }
+    for (QVector<SSProfile *>::const_iterator it = profiles.constBegin(); it != profiles.constEnd(); ++it) {
+        if ((*it)->getBackendType() == SSProfile::LIBQSS) {
+            sample("ssqt5_event_loop_lag_seconds", labelFor(*it), "thread=\"relay\"", backends->process(*it)->qssLoopMonitor()->averageLag() / 1000.0);
+        }
+    }
+
+    //every profile got a label from the first family, the others are removed or renamed
+    for (QHash<QString, Label>::iterator it = labels.begin(); it != labels.end();) {
+        if (it->rendered != renders) {
+            it = labels.erase(it);
+        }
+        else {
+            ++it;
+        }
+    }
+}
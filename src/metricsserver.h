@@ -0,0 +1,61 @@
+/*
+ * Metrics Server Class
+ *
+ * Serves GET /metrics in the Prometheus text format on a loopback port.
+ * It runs in the GUI thread and only reads counters the relay maintains
+ * anyway, so a scrape never touches relayed traffic. The page and the
+ * list of profiles are kept from one scrape to the next and the request
+ * is read into the stack, so past the socket itself a scrape only
+ * allocates when a profile is new or renamed.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef METRICSSERVER_H
+#define METRICSSERVER_H
+#include <QObject>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QByteArray>
+#include <QHash>
+#include <QVector>
+#include "backendmanager.h"
+#include "eventloopmonitor.h"
+
+class MetricsServer : public QObject
+{
+    Q_OBJECT
+
+public:
+    MetricsServer(BackendManager *backends, const EventLoopMonitor *guiMonitor, QObject *parent = 0);
+
+    bool listen(quint16 port);
+    void close();
+    inline bool isListening() const { return server.isListening(); }
+
+private:
+    struct Label
+    {
+        QByteArray escaped;
+        quint32 rendered;//the last render that used it
+    };
+
+    QTcpServer server;
+    BackendManager *backends;
+    const EventLoopMonitor *gui;
+    QByteArray page;
+    QHash<QString, Label> labels;//by profile name
+    quint32 renders;
+    QVector<SSProfile *> profiles;//refilled by each render, keeping its capacity
+
+    void render();
+    const QByteArray &labelFor(SSProfile *p);
+    void family(const char *name, const char *type, const char *help);
+    void sample(const char *name, const QByteArray &profile, const char *extra, double value);
+    void sample(const char *name, const QByteArray &profile, const char *extra, quint64 value);
+    void respond(QTcpSocket *socket, bool scrape);
+
+private slots:
+    void onNewConnection();
+};
+
+#endif // METRICSSERVER_H
@@ -0,0 +1,177 @@
+#include <QDebug>
+#include "outputreader.h"
+
+#ifdef Q_OS_UNIX
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <errno.h>
+#endif
+
+//a chunk is whatever one read returns, at most this many bytes
+static const int CHUNK_SIZE = 16384;
+//with the Sample policy, one in this many chunks is kept once the queue is half full
+static const quint32 SAMPLE_RATE = 8;
+
+OutputReader::Policy OutputReader::defaultPolicy = OutputReader::Drop;
+
+OutputReader::OutputReader(QObject *parent) :
+    QThread(parent),
+    stopping(0),
+    droppedLines(0),
+    head(0),
+    tail(0),
+    m_policy(defaultPolicy),
+    sampled(0)
+{
+    fds[0] = fds[1] = -1;
+    setObjectName("backend-output");
+}
+
+OutputReader::~OutputReader()
+{
+    requestStop();
+    wait();
+    closeWriteEnd();
+#ifdef Q_OS_UNIX
+    if (fds[0] >= 0) {
+        ::close(fds[0]);
+    }
+#endif
+}
+
+void OutputReader::setPolicy(Policy p)
+{
+    defaultPolicy = p;
+}
+
+OutputReader::Policy OutputReader::policyFromName(const QString &name)
+{
+    return name.compare("sample", Qt::CaseInsensitive) == 0 ? Sample : Drop;
+}
+
+/*
+ * Both ends are close-on-exec, so that backends started meanwhile don't
+ * inherit the write end and keep the pipe open after this one exited.
+ * The child gets the write end through dup2, which clears the flag.
+ */
+bool OutputReader::open()
+{
+#ifdef Q_OS_UNIX
+    if (::pipe(fds) != 0) {
+        fds[0] = fds[1] = -1;
+        return false;
+    }
+    ::fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    ::fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return true;
+#else
+    return false;
+#endif
+}
+
+//once the child has its copy, so that its exit is seen as end of file
+void OutputReader::closeWriteEnd()
+{
+#ifdef Q_OS_UNIX
+    if (fds[1] >= 0) {
+        ::close(fds[1]);
+        fds[1] = -1;
+    }
+#endif
+}
+
+void OutputReader::requestStop()
+{
+    stopping.storeRelease(1);
+}
+
+bool OutputReader::take(QByteArray *chunk)
+{
+    quint32 h = head.load();
+    if (h == tail.loadAcquire()) {
+        return false;
+    }
+    QByteArray &slot = ring[h % QUEUE_SIZE];
+    *chunk = slot;
+    slot = QByteArray();
+    head.storeRelease(h + 1);
+    return true;
+}
+
+void OutputReader::push(const QByteArray &chunk)
+{
+    quint32 t = tail.load();
+    quint32 used = t - head.loadAcquire();
+    bool keep = used < static_cast<quint32>(QUEUE_SIZE);
+    if (keep && m_policy == Sample && used >= static_cast<quint32>(QUEUE_SIZE / 2)) {
+        keep = sampled++ % SAMPLE_RATE == 0;
+    }
+    if (!keep) {
+        droppedLines.fetchAndAddRelaxed(qMax(1, chunk.count('\n')));
+        return;
+    }
+    ring[t % QUEUE_SIZE] = chunk;
+    tail.storeRelease(t + 1);
+}
+
+/*
+ * Polls with a timeout rather than blocking in read(), so that a stop
+ * request is noticed even if a grandchild still holds the write end.
+ */
+void OutputReader::run()
+{
+#ifdef Q_OS_UNIX
+    QByteArray buf(CHUNK_SIZE, Qt::Uninitialized);
+    struct pollfd p;
+    p.fd = fds[0];
+    p.events = POLLIN;
+    while (!stopping.loadAcquire()) {
+        p.revents = 0;
+        int r = ::poll(&p, 1, 100);
+        if (r < 0 && errno != EINTR) {
+            break;
+        }
+        if (r <= 0) {
+            continue;
+        }
+        ssize_t n = ::read(fds[0], buf.data(), CHUNK_SIZE);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        push(QByteArray(buf.constData(), static_cast<int>(n)));
+    }
+#endif
+}
+
+BackendProcess::BackendProcess(QObject *parent) :
+    QProcess(parent),
+    outputFd(-1)
+{}
+
+void BackendProcess::setOutputPipe(int fd)
+{
+    outputFd = fd;
+    if (fd >= 0) {
+        setStandardOutputFile(QProcess::nullDevice());
+        setStandardErrorFile(QProcess::nullDevice());
+    }
+    else {
+        setStandardOutputFile(QString());
+        setStandardErrorFile(QString());
+    }
+}
+
+//runs in the child between fork and exec, only async-signal-safe calls here
+void BackendProcess::setupChildProcess()
+{
+#ifdef Q_OS_UNIX
+    if (outputFd >= 0) {
+        ::dup2(outputFd, STDOUT_FILENO);
+        ::dup2(outputFd, STDERR_FILENO);
+    }
+#endif
+}
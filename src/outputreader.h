@@ -0,0 +1,87 @@
+/*
+ * Output Reader Class
+ *
+ * Drains the stdout and stderr pipe of an external backend on its own
+ * thread into a fixed-size lock-free queue, which the GUI thread empties
+ * whenever it gets to it. The backend never blocks on a full pipe, no
+ * matter how slow the log view is. When the queue fills up, output is
+ * dropped or sampled according to the overflow policy and the dropped
+ * lines are counted.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef OUTPUTREADER_H
+#define OUTPUTREADER_H
+#include <QThread>
+#include <QProcess>
+#include <QByteArray>
+#include <QAtomicInt>
+#include <QAtomicInteger>
+
+class OutputReader : public QThread
+{
+    Q_OBJECT
+
+public:
+    /*
+     * Drop keeps everything until the queue is full and drops what comes
+     * after. Sample keeps every eighth chunk once the queue is half full,
+     * so that a flood stays visible as it goes on.
+     */
+    enum Policy {Drop, Sample};
+
+    OutputReader(QObject *parent = 0);
+    ~OutputReader();
+
+    static void setPolicy(Policy p);
+    static Policy policyFromName(const QString &name);
+
+    bool open();
+    inline int writeEnd() const { return fds[1]; }
+    void closeWriteEnd();
+    void requestStop();
+
+    //consumer side, called from one thread only
+    bool take(QByteArray *chunk);
+    inline int takeDropped() { return droppedLines.fetchAndStoreRelaxed(0); }
+
+protected:
+    void run();
+
+private:
+    static const int QUEUE_SIZE = 256;
+
+    int fds[2];
+    QAtomicInt stopping;
+    QAtomicInt droppedLines;
+    QAtomicInteger<quint32> head;//next slot to take, advanced by the consumer
+    QAtomicInteger<quint32> tail;//next slot to fill, advanced by the reader
+    QByteArray ring[QUEUE_SIZE];
+    Policy m_policy;
+    quint32 sampled;
+
+    void push(const QByteArray &chunk);
+    static Policy defaultPolicy;
+};
+
+/*
+ * A QProcess whose child writes stdout and stderr into the pipe of an
+ * OutputReader instead of a pipe QProcess reads in its own thread.
+ */
+class BackendProcess : public QProcess
+{
+    Q_OBJECT
+
+public:
+    BackendProcess(QObject *parent = 0);
+    //-1 lets QProcess read the output itself
+    void setOutputPipe(int fd);
+
+protected:
+    void setupChildProcess();
+
+private:
+    int outputFd;
+};
+
+#endif // OUTPUTREADER_H
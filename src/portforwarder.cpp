@@ -0,0 +1,661 @@
+#include <QTcpSocket>
+#include <QTimer>
+#include "portforwarder.h"
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <errno.h>
+#include <string.h>
+#endif
+
+/*
+ * Bytes queued for writing on one side before we stop reading the other side.
+ * Together with the bounded read buffer this leaves flow control to the kernel.
+ */
+static const qint64 HIGH_WATER_MARK = 256 * 1024;
+static const qint64 READ_CHUNK = 64 * 1024;
+
+//a target refusing this many connections in a row is skipped for EJECT_TIME milliseconds
+static const int EJECT_AFTER = 3;
+static const qint64 EJECT_TIME = 10000;
+
+static const double HEDGE_BURST = 10;
+
+/*
+ * One client connection and its upstream connection.
+ * Both sockets are children, so deleting this object closes both.
+ */
+class ForwardedConnection : public QObject
+{
+public:
+    ForwardedConnection(QTcpSocket *c, quint16 targetPort, PortForwarder *f) :
+        QObject(f),
+        forwarder(f),
+        port(targetPort),
+        client(c),
+        upstream(new QTcpSocket(this)),
+        closing(false),
+        upstreamConnected(false),
+        retries(0)
+    {
+        forwarder->addActive(port, 1);
+        wire();
+        upstream->connectToHost(QHostAddress::LocalHost, targetPort);
+    }
+
+    //takes over an upstream that is connected already and counted for targetPort, e.g. the winner of a hedged race
+    ForwardedConnection(QTcpSocket *c, QTcpSocket *u, quint16 targetPort, PortForwarder *f) :
+        QObject(f),
+        forwarder(f),
+        port(targetPort),
+        client(c),
+        upstream(u),
+        closing(false),
+        upstreamConnected(true),
+        retries(0)
+    {
+        upstream->setParent(this);
+        wire();
+        forward(client, upstream);
+        forward(upstream, client);
+        if (client->state() != QAbstractSocket::ConnectedState || upstream->state() != QAbstractSocket::ConnectedState) {
+            teardown();
+        }
+    }
+
+    ~ForwardedConnection()
+    {
+        forwarder->addActive(port, -1);
+    }
+
+private:
+    PortForwarder *forwarder;
+    quint16 port;
+    QTcpSocket *client;
+    QTcpSocket *upstream;
+    bool closing;
+    bool upstreamConnected;
+    int retries;
+
+    void wire()
+    {
+        client->setParent(this);
+        client->setReadBufferSize(READ_CHUNK);
+        upstream->setReadBufferSize(READ_CHUNK);
+
+        connect(client, &QTcpSocket::readyRead, this, [this] { forward(client, upstream); });
+        connect(upstream, &QTcpSocket::readyRead, this, [this] { forward(upstream, client); });
+        connect(upstream, &QTcpSocket::connected, this, [this] {
+            upstreamConnected = true;
+            forwarder->onUpstreamConnected(port);
+            forward(client, upstream);
+        });
+        connect(client, &QTcpSocket::bytesWritten, this, [this] { forward(upstream, client); });
+        connect(upstream, &QTcpSocket::bytesWritten, this, [this] { forward(client, upstream); });
+        connect(client, &QTcpSocket::disconnected, this, &ForwardedConnection::teardown);
+        connect(upstream, &QTcpSocket::disconnected, this, &ForwardedConnection::teardown);
+        connect(client, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QTcpSocket::error), this, &ForwardedConnection::teardown);
+        connect(upstream, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QTcpSocket::error), this, &ForwardedConnection::onUpstreamError);
+    }
+
+    /*
+     * Nothing was read from the client before the upstream connected,
+     * so a refused connection can simply be made again to another target.
+     */
+    void onUpstreamError()
+    {
+        if (!upstreamConnected && !closing) {
+            forwarder->onUpstreamRefused(port);
+            quint16 other = ++retries < forwarder->targets.size() ? forwarder->pick(port) : 0;
+            if (other != 0) {
+                forwarder->addActive(port, -1);
+                port = other;
+                forwarder->addActive(port, 1);
+                //not from within the socket's own error handling
+                QTimer::singleShot(0, this, [this] {
+                    if (!closing) {
+                        upstream->abort();
+                        upstream->connectToHost(QHostAddress::LocalHost, port);
+                    }
+                });
+                return;
+            }
+        }
+        teardown();
+    }
+
+    void forward(QTcpSocket *from, QTcpSocket *to, bool all = false)
+    {
+        if (to->state() != QAbstractSocket::ConnectedState) {
+            return;//data stays in from's read buffer until the other end is ready
+        }
+        while (from->bytesAvailable() > 0 && (all || to->bytesToWrite() < HIGH_WATER_MARK)) {
+            to->write(from->read(READ_CHUNK));
+        }
+    }
+
+    void teardown()
+    {
+        if (!closing) {
+            closing = true;
+            //flush whatever is left, disconnectFromHost() waits for pending writes
+            forward(client, upstream, true);
+            forward(upstream, client, true);
+            client->disconnectFromHost();
+            upstream->disconnectFromHost();
+            QTimer::singleShot(30000, this, SLOT(deleteLater()));//don't linger forever on a stuck peer
+        }
+        if (client->state() == QAbstractSocket::UnconnectedState && upstream->state() == QAbstractSocket::UnconnectedState) {
+            deleteLater();
+        }
+    }
+};
+
+/*
+ * Length of a SOCKS5 request or reply starting at b,
+ * -1 while it's incomplete, 0 if the address type is unknown.
+ */
+static int socksMessageLength(const QByteArray &b)
+{
+    if (b.size() < 5) {
+        return -1;
+    }
+    int n;
+    switch (b.at(3)) {
+    case 1:
+        n = 4 + 4 + 2;
+        break;
+    case 3:
+        n = 4 + 1 + static_cast<quint8>(b.at(4)) + 2;
+        break;
+    case 4:
+        n = 4 + 16 + 2;
+        break;
+    default:
+        return 0;
+    }
+    return b.size() < n ? -1 : n;
+}
+
+/*
+ * Answers the client's SOCKS5 greeting itself, then sends its CONNECT
+ * request through two targets at once. The target whose server replies
+ * first keeps the connection, the other one is reset. Nothing the client
+ * sends after its request is read before that, so the data only ever
+ * goes to the winner. Both legs count as active while they race.
+ */
+class HedgedConnection : public QObject
+{
+public:
+    HedgedConnection(QTcpSocket *c, quint16 first, quint16 second, PortForwarder *f) :
+        QObject(f),
+        forwarder(f),
+        client(c),
+        clientStage(Greeting),
+        handedOver(false)
+    {
+        client->setParent(this);
+        connect(client, &QTcpSocket::readyRead, this, &HedgedConnection::onClientRead);
+        connect(client, &QTcpSocket::disconnected, this, &HedgedConnection::deleteLater);
+        connect(client, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QTcpSocket::error), this, &HedgedConnection::deleteLater);
+        addLeg(first);
+        addLeg(second);
+    }
+
+    //legs still racing when the client goes away, their sockets are children
+    ~HedgedConnection()
+    {
+        for (QList<Leg *>::iterator it = legs.begin(); it != legs.end(); ++it) {
+            forwarder->addActive((*it)->port, -1);
+        }
+        qDeleteAll(legs);
+    }
+
+private:
+    enum Stage {Greeting, Request, Racing};
+    struct Leg
+    {
+        QTcpSocket *socket;
+        quint16 port;
+        int stage;//waiting for the method reply, the CONNECT reply
+        bool sentRequest;
+    };
+
+    PortForwarder *forwarder;
+    QTcpSocket *client;
+    Stage clientStage;
+    bool handedOver;
+    QByteArray request;
+    QList<Leg *> legs;
+
+    void addLeg(quint16 port)
+    {
+        Leg *l = new Leg;
+        l->socket = new QTcpSocket(this);
+        l->port = port;
+        l->stage = 0;
+        l->sentRequest = false;
+        legs << l;
+        forwarder->addActive(port, 1);
+        connect(l->socket, &QTcpSocket::connected, this, [l] { l->socket->write("\x05\x01\x00", 3); });
+        connect(l->socket, &QTcpSocket::readyRead, this, [this, l] { onLegRead(l); });
+        connect(l->socket, &QTcpSocket::disconnected, this, [this, l] { dropLeg(l); });
+        connect(l->socket, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QTcpSocket::error), this, [this, l] {
+            if (l->stage == 0 && l->socket->state() != QAbstractSocket::ConnectedState) {
+                forwarder->onUpstreamRefused(l->port);
+            }
+            dropLeg(l);
+        });
+        l->socket->connectToHost(QHostAddress::LocalHost, port);
+    }
+
+    void onClientRead()
+    {
+        if (clientStage == Greeting) {
+            QByteArray b = client->peek(257);
+            if (b.size() < 2 || b.size() < 2 + static_cast<quint8>(b.at(1))) {
+                return;
+            }
+            client->read(2 + static_cast<quint8>(b.at(1)));
+            client->write("\x05\x00", 2);
+            clientStage = Request;
+        }
+        if (clientStage == Request) {
+            int n = socksMessageLength(client->peek(262));
+            if (n < 0) {
+                return;
+            }
+            if (n == 0) {
+                client->write("\x05\x08\x00\x01\x00\x00\x00\x00\x00\x00", 10);//address type not supported
+                client->disconnectFromHost();
+                return;
+            }
+            request = client->read(n);
+            clientStage = Racing;
+            if (request.at(1) != 1) {
+                //not a CONNECT, nothing to race for
+                while (legs.size() > 1) {
+                    dropLeg(legs.last());
+                }
+            }
+            QList<Leg *> l = legs;
+            for (QList<Leg *>::iterator it = l.begin(); it != l.end() && !handedOver; ++it) {
+                sendRequest(*it);
+            }
+        }
+        //while Racing, the client's data waits in its socket for the winner
+    }
+
+    void sendRequest(Leg *l)
+    {
+        if (l->stage < 1 || l->sentRequest || request.isEmpty()) {
+            return;
+        }
+        l->socket->write(request);
+        l->sentRequest = true;
+        if (request.at(1) != 1) {
+            win(l);//the reply goes straight to the client
+        }
+    }
+
+    void onLegRead(Leg *l)
+    {
+        if (l->stage == 0) {
+            if (l->socket->bytesAvailable() < 2) {
+                return;
+            }
+            if (l->socket->read(2) != QByteArray("\x05\x00", 2)) {
+                dropLeg(l);
+                return;
+            }
+            forwarder->onUpstreamConnected(l->port);
+            l->stage = 1;
+            sendRequest(l);
+            return;
+        }
+        QByteArray reply = l->socket->peek(262);
+        int n = socksMessageLength(reply);
+        if (n < 0) {
+            return;
+        }
+        if (n == 0 || reply.at(1) != 0) {
+            dropLeg(l);
+            return;
+        }
+        win(l);//the reply is still in the socket, the forwarded connection passes it on
+    }
+
+    void dropLeg(Leg *l)
+    {
+        if (!legs.removeOne(l)) {
+            return;
+        }
+        forwarder->addActive(l->port, -1);
+        l->socket->disconnect(this);
+        l->socket->abort();
+        l->socket->deleteLater();
+        delete l;
+        if (legs.isEmpty() && !handedOver) {
+            if (clientStage == Racing) {
+                client->write("\x05\x01\x00\x01\x00\x00\x00\x00\x00\x00", 10);//general failure
+            }
+            client->disconnectFromHost();
+            deleteLater();
+        }
+    }
+
+    //the winner's socket and the client move to a plain forwarded connection, which keeps its count
+    void win(Leg *l)
+    {
+        if (legs.size() > 1 && legs.first() != l) {
+            forwarder->m_hedgeWins.ref();
+        }
+        handedOver = true;
+        legs.removeOne(l);
+        while (!legs.isEmpty()) {
+            dropLeg(legs.first());
+        }
+        l->socket->disconnect(this);
+        client->disconnect(this);
+        new ForwardedConnection(client, l->socket, l->port, forwarder);
+        delete l;
+        deleteLater();
+    }
+};
+
+PortForwarder::PortForwarder(QObject *parent) :
+    QObject(parent),
+    next(0),
+    m_policy(RoundRobin),
+    hedgeBudget(0),
+    hedgeTokens(0),
+    m_active(0),
+    m_hedged(0),
+    m_hedgeWins(0)
+{
+    server = new QTcpServer(this);
+    connect(server, &QTcpServer::newConnection, this, &PortForwarder::onNewConnection);
+}
+
+PortForwarder::~PortForwarder()
+{
+    //connections update our counters when deleted, so delete them while the counters still exist
+    QObjectList c = children();
+    for (QObjectList::iterator it = c.begin(); it != c.end(); ++it) {
+        if (*it != server) {
+            delete *it;
+        }
+    }
+}
+
+void PortForwarder::addActive(quint16 targetPort, int delta)
+{
+    if (delta > 0) {
+        m_active.ref();
+    }
+    else {
+        m_active.deref();
+    }
+    QMutexLocker locker(&countMutex);
+    int n = targetActive.value(targetPort) + delta;
+    if (n > 0) {
+        targetActive.insert(targetPort, n);
+    }
+    else {
+        targetActive.remove(targetPort);
+    }
+}
+
+int PortForwarder::activeConnections(quint16 targetPort) const
+{
+    QMutexLocker locker(&countMutex);
+    return targetActive.value(targetPort);
+}
+
+bool PortForwarder::canSharePort()
+{
+#ifdef Q_OS_LINUX
+    return true;
+#else
+    return false;
+#endif
+}
+
+/*
+ * shared sets SO_REUSEPORT, so that other forwarders can listen on the
+ * same port. It's ignored where canSharePort() is false.
+ */
+bool PortForwarder::listen(const QHostAddress &addr, quint16 port, bool shared)
+{
+    bool ok;
+    QString error;
+    if (shared && canSharePort()) {
+        ok = listenShared(addr, port, &error);
+    }
+    else {
+        ok = server->listen(addr, port);
+        error = server->errorString();
+    }
+    if (!ok) {
+        emit info(tr("Forwarder failed to listen on %1:%2. %3").arg(addr.toString()).arg(port).arg(error));
+        return false;
+    }
+    emit info(tr("Forwarder listening on %1:%2 for %3 workers").arg(addr.toString()).arg(port).arg(targets.size()));
+    return true;
+}
+
+//QTcpServer can't set SO_REUSEPORT, so the socket is made here and handed over
+bool PortForwarder::listenShared(const QHostAddress &addr, quint16 port, QString *error)
+{
+#ifdef Q_OS_LINUX
+    sockaddr_storage ss;
+    memset(&ss, 0, sizeof(ss));
+    socklen_t len;
+    if (addr.protocol() == QAbstractSocket::IPv6Protocol) {
+        sockaddr_in6 *a = reinterpret_cast<sockaddr_in6 *>(&ss);
+        a->sin6_family = AF_INET6;
+        a->sin6_port = htons(port);
+        Q_IPV6ADDR ip = addr.toIPv6Address();
+        memcpy(&a->sin6_addr, &ip, sizeof(ip));
+        len = sizeof(sockaddr_in6);
+    }
+    else {
+        sockaddr_in *a = reinterpret_cast<sockaddr_in *>(&ss);
+        a->sin_family = AF_INET;
+        a->sin_port = htons(port);
+        a->sin_addr.s_addr = htonl(addr.toIPv4Address());
+        len = sizeof(sockaddr_in);
+    }
+    int fd = ::socket(ss.ss_family, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        *error = QString::fromLocal8Bit(strerror(errno));
+        return false;
+    }
+    int on = 1;
+    if (::setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on)) != 0
+            || ::setsockopt(fd, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) != 0
+            || ::bind(fd, reinterpret_cast<sockaddr *>(&ss), len) != 0
+            || ::listen(fd, SOMAXCONN) != 0) {
+        *error = QString::fromLocal8Bit(strerror(errno));
+        ::close(fd);
+        return false;
+    }
+    if (!server->setSocketDescriptor(fd)) {
+        *error = server->errorString();
+        ::close(fd);
+        return false;
+    }
+    return true;
+#else
+    Q_UNUSED(addr);
+    Q_UNUSED(port);
+    *error = tr("Sharing a port isn't supported on this platform.");
+    return false;
+#endif
+}
+
+void PortForwarder::close()
+{
+    server->close();
+    //existing connections stay alive until either end closes
+}
+
+void PortForwarder::setTargets(const QList<quint16> &ports)
+{
+    targets = ports;
+    next = 0;
+    currentWeights.clear();
+    emit targetsChanged();
+}
+
+void PortForwarder::setPolicy(int policy)
+{
+    m_policy = static_cast<Policy>(policy);
+}
+
+/*
+ * percent of the connections that may be raced over a second target,
+ * 0 turns hedging off. Unused budget accumulates for bursts, up to
+ * HEDGE_BURST extra connections.
+ */
+void PortForwarder::setHedging(int budgetPercent)
+{
+    hedgeBudget = qBound(0, budgetPercent, 100);
+    hedgeTokens = 0;
+}
+
+//targets without a weight count as 1
+void PortForwarder::setWeights(const QHash<quint16, int> &weights)
+{
+    m_weights = weights;
+}
+
+bool PortForwarder::isEjected(quint16 targetPort)
+{
+    QHash<quint16, QElapsedTimer>::iterator it = ejected.find(targetPort);
+    if (it == ejected.end()) {
+        return false;
+    }
+    if (it->elapsed() < EJECT_TIME) {
+        return true;
+    }
+    ejected.erase(it);//let one connection through to test it
+    refused.insert(targetPort, EJECT_AFTER - 1);
+    return false;
+}
+
+/*
+ * Returns 0 if there is no target other than except. Ejected targets
+ * are only used if all targets are ejected. Without advance the
+ * round-robin and weighted state is left as it is, so that a second
+ * leg doesn't shift the targets the next connections get.
+ */
+quint16 PortForwarder::pick(quint16 except, bool advance)
+{
+    QList<quint16> candidates;
+    for (QList<quint16>::iterator it = targets.begin(); it != targets.end(); ++it) {
+        if (*it != except && !isEjected(*it)) {
+            candidates << *it;
+        }
+    }
+    if (candidates.isEmpty()) {
+        for (QList<quint16>::iterator it = targets.begin(); it != targets.end(); ++it) {
+            if (*it != except) {
+                candidates << *it;
+            }
+        }
+    }
+    if (candidates.isEmpty()) {
+        return 0;
+    }
+
+    quint16 chosen = candidates.first();
+    if (m_policy == LeastActive) {
+        QMutexLocker locker(&countMutex);
+        int least = targetActive.value(chosen);
+        for (QList<quint16>::iterator it = candidates.begin(); it != candidates.end(); ++it) {
+            int n = targetActive.value(*it);
+            if (n < least) {
+                least = n;
+                chosen = *it;
+            }
+        }
+    }
+    else if (m_policy == Weighted) {
+        //smooth weighted round-robin, it interleaves instead of sending bursts to the heaviest
+        int total = 0;
+        int best = 0;
+        for (QList<quint16>::iterator it = candidates.begin(); it != candidates.end(); ++it) {
+            int w = qMax(1, m_weights.value(*it, 1));
+            int c = currentWeights.value(*it) + w;
+            if (advance) {
+                currentWeights.insert(*it, c);
+            }
+            total += w;
+            if (it == candidates.begin() || c > best) {
+                best = c;
+                chosen = *it;
+            }
+        }
+        if (advance) {
+            currentWeights[chosen] -= total;
+        }
+    }
+    else if (advance) {
+        next = (next + 1) % candidates.size();
+        chosen = candidates.at(next);
+    }
+    else {
+        //the candidate after except, which the next connection would get anyway
+        int from = targets.indexOf(except);
+        for (int n = 1; n <= targets.size(); ++n) {
+            quint16 t = targets.at((from + n) % targets.size());
+            if (candidates.contains(t)) {
+                chosen = t;
+                break;
+            }
+        }
+    }
+    return chosen;
+}
+
+void PortForwarder::onUpstreamConnected(quint16 targetPort)
+{
+    refused.remove(targetPort);
+}
+
+void PortForwarder::onUpstreamRefused(quint16 targetPort)
+{
+    int n = refused.value(targetPort) + 1;
+    refused.insert(targetPort, n);
+    if (n >= EJECT_AFTER && !ejected.contains(targetPort)) {
+        ejected[targetPort].start();
+        emit info(tr("Port %1 refused %2 connections in a row, skipping it for %3 seconds").arg(targetPort).arg(n).arg(EJECT_TIME / 1000));
+    }
+}
+
+void PortForwarder::onNewConnection()
+{
+    while (server->hasPendingConnections()) {
+        QTcpSocket *c = server->nextPendingConnection();
+        if (targets.isEmpty()) {
+            c->deleteLater();
+            continue;
+        }
+        quint16 first = pick();
+        if (hedgeBudget > 0 && targets.size() > 1) {
+            hedgeTokens = qMin(hedgeTokens + hedgeBudget / 100.0, HEDGE_BURST);
+            if (hedgeTokens >= 1) {
+                quint16 second = pick(first, false);
+                if (second != 0 && !isEjected(second)) {
+                    hedgeTokens -= 1;
+                    m_hedged.ref();
+                    new HedgedConnection(c, first, second, this);
+                    continue;
+                }
+            }
+        }
+        new ForwardedConnection(c, first, this);
+    }
+}
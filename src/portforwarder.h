@@ -0,0 +1,88 @@
+/*
+ * Port Forwarder Class
+ *
+ * Listens on the user-facing local port and splices every accepted
+ * connection to one of several loopback target ports, chosen in turn,
+ * by fewest active connections, or by weight. A target that refuses
+ * several connections in a row is skipped for a while, and a connection
+ * it refused is retried on another target. Optionally, a share of the
+ * SOCKS5 connections is raced over two targets.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef PORTFORWARDER_H
+#define PORTFORWARDER_H
+#include <QObject>
+#include <QList>
+#include <QHostAddress>
+#include <QTcpServer>
+#include <QAtomicInt>
+#include <QHash>
+#include <QMutex>
+#include <QElapsedTimer>
+
+class PortForwarder : public QObject
+{
+    Q_OBJECT
+
+public:
+    enum Policy {RoundRobin, LeastActive, Weighted};
+
+    PortForwarder(QObject *parent = 0);
+    ~PortForwarder();
+
+    //can be read from any thread
+    inline int activeConnections() const { return m_active.load(); }
+    int activeConnections(quint16 targetPort) const;
+    inline bool isListening() const { return server->isListening(); }
+    //connections raced over two targets, and races the second target won
+    inline int hedgedConnections() const { return m_hedged.load(); }
+    inline int hedgeWins() const { return m_hedgeWins.load(); }
+    //whether several forwarders can listen on the same port, the kernel then spreads the connections
+    static bool canSharePort();
+
+public slots:
+    //the slots below must be invoked in the forwarder's thread
+    bool listen(const QHostAddress &addr, quint16 port, bool shared = false);
+    void close();
+    void setTargets(const QList<quint16> &ports);
+    void setPolicy(int policy);
+    void setWeights(const QHash<quint16, int> &weights);
+    void setHedging(int budgetPercent);
+
+signals:
+    void info(const QString &);
+    void targetsChanged();
+
+private:
+    QTcpServer *server;
+    QList<quint16> targets;
+    int next;
+    Policy m_policy;
+    QHash<quint16, int> m_weights;
+    QHash<quint16, int> currentWeights;//smooth weighted round-robin state
+    QHash<quint16, int> refused;//connections refused in a row
+    QHash<quint16, QElapsedTimer> ejected;
+    int hedgeBudget;//percent
+    double hedgeTokens;
+    QAtomicInt m_active;
+    QAtomicInt m_hedged;
+    QAtomicInt m_hedgeWins;
+    mutable QMutex countMutex;
+    QHash<quint16, int> targetActive;
+
+    bool listenShared(const QHostAddress &addr, quint16 port, QString *error);
+    void addActive(quint16 targetPort, int delta);
+    bool isEjected(quint16 targetPort);
+    quint16 pick(quint16 except = 0, bool advance = true);
+    void onUpstreamConnected(quint16 targetPort);
+    void onUpstreamRefused(quint16 targetPort);
+
+    friend class ForwardedConnection;
+    friend class HedgedConnection;
+
+private slots:
+    void onNewConnection();
+};
+
+#endif // PORTFORWARDER_H
@@ -0,0 +1,88 @@
+#include "readinessprobe.h"
+
+ReadinessProbe::ReadinessProbe(QObject *parent) :
+    QObject(parent),
+    m_port(0),
+    m_timeout(10000),
+    active(false)
+{
+    socket = new QTcpSocket(this);
+    retryTimer.setSingleShot(true);
+    deadline.setSingleShot(true);
+    connect(&retryTimer, &QTimer::timeout, this, &ReadinessProbe::attempt);
+    connect(&deadline, &QTimer::timeout, this, &ReadinessProbe::onDeadline);
+    connect(socket, &QTcpSocket::connected, this, &ReadinessProbe::onConnected);
+    connect(socket, &QTcpSocket::readyRead, this, &ReadinessProbe::onReadyRead);
+    connect(socket, static_cast<void (QTcpSocket::*)(QAbstractSocket::SocketError)>(&QTcpSocket::error), this, &ReadinessProbe::onError);
+}
+
+void ReadinessProbe::start(const QHostAddress &addr, quint16 port, int timeout, int interval)
+{
+    stop();
+    //a wildcard listening address is reachable through loopback
+    m_addr = (addr == QHostAddress::Any || addr == QHostAddress::AnyIPv4) ? QHostAddress(QHostAddress::LocalHost) : addr;
+    m_port = port;
+    m_timeout = timeout;
+    retryTimer.setInterval(interval);
+    lastError.clear();
+    active = true;
+    clock.start();
+    deadline.start(m_timeout);
+    attempt();
+}
+
+void ReadinessProbe::stop()
+{
+    active = false;
+    retryTimer.stop();
+    deadline.stop();
+    socket->abort();
+}
+
+void ReadinessProbe::attempt()
+{
+    if (!active) {
+        return;
+    }
+    socket->abort();
+    socket->connectToHost(m_addr, m_port);
+}
+
+void ReadinessProbe::onDeadline()
+{
+    stop();
+    emit failed(tr("Local port %1 is not ready after %2 ms. %3").arg(m_port).arg(m_timeout).arg(lastError));
+}
+
+void ReadinessProbe::onConnected()
+{
+    //SOCKS5 greeting: version 5, one method, no authentication
+    static const char greeting[] = {0x05, 0x01, 0x00};
+    socket->write(greeting, sizeof(greeting));
+}
+
+void ReadinessProbe::onReadyRead()
+{
+    if (socket->bytesAvailable() < 2) {
+        return;
+    }
+    QByteArray reply = socket->read(2);
+    if (reply.at(0) == 0x05 && reply.at(1) == 0x00) {
+        qint64 elapsed = clock.elapsed();
+        stop();
+        emit ready(elapsed);
+    }
+    else {
+        stop();
+        emit failed(tr("Local port %1 answered the SOCKS5 greeting with an unexpected reply.").arg(m_port));
+    }
+}
+
+void ReadinessProbe::onError()
+{
+    if (!active) {
+        return;
+    }
+    lastError = socket->errorString();
+    retryTimer.start();
+}
@@ -0,0 +1,50 @@
+/*
+ * Readiness Probe Class
+ *
+ * Polls a local SOCKS5 port until it accepts a connection and answers
+ * the SOCKS5 greeting, without blocking the event loop.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef READINESSPROBE_H
+#define READINESSPROBE_H
+#include <QObject>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QElapsedTimer>
+#include <QHostAddress>
+
+class ReadinessProbe : public QObject
+{
+    Q_OBJECT
+
+public:
+    ReadinessProbe(QObject *parent = 0);
+    void start(const QHostAddress &addr, quint16 port, int timeout = 10000, int interval = 50);
+    void stop();
+    inline bool isActive() const { return active; }
+
+signals:
+    void ready(qint64 elapsed);
+    void failed(const QString &reason);
+
+private:
+    QTcpSocket *socket;
+    QTimer retryTimer;
+    QTimer deadline;
+    QElapsedTimer clock;
+    QHostAddress m_addr;
+    quint16 m_port;
+    int m_timeout;
+    bool active;
+    QString lastError;
+
+private slots:
+    void attempt();
+    void onDeadline();
+    void onConnected();
+    void onReadyRead();
+    void onError();
+};
+
+#endif // READINESSPROBE_H
@@ -0,0 +1,145 @@
+#include <QFile>
+#include <QList>
+#include <QByteArray>
+#include "socketaccounting.h"
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <unistd.h>
+#include <string.h>
+#include <linux/netlink.h>
+#include <linux/rtnetlink.h>
+#include <linux/sock_diag.h>
+#include <linux/inet_diag.h>
+#include <linux/tcp.h>
+#endif
+
+//TCP_ESTABLISHED in the kernel's socket state numbering
+static const int ESTABLISHED = 1;
+
+SocketAccounting::SocketAccounting() :
+    m_byteCounters(false)
+{}
+
+void SocketAccounting::sample(const QSet<quint16> &ports)
+{
+    m_established.clear();
+    m_sockets.clear();
+    if (ports.isEmpty()) {
+        return;
+    }
+    /*
+     * Backends are children sharing our network namespace,
+     * so /proc/self/net shows their sockets as well as ours.
+     */
+    readProcNet("/proc/self/net/tcp", ports);
+    readProcNet("/proc/self/net/tcp6", ports);
+#ifdef Q_OS_LINUX
+    m_byteCounters = dumpTcpInfo(AF_INET, ports);
+    m_byteCounters = dumpTcpInfo(AF_INET6, ports) && m_byteCounters;
+#endif
+}
+
+/*
+ * Each line is "sl local_address rem_address st ..." with the local
+ * address written as hex IP, colon, hex port.
+ */
+void SocketAccounting::readProcNet(const QString &file, const QSet<quint16> &ports)
+{
+    QFile f(file);
+    if (!f.open(QIODevice::ReadOnly)) {
+        return;
+    }
+    f.readLine();//header
+    while (!f.atEnd()) {
+        QList<QByteArray> fields = f.readLine().simplified().split(' ');
+        if (fields.size() < 4 || fields[3].toInt(NULL, 16) != ESTABLISHED) {
+            continue;
+        }
+        int colon = fields[1].lastIndexOf(':');
+        quint16 port = static_cast<quint16>(fields[1].mid(colon + 1).toUInt(NULL, 16));
+        if (ports.contains(port)) {
+            ++m_established[port];
+        }
+    }
+}
+
+bool SocketAccounting::dumpTcpInfo(int family, const QSet<quint16> &ports)
+{
+#ifdef Q_OS_LINUX
+    int fd = socket(AF_NETLINK, SOCK_DGRAM | SOCK_CLOEXEC, NETLINK_SOCK_DIAG);
+    if (fd < 0) {
+        return false;
+    }
+
+    struct {
+        nlmsghdr nlh;
+        inet_diag_req_v2 r;
+    } req;
+    memset(&req, 0, sizeof(req));
+    req.nlh.nlmsg_len = sizeof(req);
+    req.nlh.nlmsg_type = SOCK_DIAG_BY_FAMILY;
+    req.nlh.nlmsg_flags = NLM_F_REQUEST | NLM_F_DUMP;
+    req.r.sdiag_family = family;
+    req.r.sdiag_protocol = IPPROTO_TCP;
+    req.r.idiag_states = 1 << ESTABLISHED;
+    req.r.idiag_ext = 1 << (INET_DIAG_INFO - 1);
+
+    sockaddr_nl kernel;
+    memset(&kernel, 0, sizeof(kernel));
+    kernel.nl_family = AF_NETLINK;
+    if (sendto(fd, &req, sizeof(req), 0, reinterpret_cast<sockaddr *>(&kernel), sizeof(kernel)) < 0) {
+        close(fd);
+        return false;
+    }
+
+    char buf[32768];
+    bool ok = false;
+    bool done = false;
+    while (!done) {
+        ssize_t n = recv(fd, buf, sizeof(buf), 0);
+        if (n <= 0) {
+            break;
+        }
+        for (nlmsghdr *h = reinterpret_cast<nlmsghdr *>(buf); NLMSG_OK(h, n); h = NLMSG_NEXT(h, n)) {
+            if (h->nlmsg_type == NLMSG_DONE) {
+                ok = true;
+                done = true;
+                break;
+            }
+            if (h->nlmsg_type == NLMSG_ERROR) {
+                done = true;
+                break;
+            }
+            inet_diag_msg *m = static_cast<inet_diag_msg *>(NLMSG_DATA(h));
+            quint16 port = ntohs(m->id.idiag_sport);
+            if (!ports.contains(port)) {
+                continue;
+            }
+            int len = h->nlmsg_len - NLMSG_LENGTH(sizeof(*m));
+            for (rtattr *a = reinterpret_cast<rtattr *>(m + 1); RTA_OK(a, len); a = RTA_NEXT(a, len)) {
+                if (a->rta_type != INET_DIAG_INFO) {
+                    continue;
+                }
+                //older kernels send a shorter tcp_info, the missing counters read as zero
+                tcp_info info;
+                memset(&info, 0, sizeof(info));
+                size_t size = qMin(static_cast<size_t>(RTA_PAYLOAD(a)), sizeof(info));
+                memcpy(&info, RTA_DATA(a), size);
+                Socket s;
+                s.port = port;
+                s.received = info.tcpi_bytes_received;
+                s.acked = info.tcpi_bytes_acked;
+                m_sockets.insert(m->idiag_inode, s);
+            }
+        }
+    }
+    close(fd);
+    return ok;
+#else
+    Q_UNUSED(family);
+    Q_UNUSED(ports);
+    return false;
+#endif
+}
@@ -0,0 +1,44 @@
+/*
+ * Socket Accounting Class
+ *
+ * One snapshot of the established TCP sockets on a set of local ports.
+ * Connection counts come from /proc/net/tcp and tcp6, byte counters from
+ * the kernel's per-socket TCP info (sock_diag), which also covers sockets
+ * owned by external backends. Both are Linux only; elsewhere the snapshot
+ * stays empty.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef SOCKETACCOUNTING_H
+#define SOCKETACCOUNTING_H
+#include <QHash>
+#include <QSet>
+#include <QString>
+
+class SocketAccounting
+{
+public:
+    struct Socket
+    {
+        quint16 port;
+        quint64 received;//bytes the peer sent to this socket
+        quint64 acked;//bytes this socket sent and got acknowledged
+    };
+
+    SocketAccounting();
+
+    void sample(const QSet<quint16> &ports);
+    inline int established(quint16 port) const { return m_established.value(port); }
+    inline const QHash<quint64, Socket> &sockets() const { return m_sockets; }
+    inline bool hasByteCounters() const { return m_byteCounters; }
+
+private:
+    QHash<quint16, int> m_established;
+    QHash<quint64, Socket> m_sockets;//keyed by socket inode
+    bool m_byteCounters;
+
+    void readProcNet(const QString &file, const QSet<quint16> &ports);
+    bool dumpTcpInfo(int family, const QSet<quint16> &ports);
+};
+
+#endif // SOCKETACCOUNTING_H
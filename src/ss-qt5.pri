@@ -1,6 +1,12 @@
 SOURCES      += src/main.cpp\
                 src/mainwindow.cpp \
                 src/ss_process.cpp \
+                src/backendmanager.cpp \
+                src/hotstandby.cpp \
+                src/frontedgroup.cpp \
+                src/eventloopmonitor.cpp \
+                src/portforwarder.cpp \
+                src/readinessprobe.cpp \
                 src/ip4validator.cpp \
                 src/portvalidator.cpp \
                 src/addprofiledialogue.cpp \
@@ -8,10 +14,34 @@ SOURCES      += src/main.cpp\
                 src/ssprofile.cpp \
                 src/configuration.cpp \
                 src/qrwidget.cpp \
-                src/sharedialogue.cpp
+                src/sharedialogue.cpp \
+                src/backendregistry.cpp \
+                src/cipherbenchmark.cpp \
+                src/backendcapabilities.cpp \
+                src/socketaccounting.cpp \
+                src/trafficmeter.cpp \
+                src/metricsserver.cpp \
+                src/daemon.cpp \
+                src/latencytester.cpp \
+                src/fastestselector.cpp \
+                src/failoverchain.cpp \
+                src/loadbalancer.cpp \
+                src/hostresolver.cpp \
+                src/logbuffer.cpp \
+                src/outputreader.cpp \
+                src/lineassembler.cpp \
+                src/logparser.cpp \
+                src/logwriter.cpp \
+                src/logfilter.cpp
 
 HEADERS      += src/mainwindow.h \
                 src/ss_process.h \
+                src/backendmanager.h \
+                src/hotstandby.h \
+                src/frontedgroup.h \
+                src/eventloopmonitor.h \
+                src/portforwarder.h \
+                src/readinessprobe.h \
                 src/ssprofile.h \
                 src/ip4validator.h \
                 src/portvalidator.h \
@@ -19,7 +49,25 @@ HEADERS      += src/mainwindow.h \
                 src/ssvalidator.h \
                 src/configuration.h \
                 src/qrwidget.h \
-                src/sharedialogue.h
+                src/sharedialogue.h \
+                src/backendregistry.h \
+                src/cipherbenchmark.h \
+                src/backendcapabilities.h \
+                src/socketaccounting.h \
+                src/trafficmeter.h \
+                src/metricsserver.h \
+                src/daemon.h \
+                src/latencytester.h \
+                src/fastestselector.h \
+                src/failoverchain.h \
+                src/loadbalancer.h \
+                src/hostresolver.h \
+                src/logbuffer.h \
+                src/outputreader.h \
+                src/lineassembler.h \
+                src/logparser.h \
+                src/logwriter.h \
+                src/logfilter.h
 
 FORMS        += src/mainwindow.ui \
                 src/addprofiledialogue.ui \
@@ -52,11 +100,11 @@ win32: {
                     -L$$top_srcdir/3rdparty/zbar/mingw32
         }
     }
-    LIBS += -L./ -lqrencode -lQtShadowsocks -lbotan-$$BOTAN_VER -lzbar -liconv
+    LIBS += -L./ -lqrencode -lQtShadowsocks -lbotan-$$BOTAN_VER -lzbar -liconv -lz
 }
 unix : {
     CONFIG    += link_pkgconfig
-    PKGCONFIG += libqrencode QtShadowsocks botan-$$BOTAN_VER zbar
+    PKGCONFIG += libqrencode QtShadowsocks botan-$$BOTAN_VER zbar zlib
     contains(DEFINES, UBUNTU_UNITY): {
         PKGCONFIG += gtk+-2.0 appindicator-0.1
     }
@@ -1,42 +1,250 @@
 #include <QDebug>
 #include <QFileInfo>
 #include <QDir>
+#include <QTimer>
+#include <QFile>
+#include <QTcpServer>
+#include <QFutureWatcher>
+#include <QtConcurrent>
+#include <string.h>
 #include "ss_process.h"
+#include "backendregistry.h"
+#include "hostresolver.h"
+
+//from launch() on, whatever the backend type, including the server lookup
+static const int READY_TIMEOUT = 10000;
+
+//another process may take a spare loopback port before the backend binds it
+static const int SPARE_PORT_ATTEMPTS = 5;
+
+/*
+ * --mptcp only makes sense if the kernel speaks Multipath TCP,
+ * either the upstream implementation (5.6+) or the out-of-tree one.
+ */
+static bool kernelSupportsMptcp()
+{
+#ifdef Q_OS_LINUX
+    QStringList knobs = QStringList() << "/proc/sys/net/mptcp/enabled" << "/proc/sys/net/mptcp/mptcp_enabled";
+    for (QStringList::iterator it = knobs.begin(); it != knobs.end(); ++it) {
+        QFile knob(*it);
+        if (knob.open(QIODevice::ReadOnly) && knob.readAll().trimmed().toInt() > 0) {
+            return true;
+        }
+    }
+#endif
+    return false;
+}
 
 SS_Process::SS_Process(QObject *parent) :
     QObject(parent)
 {
+    m_state = Stopped;
+    m_readyLatency = -1;
+    localPort = 0;
+    awaitingServer = false;
+    m_debug = false;
+    sparePort = false;
+    portRetries = 0;
+    autoRestart = false;
+    restartDelay = 100;
+    restartMaxDelay = 30000;
+    restartLimit = 5;
+    consecutiveFailures = 0;
+    m_restartCount = 0;
+    m_totalDowntime = 0;
+    m_lastRecovery = -1;
+    expectingExit = false;
+    launchGeneration = 0;
+    restartTimer.setSingleShot(true);
+    connect(&restartTimer, &QTimer::timeout, this, &SS_Process::onRestartTimeout);
+    readyDeadline.setSingleShot(true);
+    connect(&readyDeadline, &QTimer::timeout, this, &SS_Process::onReadyDeadline);
     libQSS = false;
-    qssController = new QSS::Controller(true, this);
+    qssRunning = 0;
+    qssGeneration = 0;
+    qssStopping = 0;
+    qssStoppingCount = 0;
+    qssWorkers = 1;
     proc.setProcessChannelMode(QProcess::MergedChannels);
+    reader = NULL;
+    parser = LogParser::forBackend(SSProfile::UNKNOWN);
+    memset(eventCounts, 0, sizeof(eventCounts));
+    drainTimer.setInterval(50);
+    connect(&drainTimer, &QTimer::timeout, this, &SS_Process::drainOutput);
+
+    /*
+     * libQtShadowsocks relays on its own threads, so that GUI work
+     * (repaints, dialogues, log appends) never delays proxied connections.
+     * Every signal from the controllers is therefore a queued connection.
+     * The first worker always exists, more are added on demand.
+     */
+    addQSSWorker();
+    //if the workers' forwarders can't share the local port, this one relays for all of them
+    //on a thread of its own, so that no worker copies the bytes of the others on top of its cipher work
+    forwarder = new PortForwarder;
+    forwarder->moveToThread(&forwarderThread);
+    connect(&forwarderThread, &QThread::finished, forwarder, &QObject::deleteLater);
+    connect(forwarder, &PortForwarder::info, this, &SS_Process::onQSSInfoReady);
 
-    connect(qssController, &QSS::Controller::runningStateChanged, [&] (bool running) {
-        if (running) {
-            emit processStarted();
-        }
-        else {
-            emit processStopped();
-            disconnect(qssController, &QSS::Controller::debug, this, &SS_Process::onQSSInfoReady);
-            disconnect(qssController, &QSS::Controller::info, this, &SS_Process::onQSSInfoReady);
-        }
-    });
     connect(&proc, &QProcess::readyRead, this, &SS_Process::onProcessReadyRead);
     connect(&proc, &QProcess::started, this, &SS_Process::onStarted);
     connect(&proc, static_cast<void (QProcess::*)(int)>(&QProcess::finished), this, &SS_Process::onExited);
+    connect(&proc, static_cast<void (QProcess::*)(QProcess::ProcessError)>(&QProcess::error), this, &SS_Process::onProcessError);
+    connect(&probe, &ReadinessProbe::ready, this, &SS_Process::onReady);
+    connect(&probe, &ReadinessProbe::failed, this, &SS_Process::fail);
+    connect(HostResolver::instance(), &HostResolver::resolved, this, &SS_Process::onServerResolved);
 }
 
+SS_Process::~SS_Process()
+{
+    delete reader;
+    //objects living in a thread are deleted there once it finishes
+    if (forwarderThread.isRunning()) {
+        forwarderThread.quit();
+        forwarderThread.wait();
+    }
+    else {
+        delete forwarder;
+    }
+    for (int i = 0; i < qssThreads.size(); ++i) {
+        if (qssThreads[i]->isRunning()) {
+            qssThreads[i]->quit();
+            qssThreads[i]->wait();
+        }
+        else {
+            delete qssControllers[i];
+            delete qssMonitors[i];
+            delete qssForwarders[i];
+        }
+    }
+}
+
+void SS_Process::addQSSWorker()
+{
+    QThread *t = new QThread(this);
+    QSS::Controller *c = new QSS::Controller(true);
+    c->moveToThread(t);
+    EventLoopMonitor *m = new EventLoopMonitor;
+    m->moveToThread(t);
+    PortForwarder *f = new PortForwarder;
+    f->moveToThread(t);
+    connect(t, &QThread::finished, c, &QObject::deleteLater);
+    connect(t, &QThread::finished, m, &QObject::deleteLater);
+    connect(t, &QThread::finished, f, &QObject::deleteLater);
+    connect(f, &PortForwarder::info, this, &SS_Process::onQSSInfoReady);
+    connect(t, &QThread::started, m, &EventLoopMonitor::start);
+    /*
+     * Tagged in the worker thread with the launch the controller was
+     * started for, since a restart queues stop() and start() behind each
+     * other and the old run's state change arrives after the new launch.
+     */
+    connect(c, &QSS::Controller::runningStateChanged, c, [this, c] (bool running) {
+        quint32 generation = c->property("launchGeneration").toUInt();
+        quint16 port = c->property("workerPort").toUInt();
+        QMetaObject::invokeMethod(this, "onQSSRunningStateChanged", Qt::QueuedConnection, Q_ARG(quint32, generation), Q_ARG(bool, running), Q_ARG(quint16, port));
+    }, Qt::DirectConnection);
+    //emitted for every relayed chunk, so counted right in the worker thread
+    TrafficMeter *meter = &traffic;
+    connect(c, &QSS::Controller::newBytesSent, [meter] (const quint64 &n) { meter->addUp(n); });
+    connect(c, &QSS::Controller::newBytesReceived, [meter] (const quint64 &n) { meter->addDown(n); });
+
+    qssThreads << t;
+    qssControllers << c;
+    qssMonitors << m;
+    qssForwarders << f;
+}
+
+quint16 SS_Process::freeLoopbackPort()
+{
+    QTcpServer s;
+    s.listen(QHostAddress::LocalHost, 0);
+    return s.serverPort();
+}
+
+void SS_Process::setRestartPolicy(bool enabled, int delay, int maxDelay, int limit)
+{
+    autoRestart = enabled;
+    restartDelay = qMax(1, delay);
+    restartMaxDelay = qMax(restartDelay, maxDelay);
+    restartLimit = qMax(1, limit);
+}
+
+/*
+ * The profile is copied, so that a supervised restart uses the exact
+ * settings the user started, not whatever is being edited in the GUI.
+ */
 void SS_Process::start(SSProfile * const p, bool debug)
 {
+    begin(p, debug, false);
+}
+
+void SS_Process::startOnSparePort(SSProfile * const p, bool debug)
+{
+    SSProfile copy = *p;
+    copy.local_addr = QString("127.0.0.1");
+    copy.local_port = QString::number(freeLoopbackPort());
+    begin(&copy, debug, true);
+}
+
+void SS_Process::begin(SSProfile * const p, bool debug, bool spare)
+{
+    stop();
+    m_profile = *p;
+    m_debug = debug;
+    sparePort = spare;
+    portRetries = 0;
+    traffic.reset();
+    memset(eventCounts, 0, sizeof(eventCounts));
+    consecutiveFailures = 0;
+    restartTimes.clear();
+    launch();
+}
+
+void SS_Process::launch()
+{
+    SSProfile * const p = &m_profile;
     app_path = p->backend;
     backendType = p->getBackendType();
-    stop();
+    parser = LogParser::forBackend(backendType);
+    assembler.clear();
+
+    /*
+     * Nothing below blocks. The backend is reported as started only once
+     * the readiness probe got a SOCKS5 answer from the local port.
+     * If the server name isn't resolved yet, the backend is launched once
+     * it is, and the lookup counts towards the ready latency.
+     */
+    typeName = p->type;
+    localAddr = QHostAddress(p->local_addr);
+    localPort = p->local_port.toUShort();
+    m_readyLatency = -1;
+    ++launchGeneration;
+    spawnClock.start();
+    readyDeadline.start(READY_TIMEOUT);
+    setState(Starting);
+    awaitingServer = !HostResolver::instance()->pin(p->server, &serverAddr);
+    if (!awaitingServer) {
+        launchBackend();
+    }
+}
+
+void SS_Process::launchBackend()
+{
+    SSProfile * const p = &m_profile;
+    bool debug = m_debug;
     if (backendType == SSProfile::LIBQSS) {
         libQSS = true;
         startQSS(p, debug);
     }
     else {
         libQSS = false;
-        start(p->server, p->password, p->server_port, p->local_addr, p->local_port, p->method, p->timeout, p->custom_arg, debug, p->fast_open);
+        BackendCapabilities caps;
+        if (BackendRegistry::instance()->capabilities(app_path, &caps)) {
+            startExternal(caps);
+        }
+        else {
+            probeCapabilities();
+        }
     }
 }
 
@@ -48,7 +256,6 @@ void SS_Process::start(QString &args)
     sslocalbin = QString("\"") + QDir::toNativeSeparators(sslocalbin) + QString("\"");
     switch (backendType) {
     case SSProfile::LIBEV:
-        args.append(" -u");
     case SSProfile::GO:
         proc.setProgram(app_path);
         break;
@@ -64,38 +271,139 @@ void SS_Process::start(QString &args)
         break;
     default:
         qWarning() << tr("Aborted: Invalid Backend Type.") << backendType;
+        fail(tr("Aborted: Invalid Backend Type."));
         return;
     }
     proc.setNativeArguments(args);
     proc.start();
 #else
+    startReader();
     proc.start(app_path + QString(" ") + args);
+    if (reader) {
+        //the child has its copy once start() returned
+        reader->closeWriteEnd();
+    }
 #endif
-    qDebug() << tr("Backend arguments are ") << args;
-    proc.waitForStarted(1000);//wait for at most 1 second
+    //the log may go to a file, which must not get the password
+    QString shown = args;
+    if (!m_profile.password.isEmpty()) {
+        shown.replace(QString(" -k \"") + m_profile.password + QString("\""), QString(" -k \"********\""));
+    }
+    qDebug() << tr("Backend arguments are ") << shown;
 }
 
+/*
+ * With more than one worker, every controller listens on its own loopback port
+ * and connections on the profile's local port are spread across them.
+ * The cipher work, which dominates relaying, then runs on several cores.
+ * Where forwarders can share a port, every worker has its own one in its
+ * thread, relaying only to that worker, and the kernel spreads the
+ * connections. Otherwise a single forwarder relays for all of them.
+ */
 void SS_Process::startQSS(SSProfile * const p, bool debug)
 {
-    connect(qssController, debug ? &QSS::Controller::debug : &QSS::Controller::info, this, &SS_Process::onQSSInfoReady, Qt::DirectConnection);
-    qssController->setup(p->getQSSProfile());
-    qssController->start();
+    qssWorkers = qMax(1, p->workers);
+    while (qssControllers.size() < qssWorkers) {
+        addQSSWorker();
+    }
+
+    QSS::Profile qp = p->getQSSProfile();
+    qp.server = serverHost();
+    const bool spread = qssWorkers > 1;
+    const bool shared = spread && PortForwarder::canSharePort();
+    if (spread) {
+        qp.local_address = QString("127.0.0.1");
+    }
+    QHostAddress addr(p->local_addr);
+    quint16 port = p->local_port.toUShort();
+    qssRunning = 0;
+    qssPorts.clear();
+    qssGeneration = launchGeneration;
+    const quint32 generation = qssGeneration;
+
+    for (int i = 0; i < qssWorkers; ++i) {
+        QSS::Controller *c = qssControllers[i];
+        //a previous run may not have disconnected yet
+        disconnect(c, &QSS::Controller::debug, this, &SS_Process::onQSSInfoReady);
+        disconnect(c, &QSS::Controller::info, this, &SS_Process::onQSSInfoReady);
+        connect(c, debug ? &QSS::Controller::debug : &QSS::Controller::info, this, &SS_Process::onQSSInfoReady);
+        if (!qssThreads[i]->isRunning()) {
+            qssThreads[i]->setObjectName(QString("libQSS-%1-%2").arg(p->profileName).arg(i));
+            qssThreads[i]->start();
+        }
+
+        /*
+         * setup() and start() have to run in the controller's thread.
+         * A spare port taken by someone else in the meantime isn't a crash
+         * of the backend, so the worker simply tries another one.
+         */
+        PortForwarder *f = shared ? qssForwarders[i] : NULL;
+        const bool retry = spread || sparePort;
+        QTimer::singleShot(0, c, [c, f, qp, spread, retry, addr, port, generation] {
+            c->setProperty("launchGeneration", generation);
+            QSS::Profile wp = qp;
+            bool started = false;
+            for (int attempt = 0; attempt < (retry ? SPARE_PORT_ATTEMPTS : 1) && !started; ++attempt) {
+                if (spread || attempt > 0) {
+                    wp.local_port = freeLoopbackPort();
+                }
+                c->setProperty("workerPort", wp.local_port);
+                c->setup(wp);
+                started = c->start();
+            }
+            if (started && f) {
+                f->setTargets(QList<quint16>() << wp.local_port);
+                f->listen(addr, port, true);
+            }
+        });
+    }
+
+    if (spread && !shared && !forwarderThread.isRunning()) {
+        forwarderThread.setObjectName(QString("libQSS-%1-forwarder").arg(p->profileName));
+        forwarderThread.start();
+    }
+}
+
+/*
+ * A binary seen for the first time is probed on a pool thread and launched
+ * once its capabilities are known. It stays Starting in the meantime.
+ */
+void SS_Process::probeCapabilities()
+{
+    qDebug() << tr("Probing capabilities of ") << app_path;
+    QFutureWatcher<BackendCapabilities> *watcher = new QFutureWatcher<BackendCapabilities>(this);
+    const quint32 generation = launchGeneration;
+    const QString path = app_path;
+    connect(watcher, &QFutureWatcher<BackendCapabilities>::finished, this, [this, watcher, generation, path] {
+        BackendCapabilities caps = watcher->result();
+        watcher->deleteLater();
+        BackendRegistry::instance()->storeCapabilities(path, caps);
+        if (generation == launchGeneration && m_state == Starting) {
+            startExternal(caps);
+        }
+    });
+    watcher->setFuture(QtConcurrent::run(&BackendCapabilities::probe, app_path, backendType));
 }
 
-void SS_Process::start(const QString &server, const QString &pwd, const QString &s_port, const QString &l_addr, const QString &l_port, const QString &method, const QString &timeout, const QString &custom_arg, bool debug, bool tfo)
+/*
+ * Every performance option the binary offers is turned on, unless the
+ * custom arguments already mention it. TCP Fast Open stays per profile.
+ */
+void SS_Process::startExternal(const BackendCapabilities &caps)
 {
+    const SSProfile * const p = &m_profile;
     QString args;
-    args.append(QString(" -s ") + server);
-    args.append(QString(" -p ") + s_port);
-    args.append(QString(" -b ") + l_addr);
-    args.append(QString(" -l ") + l_port);
-    args.append(QString(" -k \"") + pwd + QString("\""));
-    args.append(QString(" -m ") + method.toLower());
-    if (backendType != SSProfile::GO) {//go port doesn't support this argument
-        args.append(QString(" -t ") + timeout);
+    args.append(QString(" -s ") + serverHost());
+    args.append(QString(" -p ") + p->server_port);
+    args.append(QString(" -b ") + p->local_addr);
+    args.append(QString(" -l ") + p->local_port);
+    args.append(QString(" -k \"") + p->password + QString("\""));
+    args.append(QString(" -m ") + p->method.toLower());
+    if (caps.timeout) {
+        args.append(QString(" -t ") + p->timeout);
     }
 
-    if (debug) {
+    if (m_debug) {
         if(backendType == SSProfile::GO) {
             args.append(" -d=true");
         }
@@ -104,46 +412,431 @@ void SS_Process::start(const QString &server, const QString &pwd, const QString
         }
     }
 
-#ifdef Q_OS_LINUX
-    if ((backendType == SSProfile::PYTHON || backendType == SSProfile::LIBEV) && tfo) {//only python and libev ports support tfo
-        args.append(" --fast-open");
+    if (!caps.supportsCipher(p->method)) {
+        emit processRead(tr("%1 doesn't list %2 as a supported method.").arg(app_path).arg(p->method.toLower()).toLocal8Bit());
+    }
+
+    QStringList options;
+    if (caps.udpRelay) {
+        options << "-u";
+    }
+    if (caps.fastOpen && p->fast_open) {
+        options << "--fast-open";
+    }
+    if (caps.reusePort) {
+        options << "--reuse-port";
+    }
+    if (caps.noDelay) {
+        options << "--no-delay";
+    }
+    if (caps.mptcp && kernelSupportsMptcp()) {
+        options << "--mptcp";
+    }
+    QStringList custom = p->custom_arg.split(' ', QString::SkipEmptyParts);
+    for (QStringList::iterator it = options.begin(); it != options.end(); ++it) {
+        if (!custom.contains(*it)) {
+            args.append(" ").append(*it);
+        }
     }
-#else
-    Q_UNUSED(tfo);
-#endif
 
-    args.append(" ").append(custom_arg);
+    args.append(" ").append(p->custom_arg);
     start(args);
 }
 
 void SS_Process::stop()
 {
+    ++launchGeneration;
+    awaitingServer = false;
+    restartTimer.stop();
+    downtimeClock.invalidate();
+    uptimeClock.invalidate();
+    if (m_state != Stopped && m_state != Failed) {
+        setState(Stopped);
+    }
+    stopBackend();
+}
+
+void SS_Process::stopBackend()
+{
+    probe.stop();
+    readyDeadline.stop();
     if (libQSS) {
-        qssController->stop();
+        qssStopping = qssGeneration;
+        qssStoppingCount = qssRunning;
+        qssRunning = 0;
+        for (int i = 0; i < qssWorkers; ++i) {
+            QSS::Controller *c = qssControllers[i];
+            QTimer::singleShot(0, c, [c] { c->stop(); });
+        }
+        if (qssWorkers > 1) {
+            for (int i = 0; i < qssWorkers; ++i) {
+                PortForwarder *f = qssForwarders[i];
+                QTimer::singleShot(0, f, [f] { f->close(); });
+            }
+            PortForwarder *f = forwarder;
+            QTimer::singleShot(0, f, [f] { f->close(); });
+        }
     }
     else if (proc.isOpen()) {
+        expectingExit = true;
         proc.close();
+        expectingExit = false;
     }
 }
 
+void SS_Process::sampleTraffic(const SocketAccounting &accounting)
+{
+    if (isRunning()) {
+        traffic.update(accounting, localPort, !libQSS);
+    }
+}
+
+bool SS_Process::isRunning() const
+{
+    return m_state == Starting || m_state == Ready || m_state == Restarting;
+}
+
+void SS_Process::setState(State s)
+{
+    if (m_state != s) {
+        m_state = s;
+        emit stateChanged(s);
+    }
+}
+
+void SS_Process::fail(const QString &reason)
+{
+    emit processRead(reason.toLocal8Bit());
+    bool wasStarting = m_state == Starting;
+    stopBackend();
+    if (!(wasStarting && scheduleRestart())) {
+        stop();
+        setState(Failed);
+    }
+}
+
+/*
+ * Exponential back-off: restartDelay, 2x, 4x ... capped at restartMaxDelay.
+ * The back-off resets once the backend has stayed up for 10 seconds.
+ * Reaching restartLimit restarts within a minute is a crash loop.
+ */
+bool SS_Process::scheduleRestart()
+{
+    if (!autoRestart) {
+        return false;
+    }
+    if (uptimeClock.isValid() && uptimeClock.elapsed() > 10000) {
+        consecutiveFailures = 0;
+    }
+    uptimeClock.invalidate();
+    if (!downtimeClock.isValid()) {
+        downtimeClock.start();
+    }
+
+    QElapsedTimer now;
+    now.start();
+    while (!restartTimes.isEmpty() && now.msecsSinceReference() - restartTimes.first() > 60000) {
+        restartTimes.removeFirst();
+    }
+    if (restartTimes.size() >= restartLimit) {
+        emit processRead(tr("%1 restarted %2 times within a minute. Giving up.").arg(typeName).arg(restartTimes.size()).toLocal8Bit());
+        setState(CrashLoop);
+        return true;
+    }
+
+    //shifted in 64 bits, a large restartDelay would overflow int well before 2^16
+    int delay = restartMaxDelay;
+    if (consecutiveFailures < 32) {
+        delay = static_cast<int>(qMin(static_cast<qint64>(restartDelay) << consecutiveFailures, static_cast<qint64>(restartMaxDelay)));
+    }
+    ++consecutiveFailures;
+    emit processRead(tr("Restarting %1 in %2 ms.").arg(typeName).arg(delay).toLocal8Bit());
+    setState(Restarting);
+    restartTimer.start(delay);
+    return true;
+}
+
+/*
+ * Another program can take a spare port between choosing and binding it.
+ * That isn't a crash, so the backend is launched again on another port
+ * without the supervisor's back-off. A port that is free now was not it.
+ */
+bool SS_Process::retryOnAnotherPort()
+{
+    if (!sparePort || portRetries >= SPARE_PORT_ATTEMPTS) {
+        return false;
+    }
+    QTcpServer s;
+    if (s.listen(localAddr, localPort)) {
+        return false;
+    }
+    ++portRetries;
+    quint16 port = freeLoopbackPort();
+    emit processRead(tr("Port %1 is taken by another program, retrying %2 on port %3.").arg(localPort).arg(typeName).arg(port).toLocal8Bit());
+    m_profile.local_port = QString::number(port);
+    //not from within QProcess' own finished handling
+    const quint32 generation = launchGeneration;
+    QTimer::singleShot(0, this, [this, generation] {
+        if (generation == launchGeneration && m_state == Starting) {
+            launch();
+        }
+    });
+    return true;
+}
+
+void SS_Process::onRestartTimeout()
+{
+    QElapsedTimer now;
+    now.start();
+    restartTimes << now.msecsSinceReference();
+    ++m_restartCount;
+    launch();
+}
+
+QString SS_Process::serverHost() const
+{
+    return serverAddr.isNull() ? m_profile.server : serverAddr.toString();
+}
+
+/*
+ * A refresh keeps the pinned address while the name still resolves to it.
+ * If it doesn't anymore, a running backend would keep relaying to an
+ * address the name left, so it's launched again with the new one.
+ */
+void SS_Process::onServerResolved(const QString &host, bool ok)
+{
+    if (host != m_profile.server) {
+        return;
+    }
+    if (!awaitingServer) {
+        QHostAddress addr;
+        if (ok && !serverAddr.isNull() && (m_state == Starting || m_state == Ready)
+                && HostResolver::instance()->pin(host, &addr) && !addr.isNull() && addr != serverAddr) {
+            emit processRead(tr("%1 no longer resolves to %2, relaunching %3 with %4.").arg(host).arg(serverAddr.toString()).arg(typeName).arg(addr.toString()).toLocal8Bit());
+            stopBackend();
+            launch();
+        }
+        return;
+    }
+    awaitingServer = false;
+    if (ok) {
+        HostResolver::instance()->pin(host, &serverAddr);
+        emit processRead(tr("%1 resolved to %2 in %3 ms.").arg(host).arg(serverAddr.toString()).arg(spawnClock.elapsed()).toLocal8Bit());
+    }
+    else {
+        serverAddr = QHostAddress();
+        emit processRead(tr("Cannot resolve %1, leaving it to the backend.").arg(host).toLocal8Bit());
+    }
+    launchBackend();
+}
+
 void SS_Process::onProcessReadyRead()
 {
-    emit processRead(proc.readAll());
+    handleOutput(proc.readAll());
+}
+
+//output is passed on in whole lines only, each one counted by its event type
+void SS_Process::handleOutput(const QByteArray &data)
+{
+    handleLines(assembler.feed(data));
+}
+
+void SS_Process::handleLines(const QList<QByteArray> &lines)
+{
+    QByteArray out;
+    QVector<BackendEvent> events;
+    for (QList<QByteArray>::const_iterator it = lines.begin(); it != lines.end(); ++it) {
+        if (it->isEmpty()) {
+            continue;
+        }
+        //parsed once here, the log buffer takes the events along with the lines
+        BackendEvent e = parser->parse(*it);
+        ++eventCounts[e.type];
+        events << e;
+        out.append(*it).append('\n');
+    }
+    if (!out.isEmpty()) {
+        emit processRead(out, events);
+    }
+}
+
+/*
+ * The backend writes into a pipe drained by a reader thread, so a busy
+ * GUI thread can't fill the pipe and block the backend on its logging.
+ * Without a pipe of our own, QProcess reads the output as before.
+ */
+void SS_Process::startReader()
+{
+    retireReader();
+    reader = new OutputReader;
+    if (!reader->open()) {
+        delete reader;
+        reader = NULL;
+        proc.setOutputPipe(-1);
+        return;
+    }
+    proc.setOutputPipe(reader->writeEnd());
+    reader->start();
+    drainTimer.start();
+}
+
+//the reader of a previous launch finishes on its own, with what it read so far shown
+void SS_Process::retireReader()
+{
+    if (reader == NULL) {
+        return;
+    }
+    drainOutput();
+    handleLines(QList<QByteArray>() << assembler.takeRest());
+    if (reader == NULL) {
+        return;
+    }
+    OutputReader *r = reader;
+    reader = NULL;
+    drainTimer.stop();
+    r->requestStop();
+    connect(r, &QThread::finished, r, &QObject::deleteLater);
+    if (r->isFinished()) {
+        r->deleteLater();
+    }
+}
+
+void SS_Process::drainOutput()
+{
+    OutputReader *r = reader;
+    if (r == NULL) {
+        drainTimer.stop();
+        return;
+    }
+    //checked first, so that nothing it pushed before finishing is missed
+    bool finished = r->isFinished();
+    QByteArray out, chunk;
+    while (r->take(&chunk)) {
+        out.append(chunk);
+    }
+    int dropped = r->takeDropped();
+    handleOutput(out);
+    if (finished) {
+        handleLines(QList<QByteArray>() << assembler.takeRest());
+    }
+    if (dropped > 0) {
+        emit processRead(tr("%1 lines of backend output were dropped, the log couldn't keep up.").arg(dropped).toLocal8Bit());
+    }
+    if (finished && r == reader) {
+        reader = NULL;
+        drainTimer.stop();
+        delete r;
+    }
 }
 
 void SS_Process::onQSSInfoReady(const QString &s)
 {
-    emit processRead(s.toLocal8Bit());
+    handleLines(s.toLocal8Bit().split('\n'));
+}
+
+void SS_Process::onQSSRunningStateChanged(quint32 generation, bool running, quint16 port)
+{
+    if (generation != qssGeneration || (generation == qssStopping && !running)) {
+        //the stopped run winding down, which may already have been replaced
+        if (!running && generation == qssStopping && qssStoppingCount > 0 && --qssStoppingCount == 0 && !isRunning()) {
+            emit processStopped();
+            for (QList<QSS::Controller *>::iterator it = qssControllers.begin(); it != qssControllers.end(); ++it) {
+                disconnect(*it, &QSS::Controller::debug, this, &SS_Process::onQSSInfoReady);
+                disconnect(*it, &QSS::Controller::info, this, &SS_Process::onQSSInfoReady);
+            }
+        }
+        return;
+    }
+    if (running) {
+        qssPorts << port;
+        if (qssWorkers == 1 && port != localPort) {//moved off a taken spare port
+            localPort = port;
+            m_profile.local_port = QString::number(port);
+        }
+        if (++qssRunning == qssWorkers && m_state == Starting) {
+            if (qssWorkers > 1 && !PortForwarder::canSharePort()) {
+                PortForwarder *f = forwarder;
+                QList<quint16> ports = qssPorts;
+                QHostAddress addr = localAddr;
+                quint16 local = localPort;
+                QTimer::singleShot(0, f, [f, ports, addr, local] {
+                    f->setTargets(ports);
+                    f->listen(addr, local);
+                });
+            }
+            probe.start(localAddr, localPort);
+        }
+    }
+    else if (qssRunning > 0 && --qssRunning == 0) {
+        probe.stop();
+        if (m_state == Starting || m_state == Ready) {
+            setState(Stopped);
+        }
+        emit processStopped();
+        for (QList<QSS::Controller *>::iterator it = qssControllers.begin(); it != qssControllers.end(); ++it) {
+            disconnect(*it, &QSS::Controller::debug, this, &SS_Process::onQSSInfoReady);
+            disconnect(*it, &QSS::Controller::info, this, &SS_Process::onQSSInfoReady);
+        }
+    }
 }
 
 void SS_Process::onStarted()
 {
     qDebug() << tr("Backend started. PID: ") << proc.pid();
-    emit processStarted();
+    probe.start(localAddr, localPort);
 }
 
 void SS_Process::onExited(int e)
 {
     qDebug() << tr("Backend exited. Exit Code: ") << e;
+    probe.stop();
+    if (reader == NULL) {
+        handleLines(QList<QByteArray>() << assembler.takeRest());
+    }
+    if (!expectingExit && (m_state == Starting || m_state == Ready)) {
+        if (m_state == Starting) {
+            emit processRead(tr("Backend exited with code %1 before it was ready.").arg(e).toLocal8Bit());
+            if (retryOnAnotherPort()) {
+                return;
+            }
+        }
+        else {
+            emit processRead(tr("Backend exited unexpectedly with code %1.").arg(e).toLocal8Bit());
+        }
+        if (!scheduleRestart()) {
+            setState(m_state == Starting ? Failed : Stopped);
+        }
+    }
     emit processStopped();
 }
+
+void SS_Process::onProcessError(QProcess::ProcessError e)
+{
+    if (e == QProcess::FailedToStart && m_state == Starting) {
+        fail(tr("Backend failed to start. %1").arg(proc.errorString()));
+    }
+}
+
+void SS_Process::onReady(qint64)
+{
+    readyDeadline.stop();
+    m_readyLatency = spawnClock.elapsed();
+    uptimeClock.start();
+    if (downtimeClock.isValid()) {
+        m_lastRecovery = downtimeClock.elapsed();
+        m_totalDowntime += m_lastRecovery;
+        downtimeClock.invalidate();
+        emit processRead(tr("%1 recovered after %2 ms of downtime (restart #%3).").arg(typeName).arg(m_lastRecovery).arg(m_restartCount).toLocal8Bit());
+    }
+    setState(Ready);
+    emit processRead(tr("%1 is ready on %2:%3, %4 ms after spawn.").arg(typeName).arg(localAddr.toString()).arg(localPort).arg(m_readyLatency).toLocal8Bit());
+    emit processStarted();
+}
+
+//a libQtShadowsocks controller that never starts doesn't get as far as the probe
+void SS_Process::onReadyDeadline()
+{
+    if (m_state == Starting) {
+        fail(tr("%1 wasn't ready within %2 seconds.").arg(typeName).arg(READY_TIMEOUT / 1000));
+    }
+}
@@ -10,39 +10,151 @@
 #include <QObject>
 #include <QString>
 #include <QProcess>
+#include <QThread>
+#include <QList>
+#include <QElapsedTimer>
+#include <QHostAddress>
+#include <QTimer>
 #include <QtShadowsocks>
 #include "ssprofile.h"
+#include "eventloopmonitor.h"
+#include "portforwarder.h"
+#include "readinessprobe.h"
+#include "backendcapabilities.h"
+#include "trafficmeter.h"
+#include "outputreader.h"
+#include "lineassembler.h"
+#include "logparser.h"
 
 class SS_Process : public QObject
 {
     Q_OBJECT
 
 public:
+    /*
+     * A backend is Ready only after its local port answered a SOCKS5 greeting.
+     * Failed means it exited or never became ready while Starting.
+     * Restarting is the back-off period after an unexpected exit, CrashLoop
+     * means the restart limit was hit and the supervisor gave up.
+     */
+    enum State {Stopped, Starting, Ready, Failed, Restarting, CrashLoop};
+
     SS_Process(QObject *parent = 0);
+    ~SS_Process();
     void start(SSProfile * const, bool debug);
+    //listens on a loopback port of its own choosing instead, listenPort() tells which once Ready
+    void startOnSparePort(SSProfile * const, bool debug);
     void stop();
+    bool isRunning() const;
+    inline State state() const { return m_state; }
+    inline qint64 readyLatency() const { return m_readyLatency; }
+    inline int restartCount() const { return m_restartCount; }
+    inline qint64 totalDowntime() const { return m_totalDowntime; }
+    inline qint64 lastRecoveryTime() const { return m_lastRecovery; }
+    void setRestartPolicy(bool enabled, int delay, int maxDelay, int limit);
+    static quint16 freeLoopbackPort();
+    inline const EventLoopMonitor *qssLoopMonitor(int i = 0) const { return qssMonitors.at(i); }
+    inline int qssWorkerCount() const { return qssWorkers; }
+    inline quint16 listenPort() const { return localPort; }
+    //the address the server name was pinned to at launch, null if passed on as a name
+    inline const QHostAddress &serverAddress() const { return serverAddr; }
+    inline const TrafficMeter &trafficMeter() const { return traffic; }
+    //lines of backend output of each event type since start()
+    inline quint64 eventCount(BackendEvent::Type t) const { return eventCounts[t]; }
+    void sampleTraffic(const SocketAccounting &accounting);
 
 signals:
-    void processRead(const QByteArray &o);
+    //events has one entry per line of backend output, ss-qt5's own messages have none
+    void processRead(const QByteArray &o, const QVector<BackendEvent> &events = QVector<BackendEvent>());
     void processStarted();
     void processStopped();
+    void stateChanged(SS_Process::State);
 
 private:
+    State m_state;
+    qint64 m_readyLatency;
+    QElapsedTimer spawnClock;
+    ReadinessProbe probe;
+    QTimer readyDeadline;
+    QHostAddress localAddr;
+    quint16 localPort;
+    QHostAddress serverAddr;
+    bool awaitingServer;
+    QString typeName;
+    SSProfile m_profile;
+    bool m_debug;
+    bool sparePort;
+    int portRetries;//launches on another spare port since start()
+    TrafficMeter traffic;
+
+    //supervisor
+    bool autoRestart;
+    int restartDelay;
+    int restartMaxDelay;
+    int restartLimit;//restarts allowed within one minute
+    int consecutiveFailures;
+    int m_restartCount;
+    qint64 m_totalDowntime;
+    qint64 m_lastRecovery;
+    QList<qint64> restartTimes;
+    QTimer restartTimer;
+    QElapsedTimer uptimeClock;
+    QElapsedTimer downtimeClock;
+    bool expectingExit;
+    quint32 launchGeneration;//drops capability probes finishing after a stop
     bool libQSS;
-    QSS::Controller *qssController;
+    int qssRunning;//workers of the current run that are running
+    quint32 qssGeneration;//launch the controllers were last started for
+    quint32 qssStopping;//launch whose controllers were last told to stop
+    int qssStoppingCount;//of those, how many haven't reported stopping yet
+    int qssWorkers;
+    QList<QSS::Controller *> qssControllers;
+    QList<QThread *> qssThreads;
+    QList<EventLoopMonitor *> qssMonitors;
+    QList<PortForwarder *> qssForwarders;//one per worker, in its thread, if they can share the port
+    QList<quint16> qssPorts;//loopback ports of the current run's running workers
+    PortForwarder *forwarder;//otherwise a single one for all workers
+    QThread forwarderThread;
     SSProfile::BackendType backendType;
     QString app_path;
-    QProcess proc;
+    BackendProcess proc;
+    OutputReader *reader;
+    QTimer drainTimer;
+    LineAssembler assembler;
+    const LogParser *parser;
+    quint64 eventCounts[BackendEvent::TypeCount];
 
+    void setState(State);
+    void begin(SSProfile * const, bool debug, bool spare);
+    void launch();
+    bool retryOnAnotherPort();
+    void launchBackend();
+    QString serverHost() const;
+    void stopBackend();
+    void fail(const QString &reason);
+    bool scheduleRestart();
+    void addQSSWorker();
     void startQSS(SSProfile * const, bool);
-    void start(const QString&, const QString&, const QString&, const QString&, const QString&, const QString&, const QString&, const QString&, bool debug = false, bool tfo = false);
+    void probeCapabilities();
+    void startExternal(const BackendCapabilities &);
     void start(QString &args);
+    void startReader();
+    void retireReader();
+    void handleOutput(const QByteArray &data);
+    void handleLines(const QList<QByteArray> &lines);
 
 private slots:
     void onProcessReadyRead();
+    void drainOutput();
     void onQSSInfoReady(const QString &);
+    void onQSSRunningStateChanged(quint32 generation, bool running, quint16 port);
     void onStarted();
     void onExited(int);
+    void onProcessError(QProcess::ProcessError);
+    void onReady(qint64);
+    void onRestartTimeout();
+    void onReadyDeadline();
+    void onServerResolved(const QString &host, bool ok);
 };
 
 #endif // SS_PROCESS_H
@@ -6,6 +6,7 @@
 #include <QDebug>
 #include "ssvalidator.h"
 #include "ssprofile.h"
+#include "backendregistry.h"
 
 SSProfile::SSProfile() :
     backend(),
@@ -19,7 +20,8 @@ SSProfile::SSProfile() :
     server(),
     server_port("8388"),
     timeout("600"),
-    type("libQtShadowsocks")
+    type("libQtShadowsocks"),
+    workers(1)
 {}
 
 QByteArray SSProfile::getSsUrl()
@@ -66,9 +68,10 @@ void SSProfile::setBackend(bool relativePath)
 #else
     QStringList findPathsList(QDir::homePath() + "/.config/shadowsocks/bin");
 #endif
-    sslocal = QStandardPaths::findExecutable(execName, findPathsList);//search ss-qt5 directory first
+    BackendRegistry *registry = BackendRegistry::instance();
+    sslocal = registry->findExecutable(execName, findPathsList);//search ss-qt5 directory first
     if(sslocal.isEmpty()) {//if not found then search system's PATH
-        sslocal = QStandardPaths::findExecutable(execName);
+        sslocal = registry->findExecutable(execName);
     }
     this->setBackend(sslocal, relativePath);
 }
@@ -127,39 +130,17 @@ SSProfile::BackendType SSProfile::getBackendType() const
 
 bool SSProfile::isBackendMatchType()
 {
-    QFile file(backend);
-    if (!file.exists()) {
-        if (getBackendType() == SSProfile::LIBQSS && backend.isEmpty()) {
-            return true;
-        }
-        qWarning() << "Backend does not exist. You can safely ignore this message if you're changing the backend type.";
-        return false;
+    if (getBackendType() == SSProfile::LIBQSS && backend.isEmpty()) {
+        return true;
     }
 
-    file.open(QIODevice::ReadOnly | QIODevice::Text);
-    if (!file.isReadable() || !file.isOpen()) {
-        qWarning() << "Cannot read from backend.";
+    //cached per path, mtime and inode, so switching profiles doesn't hit the disk
+    SSProfile::BackendType rType = BackendRegistry::instance()->detectType(backend);
+    if (rType == SSProfile::UNKNOWN) {
+        qWarning() << "Backend does not exist or is not readable. You can safely ignore this message if you're changing the backend type.";
         return false;
     }
 
-    SSProfile::BackendType rType;
-    QString ident(file.readLine());
-    file.close();
-    if (ident.contains("node")) {
-        rType = NODEJS;
-    }
-    else if (ident.contains("python")) {
-        rType = PYTHON;
-    }
-    else {
-        if (backend.contains("ss-local")) {
-            rType = LIBEV;//libev
-        }
-        else {
-            rType = GO;//Go
-        }
-    }
-
     return (rType == this->getBackendType());
 }
 
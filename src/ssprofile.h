@@ -21,6 +21,7 @@ public:
     QString backend;
     QString custom_arg;
     bool fast_open;
+    QString group;//tag used to pick the fastest profile among a group
     QString local_addr;
     QString local_port;
     QString method;
@@ -30,5 +31,6 @@ public:
     QString server_port;
     QString timeout;
     QString type;
+    int workers;
 };
 #endif // SSPROFILE_H
@@ -0,0 +1,59 @@
+#include "trafficmeter.h"
+
+TrafficMeter::TrafficMeter()
+{
+    reset();
+}
+
+void TrafficMeter::reset()
+{
+    up.store(0);
+    down.store(0);
+    lastUp = 0;
+    lastDown = 0;
+    m_upMbps = 0;
+    m_downMbps = 0;
+    m_connections = 0;
+    seen.clear();
+    clock.invalidate();
+}
+
+/*
+ * A backend's client sockets have the backend's local port as source port.
+ * What they received went up the tunnel, what they sent came down. Only the
+ * growth since the last sample is added, so sockets closing between two
+ * samples lose at most their last interval.
+ */
+void TrafficMeter::update(const SocketAccounting &accounting, quint16 port, bool fromSockets)
+{
+    if (fromSockets) {
+        QHash<quint64, Seen> now;
+        const QHash<quint64, SocketAccounting::Socket> &sockets = accounting.sockets();
+        for (QHash<quint64, SocketAccounting::Socket>::const_iterator it = sockets.begin(); it != sockets.end(); ++it) {
+            if (it->port != port) {
+                continue;
+            }
+            Seen s = seen.value(it.key(), Seen{0, 0});
+            up.fetchAndAddRelaxed(it->received - qMin(s.received, it->received));
+            down.fetchAndAddRelaxed(it->acked - qMin(s.acked, it->acked));
+            s.received = it->received;
+            s.acked = it->acked;
+            now.insert(it.key(), s);
+        }
+        seen.swap(now);
+    }
+    m_connections = accounting.established(port);
+
+    quint64 u = up.load();
+    quint64 d = down.load();
+    if (clock.isValid()) {
+        qint64 ms = qMax(Q_INT64_C(1), clock.restart());
+        m_upMbps = (u - lastUp) * 8.0 / 1000.0 / ms;
+        m_downMbps = (d - lastDown) * 8.0 / 1000.0 / ms;
+    }
+    else {
+        clock.start();
+    }
+    lastUp = u;
+    lastDown = d;
+}
@@ -0,0 +1,52 @@
+/*
+ * Traffic Meter Class
+ *
+ * Bytes up and down, current rates and connection count of one backend.
+ * libQtShadowsocks workers add to the byte counters from their own threads,
+ * external backends are metered from socket accounting on every sample.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef TRAFFICMETER_H
+#define TRAFFICMETER_H
+#include <QAtomicInteger>
+#include <QElapsedTimer>
+#include <QHash>
+#include "socketaccounting.h"
+
+class TrafficMeter
+{
+public:
+    TrafficMeter();
+
+    void reset();
+    //safe to call from any thread
+    inline void addUp(quint64 bytes) { up.fetchAndAddRelaxed(bytes); }
+    inline void addDown(quint64 bytes) { down.fetchAndAddRelaxed(bytes); }
+    void update(const SocketAccounting &accounting, quint16 port, bool fromSockets);
+
+    inline quint64 bytesUp() const { return up.load(); }
+    inline quint64 bytesDown() const { return down.load(); }
+    inline double upMbps() const { return m_upMbps; }
+    inline double downMbps() const { return m_downMbps; }
+    inline int connections() const { return m_connections; }
+
+private:
+    struct Seen
+    {
+        quint64 received;
+        quint64 acked;
+    };
+
+    QAtomicInteger<quint64> up;
+    QAtomicInteger<quint64> down;
+    quint64 lastUp;
+    quint64 lastDown;
+    QElapsedTimer clock;
+    double m_upMbps;
+    double m_downMbps;
+    int m_connections;
+    QHash<quint64, Seen> seen;//counters of each client socket at the last sample
+};
+
+#endif // TRAFFICMETER_H
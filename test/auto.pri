@@ -0,0 +1,6 @@
+#one QtTest executable per directory under auto/, run them with make check
+
+QT        += testlib
+CONFIG    += testcase
+
+include($$PWD/common.pri)
@@ -0,0 +1,5 @@
+TEMPLATE = subdirs
+SUBDIRS  = failoverchain \
+           hostresolver \
+           logwriter \
+           portforwarder
@@ -0,0 +1,6 @@
+TARGET    = tst_failoverchain
+TEMPLATE  = app
+
+include(../../auto.pri)
+
+SOURCES  += tst_failoverchain.cpp
@@ -0,0 +1,106 @@
+#include <QtTest>
+#include <QTcpServer>
+#include <QThread>
+#include "fixtures.h"
+#include "failoverchain.h"
+#include "latencytester.h"
+
+/*
+ * A two-profile chain in front of two libQtShadowsocks servers on
+ * loopback, relaying to a stand-in HTTP server that answers the health
+ * checks. The primary's server is stopped and started again.
+ */
+class TestFailoverChain : public QObject
+{
+    Q_OBJECT
+
+private:
+    static const int INTERVAL = 200;
+    static const int FAILURES = 2;
+    static const int FAILBACK = 1000;
+
+    QTcpServer target;
+    SSProfile profiles[2];
+    QSS::Controller *servers[2];
+    QThread forwarders;
+    FailoverChain *chain;
+    SSProfile *started;
+
+    //a SOCKS5 handshake to the target through the chain's local port
+    bool portServes()
+    {
+        LatencyTester tester;
+        tester.setTimeout(3000);
+        tester.setHandshakeTarget(QString("127.0.0.1"), target.serverPort());
+        qint64 handshake = -1;
+        bool done = false;
+        connect(&tester, &LatencyTester::result, [&handshake] (SSProfile *, qint64, qint64 t) { handshake = t; });
+        connect(&tester, &LatencyTester::finished, [&done] { done = true; });
+        QHash<SSProfile *, quint16> through;
+        through.insert(&profiles[0], profiles[0].local_port.toUShort());
+        tester.testThrough(through);
+        waitUntil([&done] { return done; }, 5000);
+        return handshake >= 0;
+    }
+
+private slots:
+    void initTestCase()
+    {
+        serveNoContent(&target);
+        for (int i = 0; i < 2; ++i) {
+            servers[i] = standInServer(&profiles[i], QString("stand-in-%1").arg(i));
+        }
+        chain = new FailoverChain(&forwarders);
+        chain->setRestartPolicy(false, 100, 100, 1);
+        chain->setHealthPolicy(INTERVAL, FAILURES, FAILBACK);
+        chain->setHealthTarget(QString("127.0.0.1"), target.serverPort());
+        started = NULL;
+        connect(chain, &FailoverChain::processStarted, [this] (SSProfile *p) { started = p; });
+        chain->start(QList<SSProfile *>() << &profiles[0] << &profiles[1], false);
+        QVERIFY(waitUntil([this] { return started == &profiles[0]; }, 10000));
+        runFor(50);//the forwarder listens from its own thread
+        QVERIFY(portServes());
+    }
+
+    void failsOverWithinTheHealthPolicy()
+    {
+        runFor(INTERVAL * 2);//let a health check pass first
+        QElapsedTimer t;
+        t.start();
+        servers[0]->stop();
+        //FAILURES failed checks, a backend start and some slack for a loaded machine
+        QVERIFY(waitUntil([this] { return started == &profiles[1]; }, INTERVAL * (FAILURES + 1) + 5000));
+        qDebug() << "failover took" << t.elapsed() << "ms";
+        runFor(50);//the forwarder confirms the new target from its own thread
+        QVERIFY(chain->lastFailoverTime() >= 0);
+        QCOMPARE(chain->activeProfile(), &profiles[1]);
+        QVERIFY(portServes());
+    }
+
+    void failsBackOnceThePrimaryAnswers()
+    {
+        QElapsedTimer t;
+        t.start();
+        servers[0]->start();
+        QVERIFY(waitUntil([this] { return started == &profiles[0]; }, FAILBACK * 2 + 5000));
+        qDebug() << "failback took" << t.elapsed() << "ms";
+        runFor(50);
+        QCOMPARE(chain->activeProfile(), &profiles[0]);
+        QVERIFY(portServes());
+    }
+
+    void cleanupTestCase()
+    {
+        chain->stop();
+        forwarders.quit();
+        forwarders.wait();
+        delete chain;
+        for (int i = 0; i < 2; ++i) {
+            servers[i]->stop();
+            delete servers[i];
+        }
+    }
+};
+
+QTEST_MAIN(TestFailoverChain)
+#include "tst_failoverchain.moc"
@@ -0,0 +1,6 @@
+TARGET    = tst_hostresolver
+TEMPLATE  = app
+
+include(../../auto.pri)
+
+SOURCES  += tst_hostresolver.cpp
@@ -0,0 +1,100 @@
+#include <QtTest>
+#include <QHostInfo>
+#include "fixtures.h"
+#include "hostresolver.h"
+#include "latencytester.h"
+
+/*
+ * Uses the system resolver with localhost, whose addresses come from the
+ * hosts file, so that nothing leaves the machine.
+ */
+class TestHostResolver : public QObject
+{
+    Q_OBJECT
+
+private:
+    HostResolver *resolver;
+
+    bool resolve(const QString &host, QHostAddress *addr)
+    {
+        return waitUntil([this, host, addr] { return resolver->pin(host, addr); }, 5000) && !addr->isNull();
+    }
+
+private slots:
+    void initTestCase()
+    {
+        resolver = HostResolver::instance();
+        resolver->setTtl(300);
+    }
+
+    void init()
+    {
+        resolver->clear();
+    }
+
+    void addressesAreNotPinned()
+    {
+        QHostAddress addr;
+        QVERIFY(resolver->pin(QString("127.0.0.1"), &addr));
+        QVERIFY(addr.isNull());
+    }
+
+    //a prefetched name is answered from the cache, a backend start doesn't wait for it
+    void prefetchedNamePinsAtOnce()
+    {
+        const QString name("localhost");
+        resolver->prefetch(QStringList() << name);
+        QHostAddress addr;
+        QVERIFY(resolve(name, &addr));
+        quint64 hits = resolver->hits();
+        QHostAddress again;
+        QVERIFY(resolver->pin(name, &again));
+        QCOMPARE(again, addr);
+        QCOMPARE(resolver->hits(), hits + 1);
+    }
+
+    //the pinned address refuses connections, a latency test moves the pin to the working one
+    void pinMovesToTheWorkingAddress()
+    {
+        const QString name("localhost");
+        QHostAddress pinned;
+        QVERIFY(resolve(name, &pinned));
+        QList<QHostAddress> all = QHostInfo::fromName(name).addresses();
+        all.removeAll(pinned);
+        if (all.isEmpty()) {
+            QSKIP("localhost has a single address here");
+        }
+        QHostAddress working = all.first();
+
+        SSProfile profile;
+        QSS::Controller *server = standInServer(&profile, name);
+        server->stop();
+        profile.server = working.toString();
+        server->setup(profile.getQSSProfile());
+        QVERIFY(server->start());
+        profile.server = name;
+
+        LatencyTester tester;
+        tester.setTimeout(1000);
+        qint64 connectTime = -1;
+        bool done = false;
+        connect(&tester, &LatencyTester::result, [&connectTime] (SSProfile *, qint64 t, qint64) { connectTime = t; });
+        connect(&tester, &LatencyTester::finished, [&done] { done = true; });
+        for (int i = 0; i < 2; ++i) {
+            done = false;
+            connectTime = -1;
+            tester.test(QList<SSProfile *>() << &profile, false);
+            QVERIFY(waitUntil([&done] { return done; }, 5000));
+        }
+        QHostAddress now;
+        QVERIFY(resolver->pin(name, &now));
+        QCOMPARE(now, working);
+        QVERIFY(connectTime >= 0);
+
+        server->stop();
+        delete server;
+    }
+};
+
+QTEST_MAIN(TestHostResolver)
+#include "tst_hostresolver.moc"
@@ -0,0 +1,6 @@
+TARGET    = tst_logwriter
+TEMPLATE  = app
+
+include(../../auto.pri)
+
+SOURCES  += tst_logwriter.cpp
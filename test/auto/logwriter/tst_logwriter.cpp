@@ -0,0 +1,80 @@
+#include <QtTest>
+#include <QTemporaryDir>
+#include <QFile>
+#include <zlib.h>
+#include "logwriter.h"
+
+class TestLogWriter : public QObject
+{
+    Q_OBJECT
+
+private:
+    //the lines of a log file, without their timestamps
+    static QList<QByteArray> texts(const QByteArray &content)
+    {
+        QList<QByteArray> lines = content.split('\n');
+        if (!lines.isEmpty() && lines.last().isEmpty()) {
+            lines.removeLast();
+        }
+        for (QList<QByteArray>::iterator it = lines.begin(); it != lines.end(); ++it) {
+            *it = it->mid(it->indexOf("] ") + 2);
+        }
+        return lines;
+    }
+
+    static QByteArray gunzip(const QString &name)
+    {
+        QByteArray out;
+        gzFile gz = gzopen(QFile::encodeName(name).constData(), "rb");
+        if (gz == NULL) {
+            return out;
+        }
+        char buf[4096];
+        int n;
+        while ((n = gzread(gz, buf, sizeof(buf))) > 0) {
+            out.append(buf, n);
+        }
+        gzclose(gz);
+        return out;
+    }
+
+    //a LogWriter writes out everything queued when it's deleted
+    static void write(const QString &path, const QList<QByteArray> &lines)
+    {
+        LogWriter w(path, 200 << 10, 0, 2, true);
+        for (QList<QByteArray>::const_iterator it = lines.begin(); it != lines.end(); ++it) {
+            w.append(QString("test"), *it);
+        }
+    }
+
+private slots:
+    //bigger than a compression chunk, so it's streamed in several
+    void rotatedFileRoundTripsThroughGunzip()
+    {
+        QTemporaryDir dir;
+        QVERIFY(dir.isValid());
+        const QString path = dir.path() + "/ss-qt5.log";
+
+        QList<QByteArray> first, second;
+        for (int i = 0; i < 2000; ++i) {
+            first << "first " + QByteArray::number(i) + QByteArray(40, 'a' + i % 26);
+        }
+        for (int i = 0; i < 2000; ++i) {
+            second << "second " + QByteArray::number(i);
+        }
+        write(path, first);
+        write(path, second);//too big together, so the first file is rotated
+
+        QVERIFY(QFile::exists(path + ".1.gz"));
+        QVERIFY(!QFile::exists(path + ".1"));
+        QCOMPARE(texts(gunzip(path + ".1.gz")), first);
+
+        QFile current(path);
+        QVERIFY(current.open(QIODevice::ReadOnly));
+        QCOMPARE(texts(current.readAll()), second);
+        QCOMPARE(QFile(path + ".1.gz").permissions() & (QFileDevice::ReadOther | QFileDevice::ReadGroup), QFileDevice::Permissions());
+    }
+};
+
+QTEST_MAIN(TestLogWriter)
+#include "tst_logwriter.moc"
@@ -0,0 +1,6 @@
+TARGET    = tst_portforwarder
+TEMPLATE  = app
+
+include(../../auto.pri)
+
+SOURCES  += tst_portforwarder.cpp
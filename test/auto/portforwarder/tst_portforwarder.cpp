@@ -0,0 +1,163 @@
+#include <QtTest>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include "fixtures.h"
+#include "portforwarder.h"
+
+/*
+ * A SOCKS5 server that accepts any IPv4 CONNECT and keeps what comes
+ * after it, standing in for a backend and the origin behind it. With
+ * hold set, the CONNECT replies wait for release().
+ */
+class FakeSocks : public QTcpServer
+{
+public:
+    FakeSocks() : requests(0), hold(false)
+    {
+        connect(this, &QTcpServer::newConnection, [this] {
+            while (hasPendingConnections()) {
+                QTcpSocket *s = nextPendingConnection();
+                s->setProperty("stage", 0);
+                connect(s, &QTcpSocket::readyRead, [this, s] { onRead(s); });
+            }
+        });
+        listen(QHostAddress::LocalHost);
+    }
+
+    int requests;
+    bool hold;
+    QByteArray payload;
+
+    void release()
+    {
+        hold = false;
+        for (QList<QTcpSocket *>::iterator it = held.begin(); it != held.end(); ++it) {
+            reply(*it);
+        }
+        held.clear();
+    }
+
+private:
+    QList<QTcpSocket *> held;
+
+    void reply(QTcpSocket *s)
+    {
+        s->write("\x05\x00\x00\x01\x7f\x00\x00\x01\x00\x50", 10);
+        s->setProperty("stage", 2);
+        payload.append(s->readAll());
+    }
+
+    void onRead(QTcpSocket *s)
+    {
+        int stage = s->property("stage").toInt();
+        if (stage == 0 && s->bytesAvailable() >= 3) {
+            s->read(3);
+            s->write("\x05\x00", 2);
+            s->setProperty("stage", 1);
+            stage = 1;
+        }
+        if (stage == 1 && s->bytesAvailable() >= 10) {
+            s->read(10);
+            ++requests;
+            if (hold) {
+                held << s;
+                s->setProperty("stage", 3);
+            }
+            else {
+                reply(s);
+            }
+            return;
+        }
+        if (stage == 2) {
+            payload.append(s->readAll());
+        }
+    }
+};
+
+static const QByteArray greeting("\x05\x01\x00", 3);
+static const QByteArray request("\x05\x01\x00\x01\x7f\x00\x00\x01\x00\x50", 10);
+
+class TestPortForwarder : public QObject
+{
+    Q_OBJECT
+
+private:
+    static quint16 listen(PortForwarder *f, const QList<quint16> &targets)
+    {
+        f->setTargets(targets);
+        f->setHedging(100);
+        if (!f->listen(QHostAddress::LocalHost, 0)) {
+            return 0;
+        }
+        return f->findChild<QTcpServer *>()->serverPort();
+    }
+
+private slots:
+    //the client sends its data right behind the request, before any reply
+    void hedgedPayloadReachesTheOriginOnce()
+    {
+        FakeSocks backends[2];
+        backends[0].hold = backends[1].hold = true;
+        PortForwarder forwarder;
+        quint16 port = listen(&forwarder, QList<quint16>() << backends[0].serverPort() << backends[1].serverPort());
+        QVERIFY(port != 0);
+
+        const QByteArray payload("GET / HTTP/1.1\r\nHost: example.com\r\n\r\n");
+        QTcpSocket client;
+        client.connectToHost(QHostAddress::LocalHost, port);
+        QVERIFY(client.waitForConnected(3000));
+        client.write(greeting + request + payload);
+
+        QVERIFY(waitUntil([&backends] { return backends[0].requests == 1 && backends[1].requests == 1; }, 3000));
+        QCOMPARE(forwarder.hedgedConnections(), 1);
+        QCOMPARE(forwarder.activeConnections(), 2);
+        QCOMPARE(forwarder.activeConnections(backends[0].serverPort()), 1);
+        QCOMPARE(forwarder.activeConnections(backends[1].serverPort()), 1);
+
+        backends[0].release();
+        QVERIFY(waitUntil([&backends, &payload] { return backends[0].payload.size() >= payload.size(); }, 3000));
+        runFor(200);//a copy to the loser would have arrived by now
+        QCOMPARE(backends[0].payload, payload);
+        QVERIFY(backends[1].payload.isEmpty());
+        QCOMPARE(forwarder.activeConnections(), 1);
+        QCOMPARE(forwarder.activeConnections(backends[1].serverPort()), 0);
+
+        QVERIFY(waitUntil([&client] { return client.bytesAvailable() >= 12; }, 3000));
+        QCOMPARE(client.read(2), QByteArray("\x05\x00", 2));
+        QCOMPARE(client.read(2), QByteArray("\x05\x00", 2));
+    }
+
+    //racing a second leg doesn't move round-robin off its order
+    void secondLegKeepsTheRotation()
+    {
+        FakeSocks backends[3];
+        QList<quint16> ports;
+        for (int i = 0; i < 3; ++i) {
+            backends[i].hold = true;
+            ports << backends[i].serverPort();
+        }
+        PortForwarder forwarder;
+        quint16 port = listen(&forwarder, ports);
+        QVERIFY(port != 0);
+
+        QList<QTcpSocket *> clients;
+        for (int i = 0; i < 6; ++i) {
+            QTcpSocket *c = new QTcpSocket(this);
+            c->connectToHost(QHostAddress::LocalHost, port);
+            QVERIFY(c->waitForConnected(3000));
+            c->write(greeting + request);
+            clients << c;
+            QVERIFY(waitUntil([&forwarder, i] { return forwarder.hedgedConnections() == i + 1; }, 3000));
+        }
+        QVERIFY(waitUntil([&backends] { return backends[0].requests + backends[1].requests + backends[2].requests == 12; }, 3000));
+        QCOMPARE(forwarder.activeConnections(), 12);
+        //every target was a first leg twice and a second leg twice
+        for (int i = 0; i < 3; ++i) {
+            QCOMPARE(backends[i].requests, 4);
+        }
+        qDeleteAll(clients);
+    }
+};
+
+QTEST_MAIN(TestPortForwarder)
+#include "tst_portforwarder.moc"
@@ -0,0 +1,11 @@
+TARGET    = ss-qt5-bench
+TEMPLATE  = app
+
+include(../common.pri)
+
+SOURCES  += main.cpp \
+            benchmark.cpp \
+            $$SRC/cipherbenchmark.cpp
+
+HEADERS  += benchmark.h \
+            $$SRC/cipherbenchmark.h
@@ -0,0 +1,710 @@
+#include <QTextStream>
+#include <QTemporaryDir>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QTimer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTime>
+#include <QCoreApplication>
+#include <QThread>
+#include <QThreadPool>
+#include <QSharedPointer>
+#include <QtConcurrent>
+#include <QTextBrowser>
+#include <QListView>
+#include <algorithm>
+#include "benchmark.h"
+#include "fixtures.h"
+#include "backendregistry.h"
+#include "configuration.h"
+#include "loadbalancer.h"
+#include "latencytester.h"
+#include "logbuffer.h"
+#include "logfilter.h"
+#include "eventloopmonitor.h"
+#include "cipherbenchmark.h"
+#include <QtShadowsocks>
+
+#ifdef Q_OS_LINUX
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <unistd.h>
+#include <string.h>
+#endif
+
+bool Benchmark::needsWidgets(int argc, char *argv[])
+{
+    for (int i = 1; i < argc; ++i) {
+        if (QByteArray(argv[i]) == "--bench-log") {
+            return true;
+        }
+    }
+    return false;
+}
+
+int Benchmark::run(const QStringList &args)
+{
+    if (args.contains("--bench-registry")) {
+        return registry();
+    }
+    if (args.contains("--bench-tfo")) {
+        return tfo();
+    }
+    if (args.contains("--bench-ciphers")) {
+        return CipherBenchmark::run();
+    }
+    if (args.contains("--bench-hedge")) {
+        return hedge();
+    }
+    if (args.contains("--bench-lag")) {
+        return lag();
+    }
+    if (args.contains("--bench-log")) {
+        return log();
+    }
+    if (args.contains("--bench-search")) {
+        return search();
+    }
+    if (args.contains("--bench-workers")) {
+        return workers();
+    }
+    QTextStream(stderr) << "Unknown benchmark. Available: --bench-ciphers --bench-hedge --bench-lag --bench-log --bench-registry --bench-search --bench-tfo --bench-workers" << endl;
+    return 1;
+}
+
+/*
+ * Backend type detection and executable lookup, cold (cache dropped before
+ * every lookup, which is what every profile switch used to cost) and warm.
+ */
+int Benchmark::registry()
+{
+    QTextStream out(stdout);
+    const int profiles = 500;
+    const int rounds = 20;
+
+    QTemporaryDir dir;
+    if (!dir.isValid()) {
+        out << "Cannot create a temporary directory." << endl;
+        return 1;
+    }
+    QStringList backends;
+    for (int i = 0; i < profiles; ++i) {
+        QString path = dir.path() + QString("/sslocal-%1").arg(i);
+        QFile f(path);
+        f.open(QIODevice::WriteOnly);
+        f.write(i % 2 ? "#!/usr/bin/env python\n" : "#!/usr/bin/env node\n");
+        f.close();
+        backends << path;
+    }
+
+    BackendRegistry *r = BackendRegistry::instance();
+    QElapsedTimer t;
+
+    qint64 cold = 0;
+    for (int n = 0; n < rounds; ++n) {
+        for (QStringList::iterator it = backends.begin(); it != backends.end(); ++it) {
+            r->invalidate();
+            t.start();
+            r->detectType(*it);
+            cold += t.nsecsElapsed();
+        }
+    }
+    t.start();
+    for (int n = 0; n < rounds; ++n) {
+        for (QStringList::iterator it = backends.begin(); it != backends.end(); ++it) {
+            r->detectType(*it);
+        }
+    }
+    qint64 warm = t.nsecsElapsed();
+
+    const int lookups = profiles * rounds;
+    out << "detectType:     cold " << cold / lookups << " ns/lookup, warm " << warm / lookups << " ns/lookup" << endl;
+
+    cold = 0;
+    for (int n = 0; n < rounds; ++n) {
+        r->invalidate();
+        t.start();
+        r->findExecutable("ss-local");
+        cold += t.nsecsElapsed();
+    }
+    t.start();
+    for (int n = 0; n < lookups; ++n) {
+        r->findExecutable("ss-local");
+    }
+    warm = t.nsecsElapsed();
+    out << "findExecutable: cold " << cold / rounds << " ns/lookup, warm " << warm / lookups << " ns/lookup" << endl;
+    out << "cache hits " << r->hits() << ", misses " << r->misses() << endl;
+    return 0;
+}
+
+#ifdef Q_OS_LINUX
+/*
+ * One request/response exchange with a fresh connection, measured from
+ * socket() until the response arrived. Returns -1 on error.
+ */
+static qint64 loopbackExchange(int listener, const sockaddr_in &addr, bool fastOpen, bool *synData)
+{
+    static const char request[] = "\x05\x01\x00";
+    char buf[16];
+    QElapsedTimer t;
+    t.start();
+
+    int c = socket(AF_INET, SOCK_STREAM, 0);
+    if (c < 0) {
+        return -1;
+    }
+    ssize_t sent;
+    if (fastOpen) {
+        //connects and carries the request in the SYN once a cookie is cached
+        sent = sendto(c, request, sizeof(request) - 1, MSG_FASTOPEN, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr));
+    }
+    else if (::connect(c, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) == 0) {
+        sent = send(c, request, sizeof(request) - 1, 0);
+    }
+    else {
+        sent = -1;
+    }
+
+    int s = sent < 0 ? -1 : accept(listener, NULL, NULL);
+    qint64 elapsed = -1;
+    if (s >= 0 && recv(s, buf, sizeof(buf), 0) > 0 && send(s, "\x05\x00", 2, 0) == 2 && recv(c, buf, sizeof(buf), 0) > 0) {
+        elapsed = t.nsecsElapsed();
+        tcp_info info;
+        socklen_t len = sizeof(info);
+        *synData = getsockopt(c, IPPROTO_TCP, TCP_INFO, &info, &len) == 0 && (info.tcpi_options & TCPI_OPT_SYN_DATA);
+    }
+    if (s >= 0) {
+        close(s);
+    }
+    close(c);
+    return elapsed;
+}
+#endif
+
+/*
+ * A SOCKS5 greeting and its answer over loopback, with and without TCP
+ * Fast Open. Needs both bits of net.ipv4.tcp_fastopen (value 3), since
+ * both ends of the exchange live in this process.
+ */
+int Benchmark::tfo()
+{
+    QTextStream out(stdout);
+#ifdef Q_OS_LINUX
+    const int rounds = 2000;
+    int mode = Configuration::tcpFastOpenMode();
+    out << "net.ipv4.tcp_fastopen = " << mode << endl;
+
+    int listener = socket(AF_INET, SOCK_STREAM, 0);
+    int qlen = 64;
+    setsockopt(listener, IPPROTO_TCP, TCP_FASTOPEN, &qlen, sizeof(qlen));
+    sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrLen = sizeof(addr);
+    if (bind(listener, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listener, 128) != 0 || getsockname(listener, reinterpret_cast<sockaddr *>(&addr), &addrLen) != 0) {
+        out << "Cannot listen on loopback." << endl;
+        close(listener);
+        return 1;
+    }
+
+    for (int fastOpen = 0; fastOpen < 2; ++fastOpen) {
+        qint64 total = 0;
+        int samples = 0;
+        int withData = 0;
+        bool synData = false;
+        loopbackExchange(listener, addr, fastOpen, &synData);//fetches the cookie
+        for (int n = 0; n < rounds; ++n) {
+            synData = false;
+            qint64 ns = loopbackExchange(listener, addr, fastOpen, &synData);
+            if (ns >= 0) {
+                total += ns;
+                ++samples;
+                withData += synData ? 1 : 0;
+            }
+        }
+        if (samples == 0) {
+            out << (fastOpen ? "fast open: " : "regular:   ") << "failed" << endl;
+            continue;
+        }
+        out << (fastOpen ? "fast open: " : "regular:   ") << total / samples << " ns/exchange";
+        if (fastOpen) {
+            out << ", data in SYN " << withData << "/" << samples;
+        }
+        out << endl;
+    }
+    close(listener);
+    return 0;
+#else
+    out << "TCP Fast Open benchmark is only available on Linux." << endl;
+    return 1;
+#endif
+}
+
+/*
+ * Two libQtShadowsocks servers on loopback behind a load balancer, in
+ * front of a stand-in HTTP server that answers one connection in ten late.
+ * Sequential requests through the local port are timed until the first
+ * response byte, without hedging and with every connection hedged.
+ */
+int Benchmark::hedge()
+{
+    QTextStream out(stdout);
+    const int samples = 300;
+    const int slowPercent = 10;
+    const int slowDelay = 200;
+
+    qsrand(QTime::currentTime().msec());
+    QTcpServer target;
+    serveNoContent(&target, slowPercent, slowDelay);
+
+    SSProfile profiles[2];
+    QSS::Controller *servers[2];
+    for (int i = 0; i < 2; ++i) {
+        servers[i] = standInServer(&profiles[i], QString("stand-in-%1").arg(i));
+    }
+
+    QThread forwarders;
+    LoadBalancer balancer(&forwarders);
+    balancer.setRestartPolicy(false, 100, 100, 1);
+    balancer.setHealthPolicy(600000, 1000);
+    balancer.setPolicy(PortForwarder::RoundRobin);
+    int ready = 0;
+    QObject::connect(&balancer, &LoadBalancer::processStarted, [&ready] { ++ready; });
+    QList<SSProfile *> pool;
+    pool << &profiles[0] << &profiles[1];
+    balancer.start(pool, false);
+
+    int ret = 0;
+    if (!waitUntil([&] { return ready == 2; }, 10000)) {
+        out << "The backends didn't start." << endl;
+        ret = 1;
+    }
+    runFor(100);//the forwarder listens from its own thread
+
+    LatencyTester tester;
+    tester.setTimeout(3000);
+    tester.setHandshakeTarget(QString("127.0.0.1"), target.serverPort());
+    qint64 last = -1;
+    bool done = false;
+    QObject::connect(&tester, &LatencyTester::result, [&last] (SSProfile *, qint64, qint64 handshakeTime) { last = handshakeTime; });
+    QObject::connect(&tester, &LatencyTester::finished, [&done] { done = true; });
+    QHash<SSProfile *, quint16> through;
+    through.insert(&profiles[0], profiles[0].local_port.toUShort());
+
+    out << samples << " requests, " << slowPercent << "% of the target's answers delayed by " << slowDelay << " ms" << endl;
+    for (int budget = 0; budget <= 100 && ret == 0; budget += 100) {
+        balancer.setHedging(budget);
+        runFor(50);
+        int hedged = balancer.hedgedConnections();
+        int wins = balancer.hedgeWins();
+        QList<qint64> times;
+        int failed = 0;
+        for (int n = 0; n < samples; ++n) {
+            done = false;
+            last = -1;
+            tester.testThrough(through);
+            waitUntil([&done] { return done; }, 5000);
+            if (last >= 0) {
+                times << last;
+            }
+            else {
+                ++failed;
+            }
+        }
+        std::sort(times.begin(), times.end());
+        out << (budget > 0 ? "Hedged:     " : "Not hedged: ") << "p50 " << percentile(times, 50) << " ms, p99 " << percentile(times, 99) << " ms, " << failed << " failed";
+        if (budget > 0) {
+            out << ", " << balancer.hedgedConnections() - hedged << " raced, " << balancer.hedgeWins() - wins << " won by the second profile";
+        }
+        out << endl;
+    }
+
+    balancer.stop();
+    forwarders.quit();
+    forwarders.wait();
+    for (int i = 0; i < 2; ++i) {
+        servers[i]->stop();
+        delete servers[i];
+    }
+    return ret;
+}
+
+/*
+ * Debug output arriving in chunks of a few lines, with the event loop
+ * running between chunks: appended to a QTextBrowser chunk by chunk as
+ * the log tab used to, and queued to the log buffer behind a list view.
+ * The text browser gets far fewer lines, it slows down as it grows.
+ */
+int Benchmark::log()
+{
+    QTextStream out(stdout);
+    const int browserLines = 20000;
+    const int bufferLines = 1000000;
+    const int perChunk = 8;
+
+    QByteArray chunk;
+    for (int i = 0; i < perChunk; ++i) {
+        chunk.append(QString("2015-01-01 12:00:00 DEBUG: TCP connection from 127.0.0.1:%1 to www.example.com:443 opened\n").arg(40000 + i).toLocal8Bit());
+    }
+    QElapsedTimer t;
+
+    QTextBrowser browser;
+    browser.resize(640, 480);
+    browser.show();
+    t.start();
+    for (int n = 0; n < browserLines / perChunk; ++n) {
+        browser.append(QString::fromLocal8Bit(chunk).trimmed());
+        browser.moveCursor(QTextCursor::End);
+        QCoreApplication::processEvents();
+    }
+    qint64 browserTime = qMax(qint64(1), t.elapsed());
+    browser.hide();
+    out << "QTextBrowser: " << browserLines << " lines in " << browserTime << " ms, " << browserLines * 1000 / browserTime << " lines/s" << endl;
+
+    LogBuffer buffer;
+    buffer.setLimit(qint64(512) << 20);
+    QListView view;
+    view.setUniformItemSizes(true);
+    view.setModel(&buffer);
+    view.resize(640, 480);
+    view.show();
+    QObject::connect(&buffer, &LogBuffer::rowsInserted, &view, &QListView::scrollToBottom);
+    t.start();
+    for (int n = 0; n < bufferLines / perChunk; ++n) {
+        buffer.append(chunk, QString(), LogParser::forBackend(SSProfile::LIBEV)->parseLines(chunk));
+        QCoreApplication::processEvents();
+    }
+    buffer.flush();
+    QCoreApplication::processEvents();
+    qint64 bufferTime = qMax(qint64(1), t.elapsed());
+    out << "Log buffer:   " << bufferLines << " lines in " << bufferTime << " ms, " << bufferLines * 1000 / bufferTime << " lines/s ("
+        << buffer.rowCount() << " kept in " << buffer.bytes() / 1048576 << " MB, " << buffer.dropped() << " dropped)" << endl;
+
+    t.start();
+    view.scrollToTop();
+    view.repaint();
+    view.scrollToBottom();
+    view.repaint();
+    out << "Jumping to the first line and back with " << buffer.rowCount() << " lines: " << t.elapsed() << " ms" << endl;
+    return 0;
+}
+
+static void timeQuery(QTextStream &out, LogFilter *filter, const QString &name, const LogBuffer::Query &q)
+{
+    QElapsedTimer t;
+    t.start();
+    filter->setQuery(q);
+    out << name.leftJustified(28) << filter->rowCount() << " lines in " << QString::number(t.nsecsElapsed() / 1e6, 'f', 1) << " ms" << endl;
+}
+
+/*
+ * A million lines of four profiles connecting to a thousand hosts, with
+ * a few errors and timeouts, filtered as in the log tab. Typing a search
+ * text only narrows the lines found for the previous keystroke.
+ */
+int Benchmark::search()
+{
+    QTextStream out(stdout);
+    const int total = 1000000;
+    const int perChunk = 100;
+    const LogParser *parser = LogParser::forBackend(SSProfile::LIBEV);
+
+    LogBuffer buffer;
+    buffer.setLimit(qint64(1) << 30);
+    QElapsedTimer t;
+    t.start();
+    for (int n = 0; n < total / perChunk; ++n) {
+        QByteArray chunk;
+        for (int i = 0; i < perChunk; ++i) {
+            int k = n * perChunk + i;
+            if (k % 97 == 0) {
+                chunk += "ERROR: connect to upstream timed out\n";
+            }
+            else if (k % 50 == 0) {
+                chunk += "ERROR: remote recv: Connection refused\n";
+            }
+            else {
+                chunk += QString("INFO: connect to host%1.example.com:443\n").arg(k % 1000).toLatin1();
+            }
+        }
+        buffer.append(chunk, QString("profile%1").arg(n % 4), parser->parseLines(chunk));
+        if (n % 100 == 99) {
+            buffer.flush();
+        }
+    }
+    buffer.flush();
+    out << "Indexed " << buffer.rowCount() << " lines in " << t.elapsed() << " ms, " << buffer.bytes() / 1048576 << " MB" << endl;
+
+    LogFilter filter(&buffer);
+    LogBuffer::Query q;
+    timeQuery(out, &filter, "All lines", q);
+    q.type = BackendEvent::Error;
+    timeQuery(out, &filter, "Errors", q);
+    q.type = BackendEvent::Timeout;
+    timeQuery(out, &filter, "Timeouts", q);
+    q.type = -1;
+    q.profile = "profile2";
+    timeQuery(out, &filter, "One profile", q);
+    q.profile.clear();
+    q.host = "host42.example.com";
+    timeQuery(out, &filter, "One host", q);
+    q.host = "host42";
+    timeQuery(out, &filter, "Hosts containing host42", q);
+    q.host.clear();
+    q.from = buffer.dataAt(buffer.firstSeq() + buffer.rowCount() / 2, LogBuffer::TimeRole).toDateTime();
+    timeQuery(out, &filter, "Second half", q);
+    q.from = QDateTime();
+    q.text = "refused";
+    timeQuery(out, &filter, "Text, whole buffer", q);
+
+    q.text.clear();
+    timeQuery(out, &filter, "All lines", q);
+    QString typed = "host7.example";
+    for (int i = 1; i <= typed.size(); ++i) {
+        q.text = typed.left(i);
+        timeQuery(out, &filter, QString("Typing \"%1\"").arg(q.text), q);
+    }
+
+    q.text.clear();
+    q.type = BackendEvent::Connect;
+    q.profile = "profile1";
+    q.host = "host1";
+    timeQuery(out, &filter, "Connections, profile, host", q);
+
+    t.start();
+    const QByteArray connects = QByteArray("INFO: connect to host1.example.com:443\n").repeated(perChunk);
+    for (int n = 0; n < 100; ++n) {
+        buffer.append(connects, "profile1", parser->parseLines(connects));
+        buffer.flush();
+    }
+    out << "Appending " << 100 * perChunk << " lines in flushes of " << perChunk << " with the filter above: " << t.elapsed() << " ms, " << filter.rowCount() << " lines shown" << endl;
+    return 0;
+}
+
+/*
+ * Relay latency while the GUI thread is busy 15 ms out of every 20, as
+ * with dialogues, QR scanning or log floods. A loopback echo server
+ * stands in for the relay, living in the GUI thread as the controller
+ * used to and in a worker thread as it does now. A client on a third
+ * thread times round trips through it.
+ */
+int Benchmark::lag()
+{
+    QTextStream out(stdout);
+    const int pings = 500;
+
+    QTimer load;
+    load.setInterval(20);
+    QObject::connect(&load, &QTimer::timeout, [] {
+        QElapsedTimer busy;
+        busy.start();
+        while (busy.elapsed() < 15) {}
+    });
+
+    for (int pass = 0; pass < 2; ++pass) {
+        bool worker = pass == 1;
+        QThread relayThread;
+        QObject *host = new QObject;
+        EventLoopMonitor *monitor = new EventLoopMonitor(10);
+        if (worker) {
+            host->moveToThread(&relayThread);
+            monitor->moveToThread(&relayThread);
+            QObject::connect(&relayThread, &QThread::finished, host, &QObject::deleteLater);
+            QObject::connect(&relayThread, &QThread::finished, monitor, &QObject::deleteLater);
+            relayThread.start();
+        }
+        QAtomicInt port(0);
+        QTimer::singleShot(0, host, [host, &port] {
+            QTcpServer *echo = new QTcpServer(host);
+            echo->listen(QHostAddress::LocalHost, 0);
+            QObject::connect(echo, &QTcpServer::newConnection, [echo] {
+                QTcpSocket *s = echo->nextPendingConnection();
+                QObject::connect(s, &QTcpSocket::readyRead, [s] { s->write(s->readAll()); });
+                QObject::connect(s, &QTcpSocket::disconnected, s, &QObject::deleteLater);
+            });
+            port.store(echo->serverPort());
+        });
+        QTimer::singleShot(0, monitor, [monitor] { monitor->start(); });
+        waitUntil([&port] { return port.load() != 0; }, 5000);
+
+        load.start();
+        quint16 p = static_cast<quint16>(port.load());
+        QFuture<QList<qint64> > rtts = QtConcurrent::run([p, pings] {
+            QList<qint64> l;
+            QTcpSocket s;
+            s.connectToHost(QHostAddress::LocalHost, p);
+            if (!s.waitForConnected(3000)) {
+                return l;
+            }
+            QElapsedTimer t;
+            for (int i = 0; i < pings; ++i) {
+                t.start();
+                s.write("ping");
+                s.waitForBytesWritten(1000);
+                QByteArray got;
+                while (got.size() < 4 && s.waitForReadyRead(3000)) {
+                    got += s.readAll();
+                }
+                l << t.nsecsElapsed() / 1000;
+                QThread::msleep(3);
+            }
+            std::sort(l.begin(), l.end());
+            return l;
+        });
+        waitUntil([&rtts] { return rtts.isFinished(); }, 120000);
+        load.stop();
+
+        QList<qint64> sorted = rtts.result();
+        out << (worker ? "Relay in a worker thread: " : "Relay in the GUI thread:  ")
+            << "round trip p50 " << percentile(sorted, 50) << " us, p99 " << percentile(sorted, 99)
+            << " us, relay event loop lag avg " << QString::number(monitor->averageLag(), 'f', 2) << " ms, max " << monitor->maxLag() << " ms" << endl;
+
+        if (worker) {
+            relayThread.quit();
+            relayThread.wait();
+        }
+        else {
+            delete monitor;
+            delete host;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Download throughput of a libQtShadowsocks profile with one worker and
+ * with one per core, over parallel connections to a loopback sink. The
+ * server side is as many servers, each on a thread of its own, behind a
+ * port forwarder, so that it doesn't cap the client.
+ */
+int Benchmark::workers()
+{
+    QTextStream out(stdout);
+    const int connections = 8;
+    const qint64 perConnection = 32 << 20;
+    const int cores = qMax(2, QThread::idealThreadCount());
+
+    QThread sinkThread;
+    QObject *sinkHost = new QObject;
+    sinkHost->moveToThread(&sinkThread);
+    QObject::connect(&sinkThread, &QThread::finished, sinkHost, &QObject::deleteLater);
+    sinkThread.start();
+    QAtomicInt sinkPort(0);
+    QTimer::singleShot(0, sinkHost, [sinkHost, &sinkPort, perConnection] {
+        QTcpServer *sink = new QTcpServer(sinkHost);
+        sink->listen(QHostAddress::LocalHost, 0);
+        QObject::connect(sink, &QTcpServer::newConnection, [sink, perConnection] {
+            QTcpSocket *s = sink->nextPendingConnection();
+            const QByteArray chunk(64 << 10, 'x');
+            QSharedPointer<qint64> left(new qint64(perConnection - chunk.size()));
+            QObject::connect(s, &QTcpSocket::bytesWritten, [s, chunk, left] {
+                while (*left > 0 && s->bytesToWrite() < 4 * chunk.size()) {
+                    s->write(chunk);
+                    *left -= chunk.size();
+                }
+            });
+            QObject::connect(s, &QTcpSocket::disconnected, s, &QObject::deleteLater);
+            s->write(chunk);
+        });
+        sinkPort.store(sink->serverPort());
+    });
+
+    SSProfile client;
+    client.profileName = QString("workers");
+    client.server = QString("127.0.0.1");
+    client.method = QString("aes-256-cfb");
+    client.password = QString("stand-in");
+
+    QList<QThread *> serverThreads;
+    QList<quint16> serverPorts;
+    for (int i = 0; i < cores; ++i) {
+        QSS::Profile sp = client.getQSSProfile();
+        sp.server_port = SS_Process::freeLoopbackPort();
+        serverPorts << sp.server_port;
+        QThread *t = new QThread;
+        QSS::Controller *c = new QSS::Controller(false);
+        c->moveToThread(t);
+        QObject::connect(t, &QThread::finished, c, &QObject::deleteLater);
+        t->start();
+        QTimer::singleShot(0, c, [c, sp] {
+            c->setup(sp);
+            c->start();
+        });
+        serverThreads << t;
+    }
+    QThread frontThread;
+    PortForwarder *front = new PortForwarder;
+    front->moveToThread(&frontThread);
+    QObject::connect(&frontThread, &QThread::finished, front, &QObject::deleteLater);
+    frontThread.start();
+    const quint16 frontPort = SS_Process::freeLoopbackPort();
+    QTimer::singleShot(0, front, [front, serverPorts, frontPort] {
+        front->setTargets(serverPorts);
+        front->listen(QHostAddress::LocalHost, frontPort);
+    });
+    client.server_port = QString::number(frontPort);
+    waitUntil([&sinkPort] { return sinkPort.load() != 0; }, 5000);
+    runFor(200);
+
+    QThreadPool pool;
+    pool.setMaxThreadCount(connections);
+    QList<int> counts;
+    counts << 1 << cores;
+    for (QList<int>::const_iterator n = counts.begin(); n != counts.end(); ++n) {
+        client.workers = *n;
+        client.local_port = QString::number(SS_Process::freeLoopbackPort());
+        SS_Process proc;
+        proc.setRestartPolicy(false, 100, 100, 1);
+        bool started = false;
+        QObject::connect(&proc, &SS_Process::processStarted, [&started] { started = true; });
+        proc.start(&client, false);
+        if (!waitUntil([&started] { return started; }, 10000)) {
+            out << "Backend with " << *n << " workers didn't start" << endl;
+            continue;
+        }
+        runFor(200);
+
+        const quint16 proxy = client.local_port.toUShort();
+        const quint16 target = static_cast<quint16>(sinkPort.load());
+        QElapsedTimer timer;
+        timer.start();
+        QList<QFuture<qint64> > downloads;
+        for (int i = 0; i < connections; ++i) {
+            downloads << QtConcurrent::run(&pool, socksDownload, proxy, target, perConnection);
+        }
+        waitUntil([&downloads] {
+            for (QList<QFuture<qint64> >::const_iterator it = downloads.begin(); it != downloads.end(); ++it) {
+                if (!it->isFinished()) {
+                    return false;
+                }
+            }
+            return true;
+        }, 300000);
+        const qint64 elapsed = qMax(qint64(1), timer.elapsed());
+        qint64 received = 0;
+        for (QList<QFuture<qint64> >::const_iterator it = downloads.begin(); it != downloads.end(); ++it) {
+            received += it->result();
+        }
+        out << qSetFieldWidth(3) << *n << qSetFieldWidth(0) << " workers: "
+            << QString::number(received / 1048576.0 / (elapsed / 1000.0), 'f', 1) << " MB/s over "
+            << connections << " connections (" << received / 1048576 << " MB in " << elapsed << " ms)" << endl;
+
+        proc.stop();
+        runFor(200);
+    }
+
+    frontThread.quit();
+    frontThread.wait();
+    for (QList<QThread *>::iterator it = serverThreads.begin(); it != serverThreads.end(); ++it) {
+        (*it)->quit();
+        (*it)->wait();
+        delete *it;
+    }
+    sinkThread.quit();
+    sinkThread.wait();
+    return 0;
+}
@@ -0,0 +1,30 @@
+/*
+ * Benchmark Class
+ *
+ * Command-line micro benchmarks, run with ss-qt5-bench --bench-<name>.
+ * They report to stdout and aren't part of ss-qt5. Only --bench-log
+ * constructs widgets, since it times the log view.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef BENCHMARK_H
+#define BENCHMARK_H
+#include <QStringList>
+
+class Benchmark
+{
+public:
+    static bool needsWidgets(int argc, char *argv[]);
+    static int run(const QStringList &args);
+
+private:
+    static int registry();
+    static int tfo();
+    static int hedge();
+    static int lag();
+    static int log();
+    static int search();
+    static int workers();
+};
+
+#endif // BENCHMARK_H
@@ -0,0 +1,13 @@
+#include <QApplication>
+#include <QCoreApplication>
+#include "benchmark.h"
+
+int main(int argc, char *argv[])
+{
+    if (Benchmark::needsWidgets(argc, argv)) {
+        QApplication b(argc, argv);
+        return Benchmark::run(b.arguments());
+    }
+    QCoreApplication b(argc, argv);
+    return Benchmark::run(b.arguments());
+}
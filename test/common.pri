@@ -0,0 +1,76 @@
+#the classes under test, built from ../src, and the fixtures shared by the tests and benchmarks
+
+QT        += core gui widgets network concurrent
+CONFIG    += c++11 console
+CONFIG    -= app_bundle
+DEFINES   += APP_VERSION=\\\"test\\\"
+
+SRC = $$PWD/../src
+INCLUDEPATH += $$SRC $$PWD
+
+SOURCES   += $$SRC/ss_process.cpp \
+             $$SRC/backendmanager.cpp \
+             $$SRC/frontedgroup.cpp \
+             $$SRC/hotstandby.cpp \
+             $$SRC/failoverchain.cpp \
+             $$SRC/loadbalancer.cpp \
+             $$SRC/latencytester.cpp \
+             $$SRC/hostresolver.cpp \
+             $$SRC/eventloopmonitor.cpp \
+             $$SRC/portforwarder.cpp \
+             $$SRC/readinessprobe.cpp \
+             $$SRC/backendcapabilities.cpp \
+             $$SRC/backendregistry.cpp \
+             $$SRC/ssprofile.cpp \
+             $$SRC/ssvalidator.cpp \
+             $$SRC/configuration.cpp \
+             $$SRC/socketaccounting.cpp \
+             $$SRC/trafficmeter.cpp \
+             $$SRC/outputreader.cpp \
+             $$SRC/lineassembler.cpp \
+             $$SRC/logparser.cpp \
+             $$SRC/logbuffer.cpp \
+             $$SRC/logfilter.cpp \
+             $$SRC/logwriter.cpp \
+             $$SRC/metricsserver.cpp \
+             $$PWD/fixtures.cpp
+
+HEADERS   += $$SRC/ss_process.h \
+             $$SRC/backendmanager.h \
+             $$SRC/frontedgroup.h \
+             $$SRC/hotstandby.h \
+             $$SRC/failoverchain.h \
+             $$SRC/loadbalancer.h \
+             $$SRC/latencytester.h \
+             $$SRC/hostresolver.h \
+             $$SRC/eventloopmonitor.h \
+             $$SRC/portforwarder.h \
+             $$SRC/readinessprobe.h \
+             $$SRC/backendcapabilities.h \
+             $$SRC/backendregistry.h \
+             $$SRC/ssprofile.h \
+             $$SRC/ssvalidator.h \
+             $$SRC/configuration.h \
+             $$SRC/socketaccounting.h \
+             $$SRC/trafficmeter.h \
+             $$SRC/outputreader.h \
+             $$SRC/lineassembler.h \
+             $$SRC/logparser.h \
+             $$SRC/logbuffer.h \
+             $$SRC/logfilter.h \
+             $$SRC/logwriter.h \
+             $$SRC/metricsserver.h \
+             $$PWD/fixtures.h
+
+isEmpty(BOTAN_VER) {
+    BOTAN_VER = 1.10
+}
+
+win32: {
+    DEFINES += QSS_STATIC
+    LIBS    += -L./ -lQtShadowsocks -lbotan-$$BOTAN_VER -lz
+}
+unix : {
+    CONFIG    += link_pkgconfig
+    PKGCONFIG += QtShadowsocks botan-$$BOTAN_VER zlib
+}
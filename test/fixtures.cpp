@@ -0,0 +1,71 @@
+#include <QTcpSocket>
+#include "fixtures.h"
+#include "ss_process.h"
+
+void runFor(int msec)
+{
+    QEventLoop loop;
+    QTimer::singleShot(msec, &loop, SLOT(quit()));
+    loop.exec();
+}
+
+void serveNoContent(QTcpServer *target, int slowPercent, int slowDelay, int *requests)
+{
+    target->listen(QHostAddress::LocalHost, 0);
+    QObject::connect(target, &QTcpServer::newConnection, [target, slowPercent, slowDelay, requests] {
+        QTcpSocket *s = target->nextPendingConnection();
+        int delay = qrand() % 100 < slowPercent ? slowDelay : 0;
+        QObject::connect(s, &QTcpSocket::readyRead, [s, delay, requests] {
+            QByteArray r = s->readAll();
+            if (requests) {
+                *requests += r.count("\r\n\r\n");
+            }
+            QTimer::singleShot(delay, s, [s] { s->write("HTTP/1.1 204 No Content\r\nContent-Length: 0\r\n\r\n"); });
+        });
+        QObject::connect(s, &QTcpSocket::disconnected, s, &QObject::deleteLater);
+    });
+}
+
+QSS::Controller *standInServer(SSProfile *p, const QString &name)
+{
+    p->profileName = name;
+    p->server = QString("127.0.0.1");
+    p->server_port = QString::number(SS_Process::freeLoopbackPort());
+    p->local_port = QString::number(SS_Process::freeLoopbackPort());
+    p->method = QString("aes-256-cfb");
+    p->password = QString("stand-in");
+    QSS::Controller *c = new QSS::Controller(false);
+    c->setup(p->getQSSProfile());
+    c->start();
+    return c;
+}
+
+qint64 socksDownload(quint16 proxy, quint16 target, qint64 bytes)
+{
+    QTcpSocket s;
+    s.connectToHost(QHostAddress::LocalHost, proxy);
+    if (!s.waitForConnected(3000)) {
+        return 0;
+    }
+    s.write("\x05\x01\x00", 3);
+    while (s.bytesAvailable() < 2 && s.waitForReadyRead(3000)) {}
+    s.read(2);
+    QByteArray request("\x05\x01\x00\x01\x7f\x00\x00\x01", 8);
+    request.append(static_cast<char>(target >> 8));
+    request.append(static_cast<char>(target & 0xff));
+    s.write(request);
+    while (s.bytesAvailable() < 10 && s.waitForReadyRead(3000)) {}
+    if (s.read(10).size() < 10) {
+        return 0;
+    }
+    qint64 received = 0;
+    while (received < bytes && (s.bytesAvailable() > 0 || s.waitForReadyRead(5000))) {
+        received += s.readAll().size();
+    }
+    return received;
+}
+
+qint64 percentile(const QList<qint64> &sorted, int p)
+{
+    return sorted.isEmpty() ? -1 : sorted.at(qMin(sorted.size() - 1, sorted.size() * p / 100));
+}
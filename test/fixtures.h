@@ -0,0 +1,51 @@
+/*
+ * Test Fixtures
+ *
+ * Stand-in servers and event loop helpers shared by the tests and the
+ * benchmarks. Everything runs on loopback.
+ *
+ * Copyright 2014-2015 Symeon Huang <hzwhuang@gmail.com>
+ */
+#ifndef FIXTURES_H
+#define FIXTURES_H
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QTimer>
+#include <QTcpServer>
+#include <QList>
+#include <QtShadowsocks>
+#include "ssprofile.h"
+
+//runs the event loop until done() is true or timeout milliseconds passed
+template<typename Predicate>
+bool waitUntil(Predicate done, int timeout)
+{
+    QElapsedTimer t;
+    t.start();
+    QEventLoop loop;
+    while (!done() && t.elapsed() < timeout) {
+        QTimer::singleShot(5, &loop, SLOT(quit()));
+        loop.exec();
+    }
+    return done();
+}
+
+void runFor(int msec);
+
+/*
+ * A stand-in HTTP server answering every request with 204, slowPercent
+ * of the connections only after slowDelay milliseconds. requests counts
+ * the requests it got, if not NULL.
+ */
+void serveNoContent(QTcpServer *target, int slowPercent = 0, int slowDelay = 0, int *requests = NULL);
+
+//fills in p for a libQtShadowsocks server on loopback and starts that server
+QSS::Controller *standInServer(SSProfile *p, const QString &name);
+
+//downloads bytes from 127.0.0.1:target through the SOCKS5 port, returns what arrived
+qint64 socksDownload(quint16 proxy, quint16 target, qint64 bytes);
+
+//p-th percentile of sorted samples
+qint64 percentile(const QList<qint64> &sorted, int p);
+
+#endif // FIXTURES_H
@@ -0,0 +1,10 @@
+#-------------------------------------------------
+#
+#   Tests and benchmarks of Shadowsocks-Qt5
+#   not part of ss-qt5, build with qmake test/test.pro
+#
+#-------------------------------------------------
+
+TEMPLATE = subdirs
+SUBDIRS  = auto \
+           bench